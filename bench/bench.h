@@ -0,0 +1,123 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: bench.h
+  Created: 2019-12-10
+  Updated: 2019-12-14
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file bench.h
+//! Helpers shared by the headless benchmarks.
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "0.1.0"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h> // calloc, free
+#include <string.h> // strcmp
+#include <time.h> // struct timespec, clock_gettime
+
+#include "bus.h"
+#include "cart.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "sprite.h"
+
+struct system {
+        struct cart *cart;
+        struct cpu *cpu;
+        struct ppu *ppu;
+        struct bus *bus;
+};
+
+static inline void SystemDeinit(struct system *system) {
+        if (NULL == system)
+                return;
+        if (NULL != system->bus)
+                BusDeinit(system->bus);
+        if (NULL != system->ppu)
+                PpuDeinit(system->ppu);
+        if (NULL != system->cpu)
+                CpuDeinit(system->cpu);
+        if (NULL != system->cart)
+                CartDeinit(system->cart);
+        free(system);
+}
+
+static inline struct system *SystemInit(char *romFile, enum cpu_core core) {
+        struct system *system = (struct system *)calloc(1, sizeof(struct system));
+        if (NULL == system)
+                return NULL;
+
+        system->cart = CartInit(romFile);
+        if (NULL == system->cart || !CartIsImageValid(system->cart)) {
+                SystemDeinit(system);
+                return NULL;
+        }
+
+        system->cpu = CpuInit();
+        system->ppu = PpuInit();
+        if (NULL == system->cpu || NULL == system->ppu) {
+                SystemDeinit(system);
+                return NULL;
+        }
+
+        system->bus = BusInit(system->cpu, system->ppu);
+        if (NULL == system->bus) {
+                SystemDeinit(system);
+                return NULL;
+        }
+
+        CpuConnectBus(system->cpu, system->bus);
+        BusAttachCart(system->bus, system->cart);
+        BusReset(system->bus);
+        CpuSetCore(system->cpu, core);
+
+        return system;
+}
+
+//! \brief FNV-1a hash of the current screen contents
+static inline uint32_t ScreenHash(struct ppu *ppu) {
+        struct sprite *screen = PpuScreen(ppu);
+        uint32_t hash = 2166136261u;
+        for (uint32_t i = 0; i < screen->width * screen->height; i++) {
+                hash ^= screen->pixels[i];
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+//! \brief Find the cpu core named by a --cpu= option
+//!
+//! \param[in] name one of table, fused, block or jit
+//! \param[out] core
+//! \return false if the name isn't recognized
+static inline bool ParseCore(char *name, enum cpu_core *core) {
+        if (0 == strcmp(name, "table")) {
+                *core = CPU_CORE_TABLE;
+        } else if (0 == strcmp(name, "fused")) {
+                *core = CPU_CORE_FUSED;
+        } else if (0 == strcmp(name, "block")) {
+                *core = CPU_CORE_BLOCK;
+        } else if (0 == strcmp(name, "jit")) {
+                *core = CPU_CORE_JIT;
+        } else {
+                return false;
+        }
+        return true;
+}
+
+static inline double Now() {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (double)now.tv_sec + (double)now.tv_nsec / 1000000000.0;
+}
+
+#endif // BENCH_VERSION
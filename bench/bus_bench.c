@@ -0,0 +1,154 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: bus_bench.c
+  Created: 2019-12-12
+  Updated: 2019-12-12
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file bus_bench.c
+//! Headless benchmark of BusRead with and without the page tables.
+//!
+//! Usage: bus_bench <rom.nes> [frames]
+//!
+//! Reads every address in a few regions of cpu memory over and over, first
+//! through the full address decode and then through the page tables, reporting
+//! millions of reads per second for each.  The rom is then run for the given
+//! number of frames both ways to show the effect on the whole system.
+#include <stdbool.h>
+#include <stdio.h> // printf, fprintf
+#include <stdlib.h> // strtoul
+
+#include "bus.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "bench.h"
+
+struct region {
+        char *name;
+        uint16_t start;
+        uint16_t end;
+};
+
+static struct region regions[] = {
+        { "zeropage", 0x0000, 0x00FF },
+        { "stack", 0x0100, 0x01FF },
+        { "ram", 0x0000, 0x1FFF },
+        { "prg", 0x8000, 0xFFFF },
+};
+
+//! \brief Read the addresses in the region in turn, reads times in total
+//!
+//! \return the sum of everything read, so both modes can be checked against
+//! each other
+uint32_t ReadRegion(struct bus *bus, struct region *region, uint32_t reads, double *elapsed) {
+        uint32_t sum = 0;
+        uint32_t size = region->end - region->start + 1;
+
+        double start = Now();
+        for (uint32_t i = 0; i < reads; i++) {
+                sum += BusRead(bus, region->start + (i % size), false);
+        }
+        *elapsed = Now() - start;
+
+        return sum;
+}
+
+int BenchReads(char *romFile, uint32_t reads) {
+        struct system *system = SystemInit(romFile, CPU_CORE_FUSED);
+        if (NULL == system) {
+                fprintf(stderr, "Couldn't load cart\n");
+                return 1;
+        }
+
+        // Give RAM something other than zeroes to sum up.
+        for (int i = 0; i < 0x0800; i++) {
+                BusWrite(system->bus, i, i * 7);
+        }
+
+        int result = 0;
+        for (int i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+                double decodeTime = 0.0;
+                double pagedTime = 0.0;
+
+                BusSetPaging(system->bus, false);
+                uint32_t decodeSum = ReadRegion(system->bus, &regions[i], reads, &decodeTime);
+                BusSetPaging(system->bus, true);
+                uint32_t pagedSum = ReadRegion(system->bus, &regions[i], reads, &pagedTime);
+
+                printf("%-8s decode %8.1f Mreads/s  paged %8.1f Mreads/s  paged/decode: %.2fx\n",
+                       regions[i].name, reads / decodeTime / 1000000.0, reads / pagedTime / 1000000.0,
+                       decodeTime / pagedTime);
+
+                if (decodeSum != pagedSum) {
+                        printf("%-8s reads differ: %08X vs %08X\n", regions[i].name, decodeSum, pagedSum);
+                        result = 1;
+                }
+        }
+
+        SystemDeinit(system);
+        return result;
+}
+
+int BenchFrames(char *romFile, bool isPagingEnabled, char *name, int frames, double *fps, uint32_t *hash) {
+        struct system *system = SystemInit(romFile, CPU_CORE_FUSED);
+        if (NULL == system) {
+                fprintf(stderr, "Couldn't load cart\n");
+                return 1;
+        }
+
+        BusSetPaging(system->bus, isPagingEnabled);
+
+        double start = Now();
+        for (int i = 0; i < frames; i++) {
+                BusRunFrame(system->bus);
+                PpuResetFrameCompletion(system->ppu);
+        }
+        double elapsed = Now() - start;
+
+        *fps = (double)frames / elapsed;
+        *hash = ScreenHash(system->ppu);
+
+        printf("%-8s %8d frames %8.3fs %8.1f fps  frame hash %08X\n", name, frames, elapsed, *fps, *hash);
+
+        SystemDeinit(system);
+        return 0;
+}
+
+int main(int argc, char **argv) {
+        if (argc < 2) {
+                fprintf(stderr, "Usage: %s <rom.nes> [frames]\n", argv[0]);
+                return 1;
+        }
+
+        char *romFile = argv[1];
+        int frames = (argc > 2) ? (int)strtoul(argv[2], NULL, 10) : 600;
+
+        if (BenchReads(romFile, 100000000))
+                return 1;
+
+        double decodeFps = 0.0;
+        double pagedFps = 0.0;
+        uint32_t decodeHash = 0;
+        uint32_t pagedHash = 0;
+        if (BenchFrames(romFile, false, "decode", frames, &decodeFps, &decodeHash))
+                return 1;
+        if (BenchFrames(romFile, true, "paged", frames, &pagedFps, &pagedHash))
+                return 1;
+
+        printf("paged/decode: %.2fx\n", pagedFps / decodeFps);
+
+        if (decodeHash != pagedHash) {
+                printf("Frames differ\n");
+                return 1;
+        }
+
+        return 0;
+}
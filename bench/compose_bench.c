@@ -0,0 +1,120 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: compose_bench.c
+  Created: 2019-12-17
+  Updated: 2019-12-17
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file compose_bench.c
+//! Microbenchmark of each scanline composition kernel.
+//!
+//! Usage: compose_bench [lines]
+//!
+//! Composes the given number of random lines with every kernel the cpu
+//! supports, reporting millions of pixels per second for each.  Every kernel
+//! is first checked against the scalar kernel, including which lines have
+//! sprite zero hits.
+#include <stdbool.h>
+#include <stdio.h> // printf, fprintf
+#include <stdlib.h> // strtoul, rand, srand
+#include <string.h> // memcmp
+
+#include "compose.h"
+#include "bench.h"
+
+#define LINE_COUNT 64 //!< Distinct random lines cycled through
+
+struct line {
+        uint8_t bg[COMPOSE_LINE_WIDTH];
+        uint8_t fg[COMPOSE_LINE_WIDTH];
+        int hitStart;
+};
+
+static struct line lines[LINE_COUNT];
+static uint32_t colors[32];
+
+//! \brief Fill a line with mostly transparent sprites over a busy background
+void RandomLine(struct line *line) {
+        for (int x = 0; x < COMPOSE_LINE_WIDTH; x++) {
+                line->bg[x] = rand() & 0x0F;
+                line->fg[x] = (rand() % 4) ? 0x00 : (0x10 | (rand() & 0x0F) | (rand() & (COMPOSE_SPRITE_FRONT | COMPOSE_SPRITE_ZERO)));
+        }
+
+        int starts[] = { 0, 8, COMPOSE_LINE_WIDTH, rand() % COMPOSE_LINE_WIDTH };
+        line->hitStart = starts[rand() % 4];
+}
+
+//! \return false if the kernel disagrees with the scalar kernel on any line
+bool Check(enum compose_kernel kernel) {
+        for (int i = 0; i < LINE_COUNT; i++) {
+                uint32_t expected[COMPOSE_LINE_WIDTH];
+                uint32_t actual[COMPOSE_LINE_WIDTH];
+                struct line *line = &lines[i];
+
+                bool isExpectedHit = ComposeLineWith(COMPOSE_KERNEL_SCALAR, expected, line->bg, line->fg, colors, line->hitStart);
+                bool isActualHit = ComposeLineWith(kernel, actual, line->bg, line->fg, colors, line->hitStart);
+
+                if (isExpectedHit != isActualHit || 0 != memcmp(expected, actual, sizeof(expected))) {
+                        printf("%-8s differs from scalar on line %d\n", ComposeKernelName(kernel), i);
+                        return false;
+                }
+        }
+        return true;
+}
+
+int main(int argc, char **argv) {
+        uint32_t count = 2000000;
+        if (argc > 1) {
+                count = (uint32_t)strtoul(argv[1], NULL, 10);
+        }
+
+        srand(1);
+        for (int i = 0; i < 32; i++) {
+                colors[i] = (uint32_t)rand();
+        }
+        for (int i = 0; i < LINE_COUNT; i++) {
+                RandomLine(&lines[i]);
+        }
+
+        int result = 0;
+        double scalarRate = 0.0;
+        for (int kernel = 0; kernel < COMPOSE_KERNEL_COUNT; kernel++) {
+                if (!ComposeIsKernelSupported(kernel)) {
+                        printf("%-8s unsupported\n", ComposeKernelName(kernel));
+                        continue;
+                }
+
+                if (!Check(kernel)) {
+                        result = 1;
+                        continue;
+                }
+
+                uint32_t out[COMPOSE_LINE_WIDTH];
+                uint32_t hits = 0;
+
+                double start = Now();
+                for (uint32_t i = 0; i < count; i++) {
+                        struct line *line = &lines[i % LINE_COUNT];
+                        hits += ComposeLineWith(kernel, out, line->bg, line->fg, colors, line->hitStart);
+                }
+                double elapsed = Now() - start;
+
+                double rate = (double)count * COMPOSE_LINE_WIDTH / elapsed / 1000000.0;
+                if (COMPOSE_KERNEL_SCALAR == kernel) {
+                        scalarRate = rate;
+                }
+
+                printf("%-8s %10u lines %8.3fs %10.1f Mpixels/s %6.2fx scalar %10u hits\n",
+                       ComposeKernelName(kernel), count, elapsed, rate, rate / scalarRate, hits);
+        }
+
+        return result;
+}
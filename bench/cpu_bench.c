@@ -0,0 +1,290 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: cpu_bench.c
+  Created: 2019-12-09
+  Updated: 2019-12-17
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file cpu_bench.c
+//! Headless benchmark comparing the cpu interpreter cores.
+//!
+//! Usage: cpu_bench <rom.nes> [frames] [--diff | --diff-blocks | --diff-jit]
+//!
+//! Runs the rom for the given number of frames once per core with BusRunFrame,
+//! reporting instructions executed, MIPS and a hash of the final frame.  The
+//! same number of cpu cycles is then run again with CpuRun alone, without the
+//! ppu, to isolate the cost of the interpreter itself.  The fused core also
+//! reports how often instructions were run from its decode cache, and how often
+//! each superinstruction was run.
+//!
+//! With --diff, the table and fused cores are instead run in lockstep and the
+//! first instruction where their cpu state differs is reported.  With
+//! --diff-blocks, the block core is compared against the fused core after every
+//! block, without the ppu; --diff-jit does the same for the jit core.
+#include <stdbool.h>
+#include <stdio.h> // printf, fprintf
+#include <stdlib.h> // strtoul
+#include <string.h> // strcmp
+
+#include "bus.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "bench.h"
+
+void PrintDecodeStats(struct cpu *cpu) {
+        struct cpu_decode_stats stats;
+        CpuGetDecodeStats(cpu, &stats);
+
+        uint64_t total = stats.hits + stats.misses + stats.uncached;
+        printf("       decode cache %12llu hits %12llu misses %12llu uncached %6.2f%% hit rate\n",
+               (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+               (unsigned long long)stats.uncached, (0 == total) ? 0.0 : 100.0 * stats.hits / total);
+}
+
+void PrintPairStats(struct cpu *cpu) {
+        struct cpu_decode_stats stats;
+        CpuGetDecodeStats(cpu, &stats);
+
+        uint64_t instructions = CpuInstructionCount(cpu);
+        for (int pair = CPU_PAIR_NONE + 1; pair < CPU_PAIR_COUNT; pair++) {
+                printf("       %-10s %12llu runs %6.2f%% of instructions\n", CpuPairName(pair),
+                       (unsigned long long)stats.pairs[pair],
+                       (0 == instructions) ? 0.0 : 200.0 * stats.pairs[pair] / instructions);
+        }
+}
+
+int Bench(char *romFile, enum cpu_core core, char *name, int frames, double *mips) {
+        struct system *system = SystemInit(romFile, core);
+        if (NULL == system) {
+                fprintf(stderr, "Couldn't load cart\n");
+                return 1;
+        }
+
+        double start = Now();
+        for (int i = 0; i < frames; i++) {
+                BusRunFrame(system->bus);
+                PpuResetFrameCompletion(system->ppu);
+        }
+        double elapsed = Now() - start;
+
+        uint64_t instructions = CpuInstructionCount(system->cpu);
+        *mips = (double)instructions / elapsed / 1000000.0;
+
+        printf("%-6s %8d frames %12llu instructions %8.3fs %8.3f MIPS %8.1f fps  frame hash %08X\n",
+               name, frames, (unsigned long long)instructions, elapsed, *mips,
+               (double)frames / elapsed, ScreenHash(system->ppu));
+
+        if (CPU_CORE_TABLE != core) {
+                PrintDecodeStats(system->cpu);
+        }
+        if (CPU_CORE_FUSED == core) {
+                PrintPairStats(system->cpu);
+        }
+
+        SystemDeinit(system);
+        return 0;
+}
+
+//! \brief Run the cpu alone, without the rest of the system ticking
+//!
+//! PPU registers keep returning the same values, so games wind up spinning in
+//! their vblank loops; which still makes for a fair comparison between cores.
+int BenchCpuOnly(char *romFile, enum cpu_core core, char *name, int frames, double *mips) {
+        struct system *system = SystemInit(romFile, core);
+        if (NULL == system) {
+                fprintf(stderr, "Couldn't load cart\n");
+                return 1;
+        }
+
+        // 341 * 262 / 3 cpu cycles per frame.
+        uint64_t cycles = (uint64_t)frames * 29781;
+
+        double start = Now();
+        for (int i = 0; i < frames; i++) {
+                CpuRun(system->cpu, 29781);
+        }
+        double elapsed = Now() - start;
+
+        uint64_t instructions = CpuInstructionCount(system->cpu);
+        *mips = (double)instructions / elapsed / 1000000.0;
+
+        printf("%-6s %8llu cycles %12llu instructions %8.3fs %8.3f MIPS (cpu only)\n",
+               name, (unsigned long long)cycles, (unsigned long long)instructions, elapsed, *mips);
+
+        SystemDeinit(system);
+        return 0;
+}
+
+bool StatesEqual(struct cpu_state *a, struct cpu_state *b) {
+        return a->a == b->a && a->x == b->x && a->y == b->y && a->sp == b->sp &&
+                a->pc == b->pc && a->status == b->status && a->cycles == b->cycles;
+}
+
+void PrintState(char *name, struct cpu_state *s) {
+        printf("  %-6s PC:$%04X A:$%02X X:$%02X Y:$%02X SP:$%02X P:$%02X cycles:%d\n",
+               name, s->pc, s->a, s->x, s->y, s->sp, s->status, s->cycles);
+}
+
+int Diff(char *romFile, int frames) {
+        struct system *table = SystemInit(romFile, CPU_CORE_TABLE);
+        struct system *fused = SystemInit(romFile, CPU_CORE_FUSED);
+        if (NULL == table || NULL == fused) {
+                fprintf(stderr, "Couldn't load cart\n");
+                SystemDeinit(table);
+                SystemDeinit(fused);
+                return 1;
+        }
+
+        int result = 0;
+        int frame = 0;
+        while (frame < frames) {
+                BusTick(table->bus);
+                BusTick(fused->bus);
+
+                // Both cores are cycle accurate with respect to each other,
+                // so their state must match on every tick, not just at
+                // instruction boundaries.
+                struct cpu_state a;
+                struct cpu_state b;
+                CpuGetState(table->cpu, &a);
+                CpuGetState(fused->cpu, &b);
+                if (!StatesEqual(&a, &b) || CpuInstructionCount(table->cpu) != CpuInstructionCount(fused->cpu)) {
+                        printf("Divergence at frame %d, instruction %llu\n", frame, (unsigned long long)CpuInstructionCount(table->cpu));
+                        PrintState("table", &a);
+                        PrintState("fused", &b);
+                        result = 1;
+                        break;
+                }
+
+                if (PpuIsFrameComplete(table->ppu)) {
+                        if (ScreenHash(table->ppu) != ScreenHash(fused->ppu)) {
+                                printf("Frame %d differs\n", frame);
+                                result = 1;
+                                break;
+                        }
+                        PpuResetFrameCompletion(table->ppu);
+                        PpuResetFrameCompletion(fused->ppu);
+                        frame++;
+                }
+        }
+
+        if (0 == result)
+                printf("No divergence over %d frames, %llu instructions\n", frames, (unsigned long long)CpuInstructionCount(table->cpu));
+
+        SystemDeinit(table);
+        SystemDeinit(fused);
+        return result;
+}
+
+//! \brief Run the block or jit core and the fused core side by side, without
+//! the ppu
+//!
+//! The block core runs one block at a time, then the fused core runs the same
+//! number of cycles; which must leave both at the same instruction boundary.
+int DiffBlocks(char *romFile, enum cpu_core core, char *name, int frames) {
+        struct system *block = SystemInit(romFile, core);
+        struct system *fused = SystemInit(romFile, CPU_CORE_FUSED);
+        if (NULL == block || NULL == fused) {
+                fprintf(stderr, "Couldn't load cart\n");
+                SystemDeinit(block);
+                SystemDeinit(fused);
+                return 1;
+        }
+
+        int result = 0;
+        uint64_t blocks = 0;
+        uint64_t cycles = (uint64_t)frames * 29781;
+        uint64_t elapsed = 0;
+        while (elapsed < cycles) {
+                uint32_t ran = CpuRunBlock(block->cpu);
+                CpuRun(fused->cpu, ran);
+                elapsed += ran;
+                blocks++;
+
+                struct cpu_state a;
+                struct cpu_state b;
+                CpuGetState(block->cpu, &a);
+                CpuGetState(fused->cpu, &b);
+                if (!StatesEqual(&a, &b) || CpuInstructionCount(block->cpu) != CpuInstructionCount(fused->cpu)) {
+                        printf("Divergence at block %llu, instruction %llu\n", (unsigned long long)blocks, (unsigned long long)CpuInstructionCount(fused->cpu));
+                        PrintState(name, &a);
+                        PrintState("fused", &b);
+                        result = 1;
+                        break;
+                }
+        }
+
+        if (0 == result)
+                printf("No divergence over %llu cycles, %llu blocks, %llu instructions\n", (unsigned long long)elapsed,
+                       (unsigned long long)blocks, (unsigned long long)CpuInstructionCount(block->cpu));
+
+        SystemDeinit(block);
+        SystemDeinit(fused);
+        return result;
+}
+
+int main(int argc, char **argv) {
+        if (argc < 2) {
+                fprintf(stderr, "Usage: %s <rom.nes> [frames] [--diff | --diff-blocks | --diff-jit]\n", argv[0]);
+                return 1;
+        }
+
+        char *romFile = argv[1];
+        int frames = 600;
+        bool diff = false;
+        bool diffBlocks = false;
+        bool diffJit = false;
+        for (int i = 2; i < argc; i++) {
+                if (0 == strcmp(argv[i], "--diff"))
+                        diff = true;
+                else if (0 == strcmp(argv[i], "--diff-blocks"))
+                        diffBlocks = true;
+                else if (0 == strcmp(argv[i], "--diff-jit"))
+                        diffJit = true;
+                else
+                        frames = (int)strtoul(argv[i], NULL, 10);
+        }
+
+        if (diff)
+                return Diff(romFile, frames);
+        if (diffBlocks)
+                return DiffBlocks(romFile, CPU_CORE_BLOCK, "block", frames);
+        if (diffJit)
+                return DiffBlocks(romFile, CPU_CORE_JIT, "jit", frames);
+
+        double tableMips = 0.0;
+        double fusedMips = 0.0;
+        double blockMips = 0.0;
+        double jitMips = 0.0;
+        if (Bench(romFile, CPU_CORE_TABLE, "table", frames, &tableMips))
+                return 1;
+        if (Bench(romFile, CPU_CORE_FUSED, "fused", frames, &fusedMips))
+                return 1;
+        if (Bench(romFile, CPU_CORE_BLOCK, "block", frames, &blockMips))
+                return 1;
+        if (Bench(romFile, CPU_CORE_JIT, "jit", frames, &jitMips))
+                return 1;
+
+        printf("fused/table: %.2fx block/table: %.2fx jit/table: %.2fx\n", fusedMips / tableMips, blockMips / tableMips, jitMips / tableMips);
+
+        if (BenchCpuOnly(romFile, CPU_CORE_TABLE, "table", frames, &tableMips))
+                return 1;
+        if (BenchCpuOnly(romFile, CPU_CORE_FUSED, "fused", frames, &fusedMips))
+                return 1;
+        if (BenchCpuOnly(romFile, CPU_CORE_BLOCK, "block", frames, &blockMips))
+                return 1;
+        if (BenchCpuOnly(romFile, CPU_CORE_JIT, "jit", frames, &jitMips))
+                return 1;
+
+        printf("fused/table: %.2fx block/table: %.2fx jit/table: %.2fx (cpu only)\n", fusedMips / tableMips, blockMips / tableMips, jitMips / tableMips);
+
+        return 0;
+}
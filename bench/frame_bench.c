@@ -0,0 +1,301 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: frame_bench.c
+  Created: 2019-12-10
+  Updated: 2019-12-17
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file frame_bench.c
+//! Headless benchmark comparing BusTick against BusRunFrame.
+//!
+//! Usage: frame_bench <rom.nes> [frames] [--diff] [--cpu=table|fused|block|jit] [--no-idle-skip] [--dot-renderer] [--no-sprite-limit] [--indexed] [--frame-skip=N] [--timeline=file] [--ppu-thread]
+//!
+//! Runs the rom for the given number of frames, first calling BusTick once per
+//! ppu dot and then calling BusRunFrame once per frame.  With --diff, both are
+//! run side by side and every frame and the cpu state at the end of every frame
+//! are compared.  The fused cpu core is used unless another is chosen; the
+//! block and jit cores only differ from it within BusRunFrame.  BusRunFrame skips
+//! iterations of idle loops unless --no-idle-skip is given; see CpuSetIdleSkip.
+//! BusRunFrame also renders whole scanlines at once where it can unless
+//! --dot-renderer is given; see PpuTickScanline.  BusTick always renders one
+//! dot at a time.  --no-sprite-limit draws every sprite on each scanline with
+//! both; see PpuSetSpriteLimit.  --indexed has BusRunFrame write color
+//! indices, converted to colors only when hashing; see PpuSetIndexedOutput.
+//! --frame-skip=N only outputs every Nth frame, and the last, with both; see
+//! PpuSetOutput.  With --diff, only output frames are compared.
+//! --timeline=file saves BusRunFrame's accesses to the ppu to the file; with
+//! --diff, the writes of both are compared instead.  See PpuSetTimeline.
+//! --ppu-thread runs BusRunFrame's ppu on its own thread; see
+//! BusSetPpuThread.
+#include <stdbool.h>
+#include <stdio.h> // printf, fprintf
+#include <stdlib.h> // strtoul
+#include <string.h> // strcmp, strncmp
+
+#include "bus.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "timeline.h"
+#include "bench.h"
+
+#define TIMELINE_CAPACITY (1 << 20) //!< Accesses to the ppu recorded
+
+//! \brief Whether a frame is output when outputting 1 of every frameSkip
+//!
+//! The last frame is always output, so the final frame hash is comparable.
+bool IsFrameOutput(int frame, int frames, int frameSkip) {
+        return 0 == (frame + 1) % frameSkip || frame == frames - 1;
+}
+
+void RunFrameTick(struct system *system) {
+        do { BusTick(system->bus); } while (!PpuIsFrameComplete(system->ppu));
+        PpuResetFrameCompletion(system->ppu);
+}
+
+void RunFrameCatchUp(struct system *system) {
+        BusRunFrame(system->bus);
+        PpuResetFrameCompletion(system->ppu);
+}
+
+int Bench(char *romFile, enum cpu_core core, bool isIdleSkipEnabled, bool isScanlineRendererEnabled, bool isSpriteLimitEnabled, bool isIndexed, int frameSkip, char *timelineFile, bool isPpuThreaded, void (*runFrame)(struct system *), char *name, int frames, double *fps) {
+        struct system *system = SystemInit(romFile, core);
+        if (NULL == system) {
+                fprintf(stderr, "Couldn't load cart\n");
+                return 1;
+        }
+        CpuSetIdleSkip(system->cpu, isIdleSkipEnabled);
+        PpuSetScanlineRenderer(system->ppu, isScanlineRendererEnabled);
+        PpuSetSpriteLimit(system->ppu, isSpriteLimitEnabled);
+        PpuSetIndexedOutput(system->ppu, isIndexed);
+        if (!BusSetPpuThread(system->bus, isPpuThreaded)) {
+                fprintf(stderr, "Couldn't start the ppu's thread\n");
+                SystemDeinit(system);
+                return 1;
+        }
+
+        struct timeline *timeline = NULL;
+        if (NULL != timelineFile) {
+                timeline = TimelineInit(TIMELINE_CAPACITY);
+                PpuSetTimeline(system->ppu, timeline);
+        }
+
+        double start = Now();
+        for (int i = 0; i < frames; i++) {
+                PpuSetOutput(system->ppu, IsFrameOutput(i, frames, frameSkip));
+                runFrame(system);
+        }
+        double elapsed = Now() - start;
+
+        *fps = (double)frames / elapsed;
+
+        printf("%-8s %8d frames %8.3fs %8.1f fps %12llu instructions %12llu idle cycles skipped  frame hash %08X\n",
+               name, frames, elapsed, *fps,
+               (unsigned long long)CpuInstructionCount(system->cpu),
+               (unsigned long long)CpuIdleCyclesSkipped(system->cpu), ScreenHash(system->ppu));
+
+        int result = 0;
+        if (NULL != timeline) {
+                if (TimelineSave(timeline, timelineFile)) {
+                        printf("%-8s %8u accesses saved to %s\n", name, TimelineCount(timeline), timelineFile);
+                } else {
+                        fprintf(stderr, "Couldn't save timeline: %s\n", timelineFile);
+                        result = 1;
+                }
+                TimelineDeinit(timeline);
+        }
+
+        SystemDeinit(system);
+        return result;
+}
+
+//! \brief Index of the next write in a timeline, from the given access
+//!
+//! \return the index, or TimelineCount if there are no more writes
+uint32_t NextWrite(struct timeline *timeline, uint32_t from) {
+        while (from < TimelineCount(timeline) && TIMELINE_WRITE != TimelineGet(timeline, from).kind) {
+                from++;
+        }
+        return from;
+}
+
+//! \brief Find the first write two timelines disagree on
+//!
+//! Only writes are compared: idle loop skipping leaves out reads, and the
+//! clocks may copy OAM DMA bytes at different times.
+//!
+//! \param[out] x the write in a, or a zeroed entry if a ran out
+//! \param[out] y the write in b, or a zeroed entry if b ran out
+//! \return the number of writes before it, or -1 if they agree
+long FirstTimelineDifference(struct timeline *a, struct timeline *b, struct timeline_entry *x, struct timeline_entry *y) {
+        uint32_t i = NextWrite(a, 0);
+        uint32_t j = NextWrite(b, 0);
+        for (long n = 0;; n++) {
+                struct timeline_entry none = { 0 };
+                *x = (i < TimelineCount(a)) ? TimelineGet(a, i) : none;
+                *y = (j < TimelineCount(b)) ? TimelineGet(b, j) : none;
+                if (i == TimelineCount(a) && j == TimelineCount(b)) {
+                        return -1;
+                }
+                if (i == TimelineCount(a) || j == TimelineCount(b) || x->frame != y->frame ||
+                    x->scanline != y->scanline || x->cycle != y->cycle || x->addr != y->addr || x->data != y->data) {
+                        return n;
+                }
+                i = NextWrite(a, i + 1);
+                j = NextWrite(b, j + 1);
+        }
+}
+
+int Diff(char *romFile, enum cpu_core core, bool isIdleSkipEnabled, bool isScanlineRendererEnabled, bool isSpriteLimitEnabled, bool isIndexed, int frameSkip, bool isTimelineCompared, bool isPpuThreaded, int frames) {
+        struct system *tick = SystemInit(romFile, core);
+        struct system *run = SystemInit(romFile, core);
+        if (NULL == tick || NULL == run) {
+                fprintf(stderr, "Couldn't load cart\n");
+                SystemDeinit(tick);
+                SystemDeinit(run);
+                return 1;
+        }
+        CpuSetIdleSkip(run->cpu, isIdleSkipEnabled);
+        PpuSetScanlineRenderer(tick->ppu, false);
+        PpuSetScanlineRenderer(run->ppu, isScanlineRendererEnabled);
+        PpuSetSpriteLimit(tick->ppu, isSpriteLimitEnabled);
+        PpuSetSpriteLimit(run->ppu, isSpriteLimitEnabled);
+        PpuSetIndexedOutput(run->ppu, isIndexed);
+        if (!BusSetPpuThread(run->bus, isPpuThreaded)) {
+                fprintf(stderr, "Couldn't start the ppu's thread\n");
+                SystemDeinit(tick);
+                SystemDeinit(run);
+                return 1;
+        }
+
+        struct timeline *tickTimeline = NULL;
+        struct timeline *runTimeline = NULL;
+        if (isTimelineCompared) {
+                tickTimeline = TimelineInit(TIMELINE_CAPACITY);
+                runTimeline = TimelineInit(TIMELINE_CAPACITY);
+                PpuSetTimeline(tick->ppu, tickTimeline);
+                PpuSetTimeline(run->ppu, runTimeline);
+        }
+
+        int result = 0;
+        for (int frame = 0; frame < frames; frame++) {
+                bool isOutput = IsFrameOutput(frame, frames, frameSkip);
+                PpuSetOutput(run->ppu, isOutput);
+
+                RunFrameTick(tick);
+                RunFrameCatchUp(run);
+
+                struct cpu_state a;
+                struct cpu_state b;
+                CpuGetState(tick->cpu, &a);
+                CpuGetState(run->cpu, &b);
+
+                bool sameCpu = a.a == b.a && a.x == b.x && a.y == b.y && a.sp == b.sp &&
+                        a.pc == b.pc && a.status == b.status && a.cycles == b.cycles &&
+                        CpuInstructionCount(tick->cpu) == CpuInstructionCount(run->cpu);
+
+                if (!sameCpu || (isOutput && ScreenHash(tick->ppu) != ScreenHash(run->ppu))) {
+                        printf("Frame %d differs: frame hash %08X vs %08X, pc $%04X vs $%04X, instructions %llu vs %llu\n",
+                               frame, ScreenHash(tick->ppu), ScreenHash(run->ppu), a.pc, b.pc,
+                               (unsigned long long)CpuInstructionCount(tick->cpu),
+                               (unsigned long long)CpuInstructionCount(run->cpu));
+                        result = 1;
+                        break;
+                }
+
+                if (isTimelineCompared) {
+                        // Compare each frame's writes, then drop them.
+                        struct timeline_entry x;
+                        struct timeline_entry y;
+                        long i = FirstTimelineDifference(tickTimeline, runTimeline, &x, &y);
+                        if (i >= 0) {
+                                printf("Frame %d differs at write %ld: $%04X=$%02X at %d,%u vs $%04X=$%02X at %d,%u\n",
+                                       frame, i, x.addr, x.data, x.scanline, x.cycle, y.addr, y.data, y.scanline, y.cycle);
+                                result = 1;
+                                break;
+                        }
+                        TimelineClear(tickTimeline);
+                        TimelineClear(runTimeline);
+                }
+        }
+
+        if (0 == result)
+                printf("No divergence over %d frames, %llu idle cycles skipped\n", frames,
+                       (unsigned long long)CpuIdleCyclesSkipped(run->cpu));
+
+        SystemDeinit(tick);
+        SystemDeinit(run);
+        TimelineDeinit(tickTimeline);
+        TimelineDeinit(runTimeline);
+        return result;
+}
+
+int main(int argc, char **argv) {
+        if (argc < 2) {
+                fprintf(stderr, "Usage: %s <rom.nes> [frames] [--diff] [--cpu=table|fused|block|jit] [--no-idle-skip] [--dot-renderer] [--no-sprite-limit] [--indexed] [--frame-skip=N] [--timeline=file] [--ppu-thread]\n", argv[0]);
+                return 1;
+        }
+
+        char *romFile = argv[1];
+        int frames = 600;
+        bool diff = false;
+        bool isIdleSkipEnabled = true;
+        bool isScanlineRendererEnabled = true;
+        bool isSpriteLimitEnabled = true;
+        bool isIndexed = false;
+        int frameSkip = 1;
+        char *timelineFile = NULL;
+        bool isPpuThreaded = false;
+        enum cpu_core core = CPU_CORE_FUSED;
+        for (int i = 2; i < argc; i++) {
+                if (0 == strcmp(argv[i], "--diff")) {
+                        diff = true;
+                } else if (0 == strcmp(argv[i], "--no-idle-skip")) {
+                        isIdleSkipEnabled = false;
+                } else if (0 == strcmp(argv[i], "--dot-renderer")) {
+                        isScanlineRendererEnabled = false;
+                } else if (0 == strcmp(argv[i], "--no-sprite-limit")) {
+                        isSpriteLimitEnabled = false;
+                } else if (0 == strcmp(argv[i], "--indexed")) {
+                        isIndexed = true;
+                } else if (0 == strncmp(argv[i], "--frame-skip=", 13)) {
+                        frameSkip = (int)strtoul(argv[i] + 13, NULL, 10);
+                        if (frameSkip < 1) {
+                                fprintf(stderr, "Frame skip must be at least 1\n");
+                                return 1;
+                        }
+                } else if (0 == strncmp(argv[i], "--timeline=", 11)) {
+                        timelineFile = argv[i] + 11;
+                } else if (0 == strcmp(argv[i], "--ppu-thread")) {
+                        isPpuThreaded = true;
+                } else if (0 == strncmp(argv[i], "--cpu=", 6)) {
+                        if (!ParseCore(argv[i] + 6, &core)) {
+                                fprintf(stderr, "Unknown cpu core: %s\n", argv[i] + 6);
+                                return 1;
+                        }
+                } else {
+                        frames = (int)strtoul(argv[i], NULL, 10);
+                }
+        }
+
+        if (diff)
+                return Diff(romFile, core, isIdleSkipEnabled, isScanlineRendererEnabled, isSpriteLimitEnabled, isIndexed, frameSkip, NULL != timelineFile, isPpuThreaded, frames);
+
+        double tickFps = 0.0;
+        double runFps = 0.0;
+        if (Bench(romFile, core, isIdleSkipEnabled, isScanlineRendererEnabled, isSpriteLimitEnabled, false, frameSkip, NULL, false, RunFrameTick, "tick", frames, &tickFps))
+                return 1;
+        if (Bench(romFile, core, isIdleSkipEnabled, isScanlineRendererEnabled, isSpriteLimitEnabled, isIndexed, frameSkip, timelineFile, isPpuThreaded, RunFrameCatchUp, "catchup", frames, &runFps))
+                return 1;
+
+        printf("catchup/tick: %.2fx\n", runFps / tickFps);
+
+        return 0;
+}
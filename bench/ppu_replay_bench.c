@@ -0,0 +1,370 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: ppu_replay_bench.c
+  Created: 2019-12-17
+  Updated: 2019-12-17
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file ppu_replay_bench.c
+//! Headless benchmark of the ppu alone, replaying a capture of a rom's accesses
+//! to it without the cpu.
+//!
+//! Usage: ppu_replay_bench <rom.nes> [frames] [--skip=N] [--cpu=table|fused|block|jit] [--save=file] [--load=file]
+//!
+//! Runs the rom for --skip frames, then captures the ppu's state and the next
+//! frames: every access to the ppu, timestamped by PpuSetTimeline, and the hash
+//! of every frame.  --save=file writes the capture to the file, and
+//! --load=file replays that capture rather than running the rom; the rom is
+//! still needed for the cart.
+//!
+//! The capture is replayed twice with no cpu: once calling PpuTick for every
+//! dot, then once also calling PpuTickScanline wherever no access falls within
+//! the scanline.  Every replayed frame must hash the same as the captured one,
+//! and every replayed read must return what the captured one did.
+//!
+//! The capture file is the magic "GSRP", the number of frames as 32 bits, the
+//! state PpuSaveState wrote, the timeline TimelineWrite wrote, then each frame's
+//! hash as 32 bits; little endian.
+#include <stdbool.h>
+#include <stdio.h> // printf, fprintf, FILE
+#include <stdlib.h> // strtoul
+#include <string.h> // strcmp, strncmp, memcmp
+
+#include "bus.h"
+#include "cart.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "timeline.h"
+#include "bench.h"
+
+#define TIMELINE_CAPACITY (1 << 22) //!< Accesses to the ppu captured
+
+static const char magic[4] = { 'G', 'S', 'R', 'P' };
+
+struct capture {
+        uint32_t frames;
+        FILE *file; //!< Positioned at the ppu state after CaptureRead
+        long stateOffset;
+        struct timeline *timeline;
+        uint32_t *hashes;
+};
+
+void CaptureDeinit(struct capture *capture) {
+        if (NULL != capture->timeline)
+                TimelineDeinit(capture->timeline);
+        if (NULL != capture->hashes)
+                free(capture->hashes);
+        if (NULL != capture->file)
+                fclose(capture->file);
+}
+
+bool WriteWord(FILE *file, uint32_t value) {
+        uint8_t bytes[4] = { value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24 };
+        return 1 == fwrite(bytes, sizeof(bytes), 1, file);
+}
+
+bool ReadWord(FILE *file, uint32_t *value) {
+        uint8_t bytes[4];
+        if (1 != fread(bytes, sizeof(bytes), 1, file)) {
+                return false;
+        }
+        *value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+        return true;
+}
+
+//! \brief Run the rom and write a capture of it to a file
+//!
+//! \return false if the rom couldn't be run or the file written
+bool CaptureWrite(char *romFile, enum cpu_core core, int skip, uint32_t frames, FILE *file) {
+        struct system *system = SystemInit(romFile, core);
+        if (NULL == system) {
+                fprintf(stderr, "Couldn't load cart\n");
+                return false;
+        }
+
+        for (int i = 0; i < skip; i++) {
+                BusRunFrame(system->bus);
+                PpuResetFrameCompletion(system->ppu);
+        }
+
+        struct timeline *timeline = TimelineInit(TIMELINE_CAPACITY);
+        uint32_t *hashes = (uint32_t *)calloc(frames, sizeof(uint32_t));
+        bool isOk = NULL != timeline && NULL != hashes;
+
+        isOk = isOk && 1 == fwrite(magic, sizeof(magic), 1, file);
+        isOk = isOk && WriteWord(file, frames);
+        isOk = isOk && PpuSaveState(system->ppu, file);
+
+        if (isOk) {
+                PpuSetTimeline(system->ppu, timeline);
+                for (uint32_t i = 0; i < frames; i++) {
+                        BusRunFrame(system->bus);
+                        PpuResetFrameCompletion(system->ppu);
+                        hashes[i] = ScreenHash(system->ppu);
+                }
+                PpuSetTimeline(system->ppu, NULL);
+
+                // A full ring buffer may have dropped the oldest accesses.
+                if (TIMELINE_CAPACITY == TimelineCount(timeline)) {
+                        fprintf(stderr, "Too many accesses to capture; try fewer frames\n");
+                        isOk = false;
+                }
+        }
+
+        isOk = isOk && TimelineWrite(timeline, file);
+        for (uint32_t i = 0; i < frames && isOk; i++) {
+                isOk = WriteWord(file, hashes[i]);
+        }
+
+        if (isOk) {
+                printf("%-8s %8u frames %12u accesses captured\n", "capture", frames, TimelineCount(timeline));
+        }
+
+        free(hashes);
+        TimelineDeinit(timeline);
+        SystemDeinit(system);
+        return isOk;
+}
+
+//! \brief Read a capture CaptureWrite wrote
+//!
+//! \param[in] file taken over by the capture
+//! \param[in] ppu loaded with the captured state, to find the timeline after it
+//! \param[out] capture
+//! \return false if the capture couldn't be read
+bool CaptureRead(FILE *file, struct ppu *ppu, struct capture *capture) {
+        memset(capture, 0, sizeof(*capture));
+        capture->file = file;
+
+        char header[sizeof(magic)];
+        if (1 != fread(header, sizeof(header), 1, file) || 0 != memcmp(header, magic, sizeof(magic)) ||
+            !ReadWord(file, &capture->frames)) {
+                return false;
+        }
+
+        capture->stateOffset = ftell(file);
+        if (!PpuLoadState(ppu, file)) {
+                return false;
+        }
+
+        capture->timeline = TimelineRead(file);
+        capture->hashes = (uint32_t *)calloc(capture->frames ? capture->frames : 1, sizeof(uint32_t));
+        if (NULL == capture->timeline || NULL == capture->hashes) {
+                return false;
+        }
+
+        for (uint32_t i = 0; i < capture->frames; i++) {
+                if (!ReadWord(file, &capture->hashes[i])) {
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+//! \brief Order of a dot among all the frames
+uint64_t Position(uint32_t frame, int16_t scanline, int16_t cycle) {
+        return ((uint64_t)frame << 32) | ((uint32_t)(scanline + 1) << 16) | (uint16_t)cycle;
+}
+
+//! \brief Position of an access, or UINT64_MAX past the last
+uint64_t NextPosition(struct timeline *timeline, uint32_t i) {
+        if (i >= TimelineCount(timeline)) {
+                return UINT64_MAX;
+        }
+        struct timeline_entry entry = TimelineGet(timeline, i);
+        return Position(entry.frame, entry.scanline, entry.cycle);
+}
+
+//! \brief Make an access the cpu made
+//!
+//! \return false if a read returned something other than what was captured
+bool Access(struct ppu *ppu, struct timeline_entry entry) {
+        switch (entry.kind) {
+                case TIMELINE_WRITE:
+                        // OAM DMA's bytes follow as their own accesses.
+                        if (0x4014 != entry.addr) {
+                                PpuWriteViaCpu(ppu, entry.addr & 0x0007, entry.data);
+                        }
+                        break;
+
+                case TIMELINE_READ:
+                        return entry.data == PpuReadViaCpu(ppu, entry.addr & 0x0007, false);
+
+                case TIMELINE_OAM_DMA:
+                        PpuWriteOam(ppu, entry.addr, entry.data);
+                        break;
+        }
+        return true;
+}
+
+//! \brief Replay a capture, timing only the ppu
+//!
+//! \return 0 if every frame and read matched the capture
+int Replay(struct cart *cart, struct capture *capture, bool isScanlineRendererEnabled, char *name) {
+        struct ppu *ppu = PpuInit();
+        if (NULL == ppu) {
+                fprintf(stderr, "Couldn't allocate ppu\n");
+                return 1;
+        }
+        PpuAttachCart(ppu, cart);
+        PpuSetScanlineRenderer(ppu, isScanlineRendererEnabled);
+
+        if (0 != fseek(capture->file, capture->stateOffset, SEEK_SET) || !PpuLoadState(ppu, capture->file)) {
+                fprintf(stderr, "Couldn't load ppu state\n");
+                PpuDeinit(ppu);
+                return 1;
+        }
+
+        struct timeline *timeline = capture->timeline;
+        uint32_t next = 0;
+        uint64_t nextPosition = NextPosition(timeline, next);
+
+        uint64_t dots = 0;
+        double elapsed = 0.0;
+        int result = 0;
+
+        for (uint32_t frame = 0; frame < capture->frames && 0 == result; frame++) {
+                double start = Now();
+
+                while (!PpuIsFrameComplete(ppu)) {
+                        uint32_t frameCount = PpuFrameCount(ppu);
+                        int16_t scanline = PpuScanline(ppu);
+                        uint64_t position = Position(frameCount, scanline, PpuCycle(ppu));
+
+                        // Make every access due before this dot.
+                        while (nextPosition <= position) {
+                                struct timeline_entry entry = TimelineGet(timeline, next);
+                                if (nextPosition < position || !Access(ppu, entry)) {
+                                        printf("%-8s frame %u differs at access %u: $%04X at %d,%u\n",
+                                               name, frame, next, entry.addr, entry.scanline, entry.cycle);
+                                        result = 1;
+                                }
+
+                                next++;
+                                nextPosition = NextPosition(timeline, next);
+                        }
+
+                        uint32_t ticks = 0;
+                        if (nextPosition >= Position(frameCount, scanline, 257)) {
+                                ticks = PpuTickScanline(ppu);
+                        }
+                        if (0 == ticks) {
+                                PpuTick(ppu);
+                                ticks = 1;
+                        }
+                        dots += ticks;
+                }
+                PpuResetFrameCompletion(ppu);
+
+                elapsed += Now() - start;
+
+                if (ScreenHash(ppu) != capture->hashes[frame]) {
+                        printf("%-8s frame %u differs: frame hash %08X vs %08X\n", name, frame, ScreenHash(ppu), capture->hashes[frame]);
+                        result = 1;
+                }
+        }
+
+        if (0 == result) {
+                printf("%-8s %8u frames %12llu dots %8.3fs %8.2f ns/dot %12.0f ns/frame  frame hash %08X\n",
+                       name, capture->frames, (unsigned long long)dots, elapsed,
+                       (0 < dots) ? elapsed * 1e9 / (double)dots : 0.0,
+                       (0 < capture->frames) ? elapsed * 1e9 / (double)capture->frames : 0.0,
+                       ScreenHash(ppu));
+        }
+
+        PpuDeinit(ppu);
+        return result;
+}
+
+int main(int argc, char **argv) {
+        if (argc < 2) {
+                fprintf(stderr, "Usage: %s <rom.nes> [frames] [--skip=N] [--cpu=table|fused|block|jit] [--save=file] [--load=file]\n", argv[0]);
+                return 1;
+        }
+
+        char *romFile = argv[1];
+        uint32_t frames = 600;
+        int skip = 0;
+        enum cpu_core core = CPU_CORE_FUSED;
+        char *saveFile = NULL;
+        char *loadFile = NULL;
+        for (int i = 2; i < argc; i++) {
+                if (0 == strncmp(argv[i], "--skip=", 7)) {
+                        skip = (int)strtoul(argv[i] + 7, NULL, 10);
+                } else if (0 == strncmp(argv[i], "--cpu=", 6)) {
+                        if (!ParseCore(argv[i] + 6, &core)) {
+                                fprintf(stderr, "Unknown cpu core: %s\n", argv[i] + 6);
+                                return 1;
+                        }
+                } else if (0 == strncmp(argv[i], "--save=", 7)) {
+                        saveFile = argv[i] + 7;
+                } else if (0 == strncmp(argv[i], "--load=", 7)) {
+                        loadFile = argv[i] + 7;
+                } else {
+                        frames = (uint32_t)strtoul(argv[i], NULL, 10);
+                }
+        }
+
+        // Without a file to save to, keep the capture in a temporary one.
+        FILE *file = NULL;
+        if (NULL != loadFile) {
+                file = fopen(loadFile, "rb");
+        } else {
+                file = (NULL != saveFile) ? fopen(saveFile, "w+b") : tmpfile();
+                if (NULL != file && !CaptureWrite(romFile, core, skip, frames, file)) {
+                        fclose(file);
+                        return 1;
+                }
+        }
+
+        if (NULL == file) {
+                fprintf(stderr, "Couldn't open capture: %s\n", (NULL != loadFile) ? loadFile : saveFile);
+                return 1;
+        }
+        rewind(file);
+
+        struct cart *cart = CartInit(romFile);
+        if (NULL == cart || !CartIsImageValid(cart)) {
+                fprintf(stderr, "Couldn't load cart\n");
+                fclose(file);
+                return 1;
+        }
+        CartReset(cart);
+
+        struct ppu *ppu = PpuInit();
+        if (NULL == ppu) {
+                fprintf(stderr, "Couldn't allocate ppu\n");
+                fclose(file);
+                CartDeinit(cart);
+                return 1;
+        }
+        PpuAttachCart(ppu, cart);
+
+        struct capture capture;
+        bool isRead = CaptureRead(file, ppu, &capture);
+        PpuDeinit(ppu);
+        if (!isRead) {
+                fprintf(stderr, "Couldn't read capture\n");
+                CaptureDeinit(&capture);
+                CartDeinit(cart);
+                return 1;
+        }
+
+        int result = Replay(cart, &capture, false, "tick");
+        if (0 == result) {
+                result = Replay(cart, &capture, true, "scanline");
+        }
+
+        CaptureDeinit(&capture);
+        CartDeinit(cart);
+        return result;
+}
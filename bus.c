@@ -4,7 +4,7 @@
 
   File: bus.c
   Created: 2019-10-16
-  Updated: 2019-12-07
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -21,14 +21,22 @@
 #include "cpu.h"
 #include "ppu.h"
 #include "cart.h"
+#include "pipeline.h"
+#include "scheduler.h"
 #include "util.h"
 
 struct bus {
         struct cpu *cpu;
         struct ppu *ppu;
         struct cart *cart;
+        struct scheduler *scheduler;
         uint8_t *cpuRam; // Dummy RAM for prototyping
-        uint32_t tickCount;
+        uint8_t *readPages[256]; //!< Memory behind each page of cpu reads, or NULL to decode the address
+        uint8_t *writePages[256]; //!< Memory behind each page of cpu writes, or NULL to decode the address
+        uint8_t *codePages[256]; //!< Read pages whose memory can only change through the address decode
+        bool isPagingEnabled;
+        uint64_t clock; //!< Master clock; ppu ticks since reset
+        uint64_t cpuClock; //!< Master clock tick of the next cpu cycle
         struct controller controllers[2];
         uint8_t controllerSnapshot[2];
         uint8_t dmaPage;
@@ -36,8 +44,55 @@ struct bus {
         uint8_t dmaData;
         bool dmaTransfer;
         bool dmaDummy;
+        bool isNmiStale; //!< The control register was written since the nmi was scheduled
+        bool isRunning; //!< Inside CpuRun; the ppu may be behind the cpu
+        uint64_t runClockBase; //!< clock when CpuRun was entered
+        uint32_t runCpuBase; //!< CpuTickCount when CpuRun was entered
+        struct pipeline *pipeline; //!< See BusSetPpuThread
+        bool isPipelining; //!< Inside BusRunFrame with the ppu on its own thread
+        uint8_t control; //!< Last write to the ppu control register
+        uint64_t vblankClock; //!< Tick the ppu sets vblank on, while pipelining
 };
 
+//! \brief Rebuild the page tables used by BusRead and BusWrite
+//!
+//! A page gets a direct pointer if it's entirely system RAM or prg memory
+//! mapped linearly by the cartridge.  Everything else - ppu registers, I/O and
+//! pages the mapper handles itself - goes through the full address decode.
+//!
+//! Writes to the cartridge always take the full decode, so that the cpu can
+//! cache instructions decoded from prg memory and be told when it changes, and
+//! so that bank switches are noticed.
+//!
+//! \param[in,out] bus
+static void MapPages(struct bus *bus) {
+        for (int page = 0; page < 256; page++) {
+                bus->readPages[page] = NULL;
+                bus->writePages[page] = NULL;
+                bus->codePages[page] = NULL;
+
+                if (!bus->isPagingEnabled) {
+                        continue;
+                }
+
+                // System RAM, mirrored every 2048.
+                uint8_t *ram = (page < 0x20) ? &bus->cpuRam[(page & 0x07) << 8] : NULL;
+
+                // As in BusRead and BusWrite, the cartridge gets first pick.
+                uint8_t *mem = NULL;
+                if (NULL != bus->cart && CartCpuReadPage(bus->cart, page, &mem)) {
+                        bus->readPages[page] = mem;
+                        bus->codePages[page] = mem;
+                } else {
+                        bus->readPages[page] = ram;
+                }
+
+                if (NULL == bus->cart || !CartCpuWritePage(bus->cart, page, &mem)) {
+                        bus->writePages[page] = ram;
+                }
+        }
+}
+
 struct bus *BusInit(struct cpu *cpu, struct ppu *ppu) {
         struct bus *bus = (struct bus *)calloc(1, sizeof(struct bus));
         if (NULL == bus)
@@ -49,6 +104,12 @@ struct bus *BusInit(struct cpu *cpu, struct ppu *ppu) {
                 return NULL;
         }
 
+        bus->scheduler = SchedulerInit();
+        if (NULL == bus->scheduler) {
+                BusDeinit(bus);
+                return NULL;
+        }
+
         bus->cpu = cpu;
         bus->ppu = ppu;
         bus->controllerSnapshot[0] = 0x00;
@@ -58,6 +119,10 @@ struct bus *BusInit(struct cpu *cpu, struct ppu *ppu) {
         bus->dmaData = 0x00;
         bus->dmaTransfer = false;
         bus->dmaDummy = true;
+        bus->isNmiStale = true;
+        bus->isRunning = false;
+        bus->isPagingEnabled = true;
+        MapPages(bus);
 
         return bus;
 }
@@ -71,29 +136,178 @@ void BusDeinit(struct bus *bus) {
                 free(bus->cpuRam);
         }
 
+        SchedulerDeinit(bus->scheduler);
+        PipelineDeinit(bus->pipeline);
+
         free(bus);
 }
 
+//! \brief Tick the ppu alone until clock reaches until
+//!
+//! \param[in,out] bus
+//! \param[in] until clock to stop at
+//! \param[in] pollNmi deliver an nmi raised on any of these ticks
+static void CatchUp(struct bus *bus, uint64_t until, bool pollNmi) {
+        // The ppu's own thread catches up to the next write; only the nmi it
+        // raises meanwhile needs predicting.
+        if (bus->isPipelining) {
+                if (bus->clock < until) {
+                        if (pollNmi && (bus->control & 0x80) && bus->vblankClock >= bus->clock && bus->vblankClock < until) {
+                                CpuNmi(bus->cpu);
+                        }
+                        bus->clock = until;
+                }
+                return;
+        }
+
+        while (bus->clock < until) {
+                // Nothing touches the ppu before until, so when a whole
+                // visible scanline lies before it, it can be rendered at
+                // once.  The nmi is never raised on a visible scanline.
+                if (until - bus->clock >= 256) {
+                        uint32_t ticks = PpuTickScanline(bus->ppu);
+                        if (ticks > 0) {
+                                bus->clock += ticks;
+                                continue;
+                        }
+                }
+
+                PpuTick(bus->ppu);
+
+                if (pollNmi && PpuGetNmi(bus->ppu)) {
+                        PpuSetNmi(bus->ppu, false);
+                        CpuNmi(bus->cpu);
+                }
+
+                bus->clock++;
+        }
+}
+
+//! \brief Bring the ppu up to the tick the executing instruction was issued on
+//!
+//! BusTick ticks the ppu before the cpu, so that tick is included.
+//!
+//! \param[in,out] bus
+static void CatchUpToCpu(struct bus *bus) {
+        uint64_t now = bus->runClockBase + 3 * (uint64_t)(CpuTickCount(bus->cpu) - bus->runCpuBase);
+        CatchUp(bus, now + 1, false);
+}
+
+//! \brief Number of ticks the ppu has run, or should have, as the cpu accesses it
+//!
+//! Within CpuRun that's up to the master clock, once caught up.  Within
+//! BusTick, the ppu ticks before the cpu.
+static uint64_t PpuTicks(struct bus *bus) {
+        return bus->isRunning ? bus->clock : bus->clock + 1;
+}
+
+//! \brief Wait for the ppu's thread to catch up, if it has one
+//!
+//! After which the ppu may be used directly until it's next written.
+//!
+//! \param[in,out] bus
+static void Sync(struct bus *bus) {
+        if (bus->isPipelining) {
+                PipelineSync(bus->pipeline, PpuTicks(bus));
+        }
+}
+
+//! \brief Write a byte of OAM for DMA, through the ppu's thread if it has one
+static void WriteOam(struct bus *bus, uint8_t addr, uint8_t data) {
+        if (bus->isPipelining) {
+                PipelineWriteOam(bus->pipeline, PpuTicks(bus), addr, data);
+        } else {
+                PpuWriteOamViaDma(bus->ppu, addr, data);
+        }
+}
+
 void BusWrite(struct bus *bus, uint16_t addr, uint8_t data) {
-        if (CartCpuWrite(bus->cart, addr, data)) {
+        uint8_t *page = bus->writePages[addr >> 8];
+        if (NULL != page) {
+                page[addr & 0x00FF] = data;
+                return;
+        }
+
+        if (bus->isRunning) {
+                if (addr >= 0x2000 && addr <= 0x3FFF) {
+                        CatchUpToCpu(bus);
 
+                        // Writing the control register may enable or disable
+                        // the nmi, invalidating BusRunFrame's schedule.
+                        if ((addr & 0x0007) == 0x0000) {
+                                CpuYield(bus->cpu);
+                        }
+                } else if (addr == 0x4014) {
+                        // DMA steals cycles from the cpu; BusTick handles it.
+                        CpuYield(bus->cpu);
+
+                        // The timeline records where the ppu is.
+                        if (NULL != PpuGetTimeline(bus->ppu)) {
+                                CatchUpToCpu(bus);
+                        }
+                } else if (addr >= 0x4020) {
+                        // Mapper registers may change what the ppu fetches.
+                        CatchUpToCpu(bus);
+                }
+        }
+
+        // The ppu's thread mustn't fetch from the cart while it changes.
+        if (addr >= 0x4020) {
+                Sync(bus);
+        }
+
+        if (CartCpuWrite(bus->cart, addr, data)) {
+                // Prg memory the cpu may have decoded instructions from.
+                CpuInvalidateDecodeCache(bus->cpu, addr);
         } else if (addr >= 0x0000 && addr <= 0x1FFF) {
                 // System RAM address range, mirrored every 2048.
                 bus->cpuRam[addr & 0x07FF] = data;
         } else if (addr >= 0x2000 && addr <= 0x3FFF) {
-                PpuWriteViaCpu(bus->ppu, addr & 0x0007, data);
+                if (bus->isPipelining) {
+                        PipelineWrite(bus->pipeline, PpuTicks(bus), addr & 0x0007, data);
+                } else {
+                        PpuWriteViaCpu(bus->ppu, addr & 0x0007, data);
+                }
+                if ((addr & 0x0007) == 0x0000) {
+                        bus->control = data;
+                        bus->isNmiStale = true;
+                }
         } else if (addr == 0x4014) {
+                if (!bus->isPipelining) {
+                        PpuRecordOamDma(bus->ppu, data);
+                } else if (NULL != PpuGetTimeline(bus->ppu)) {
+                        PipelineRecordOamDma(bus->pipeline, PpuTicks(bus), data);
+                }
                 bus->dmaPage = data;
                 bus->dmaAddr = 0x00;
                 bus->dmaTransfer = true;
         } else if (addr >= 0x4016 && addr <= 0x4017) {
                 bus->controllerSnapshot[addr & 0x0001] = bus->controllers[addr & 0x0001].input;
+        } else if (addr >= 0x4020) {
+                // Cartridge space the mapper didn't map to memory; a mapper
+                // register, which may switch banks or mirroring.
+                if (CartCpuWriteRegister(bus->cart, addr, data)) {
+                        MapPages(bus);
+                        PpuUpdateMirroring(bus->ppu);
+                }
         }
 }
 
 uint8_t BusRead(struct bus *bus, uint16_t addr, bool readOnly) {
+        uint8_t *page = bus->readPages[addr >> 8];
+        if (NULL != page) {
+                return page[addr & 0x00FF];
+        }
+
         uint8_t data = 0x00;
 
+        if (addr >= 0x2000 && addr <= 0x3FFF) {
+                if (bus->isRunning) {
+                        CatchUpToCpu(bus);
+                }
+                Sync(bus);
+        }
+
         if (CartCpuRead(bus->cart, addr, &data)) {
                 // Cartridge address range
         } else if (addr >= 0x0000 && addr <= 0x1FFF) {
@@ -113,29 +327,44 @@ uint8_t BusRead(struct bus *bus, uint16_t addr, bool readOnly) {
 void BusAttachCart(struct bus *bus, struct cart *cart) {
         bus->cart = cart;
         PpuAttachCart(bus->ppu, cart);
+        MapPages(bus);
 }
 
 void BusReset(struct bus *bus) {
         CartReset(bus->cart);
+        MapPages(bus);
+        PpuUpdateMirroring(bus->ppu);
         CpuReset(bus->cpu);
         PpuReset(bus->ppu);
-        bus->tickCount = 0;
+        SchedulerReset(bus->scheduler);
+        bus->clock = 0;
+        bus->cpuClock = 0;
+        bus->isNmiStale = true;
 }
 
 void BusTick(struct bus *bus) {
-        PpuTick(bus->ppu);
+        // While pipelining, the ppu's thread ticks the ppu when it's next
+        // written, and the nmi it raises on this tick is predicted.
+        bool isNmi = false;
+        if (bus->isPipelining) {
+                isNmi = bus->clock == bus->vblankClock && (bus->control & 0x80);
+        } else {
+                PpuTick(bus->ppu);
+        }
+
+        if (bus->clock == bus->cpuClock) {
+                bus->cpuClock += 3;
 
-        if (bus->tickCount % 3 == 0) {
                 if (bus->dmaTransfer) {
                         if (bus->dmaDummy) {
-                                if (bus->tickCount % 2 == 1) {
+                                if ((bus->clock & 1) == 1) {
                                         bus->dmaDummy = false;
                                 }
                         } else {
-                                if (bus->tickCount % 2 == 0) {
+                                if ((bus->clock & 1) == 0) {
                                         bus->dmaData = BusRead(bus, bus->dmaPage << 8 | bus->dmaAddr, false);
                                 } else {
-                                        PpuGetOam(bus->ppu)[bus->dmaAddr] = bus->dmaData;
+                                        WriteOam(bus, bus->dmaAddr, bus->dmaData);
                                         bus->dmaAddr++;
 
                                         if (bus->dmaAddr == 0x00) {
@@ -149,12 +378,192 @@ void BusTick(struct bus *bus) {
                 }
         }
 
-        if (PpuGetNmi(bus->ppu)) {
+        if (bus->isPipelining) {
+                if (isNmi) {
+                        CpuNmi(bus->cpu);
+                }
+        } else if (PpuGetNmi(bus->ppu)) {
                 PpuSetNmi(bus->ppu, false);
                 CpuNmi(bus->cpu);
         }
 
-        bus->tickCount++;
+        bus->clock++;
+}
+
+//! \brief Predict PpuTicksUntilNmi from the last control register write
+static uint32_t PredictTicksUntilNmi(struct bus *bus) {
+        // The next vblank after this one is past the end of the frame.
+        if (!(bus->control & 0x80) || bus->vblankClock < bus->clock) {
+                return 0;
+        }
+        return bus->vblankClock - bus->clock + 1;
+}
+
+//! \brief Schedule the ppu's next nmi, if it's enabled
+//!
+//! The ppu must be caught up to the master clock, unless pipelining.
+//!
+//! \param[in,out] bus
+static void ScheduleNmi(struct bus *bus) {
+        uint32_t ticks = bus->isPipelining ? PredictTicksUntilNmi(bus) : PpuTicksUntilNmi(bus->ppu);
+        if (0 == ticks) {
+                SchedulerCancel(bus->scheduler, SCHED_EVENT_NMI);
+        } else {
+                SchedulerSet(bus->scheduler, SCHED_EVENT_NMI, bus->clock + ticks - 1);
+        }
+        bus->isNmiStale = false;
+}
+
+//! \brief Copy the whole OAM DMA page at once and skip to the end of the transfer
+//!
+//! The cpu is stalled for the duration, so only the ppu could tell the
+//! difference; and it only reads OAM while evaluating sprites.  The page must
+//! not be ppu registers, and nothing else may be scheduled during the transfer.
+//!
+//! \param[in,out] bus
+//! \param[in] end clock of the first cpu cycle after the transfer
+//! \return false if the transfer must be ticked through instead
+static bool RunDma(struct bus *bus, uint64_t end) {
+        if (bus->dmaPage >= 0x20 && bus->dmaPage <= 0x3F) {
+                return false;
+        }
+
+        if (bus->clock + PpuTicksUntilSpriteEvaluation(bus->ppu) - 1 < end) {
+                return false;
+        }
+
+        for (int i = 0; i < 256; i++) {
+                PpuWriteOamViaDma(bus->ppu, i, BusRead(bus, bus->dmaPage << 8 | i, false));
+        }
+        bus->dmaAddr = 0x00;
+        bus->dmaTransfer = false;
+        bus->dmaDummy = true;
+
+        CatchUp(bus, end, true);
+        bus->cpuClock = end;
+
+        return true;
+}
+
+void BusRunFrame(struct bus *bus) {
+        // Only BusRunFrame keeps the schedule, so start from the ppu's state.
+        uint64_t frameEnd = bus->clock + PpuTicksUntilFrameComplete(bus->ppu) - 1;
+        SchedulerSet(bus->scheduler, SCHED_EVENT_FRAME, frameEnd);
+        SchedulerCancel(bus->scheduler, SCHED_EVENT_DMA);
+
+        // With the ppu on its own thread, whatever the schedule needs from it
+        // is predicted now, while it's idle.
+        bus->isPipelining = NULL != bus->pipeline;
+        if (bus->isPipelining) {
+                bus->control = PpuReadViaCpu(bus->ppu, 0x0000, true);
+                bus->vblankClock = bus->clock + PpuTicksUntilVblank(bus->ppu) - 1;
+                PipelineStart(bus->pipeline, bus->clock);
+        }
+        ScheduleNmi(bus);
+
+        while (bus->isPipelining ? bus->clock <= frameEnd : !PpuIsFrameComplete(bus->ppu)) {
+                if (bus->isNmiStale || SchedulerWhen(bus->scheduler, SCHED_EVENT_NMI) < bus->clock) {
+                        ScheduleNmi(bus);
+                }
+
+                bool isCpuCycle = bus->clock == bus->cpuClock;
+
+                if (!bus->dmaTransfer) {
+                        SchedulerCancel(bus->scheduler, SCHED_EVENT_DMA);
+                } else if (isCpuCycle && bus->dmaDummy && SCHEDULER_NEVER == SchedulerWhen(bus->scheduler, SCHED_EVENT_DMA)) {
+                        // One or two dummy cycles to align to an even cycle,
+                        // then alternating reads and writes.
+                        uint32_t cycles = ((bus->clock & 1) ? 1 : 2) + 512;
+                        SchedulerSet(bus->scheduler, SCHED_EVENT_DMA, bus->clock + 3 * cycles);
+                }
+
+                enum sched_event event;
+                uint64_t when = SchedulerNext(bus->scheduler, &event);
+
+                // Pipelining sends the ppu's thread each byte as BusTick
+                // would, so doesn't need to check for sprite evaluation.
+                if (SCHED_EVENT_DMA == event && isCpuCycle && bus->dmaDummy && !bus->isPipelining && RunDma(bus, when)) {
+                        SchedulerCancel(bus->scheduler, SCHED_EVENT_DMA);
+                        continue;
+                }
+
+                // Number of whole cpu cycles before the one sharing a system
+                // tick with the event.
+                uint32_t cpuCycles = (uint32_t)((when - bus->clock) / 3);
+
+                // Events, DMA and realigning to a cpu cycle all go through the
+                // reference path.
+                if (!isCpuCycle || bus->dmaTransfer || 0 == cpuCycles) {
+                        BusTick(bus);
+                        continue;
+                }
+
+                bus->isRunning = true;
+                bus->runClockBase = bus->clock;
+                bus->runCpuBase = CpuTickCount(bus->cpu);
+
+                uint32_t ran = CpuRun(bus->cpu, cpuCycles);
+
+                bus->isRunning = false;
+
+                // If CpuRun yielded after a control register write, an nmi may
+                // now be raised within the remainder of the last cpu cycle.
+                bus->cpuClock = bus->runClockBase + 3 * (uint64_t)ran;
+                CatchUp(bus, bus->cpuClock, true);
+        }
+
+        if (bus->isPipelining) {
+                PipelineSync(bus->pipeline, bus->clock);
+                bus->isPipelining = false;
+        }
+}
+
+uint32_t BusTicksUntilChange(struct bus *bus, uint16_t addr, uint8_t *data) {
+        if (addr <= 0x1FFF) {
+                // Only the cpu itself writes to system RAM.
+                *data = bus->cpuRam[addr & 0x07FF];
+                return UINT32_MAX;
+        }
+
+        if (addr > 0x3FFF || (addr & 0x0007) != 0x0002) {
+                return 0;
+        }
+
+        if (!bus->isRunning) {
+                // Nothing ticks the ppu alongside CpuRun outside BusRunFrame.
+                Sync(bus);
+                return (0 == PpuTicksUntilStatusChange(bus->ppu, data)) ? 0 : UINT32_MAX;
+        }
+
+        CatchUpToCpu(bus);
+        Sync(bus);
+        return PpuTicksUntilStatusChange(bus->ppu, data);
+}
+
+bool BusSetPpuThread(struct bus *bus, bool isEnabled) {
+        if (isEnabled && NULL == bus->pipeline) {
+                bus->pipeline = PipelineInit(bus->ppu);
+                return NULL != bus->pipeline;
+        }
+
+        if (!isEnabled && NULL != bus->pipeline) {
+                PipelineDeinit(bus->pipeline);
+                bus->pipeline = NULL;
+        }
+        return true;
+}
+
+uint8_t *const *BusGetCodePages(struct bus *bus) {
+        return bus->codePages;
+}
+
+uint8_t *BusGetRam(struct bus *bus) {
+        return bus->cpuRam;
+}
+
+void BusSetPaging(struct bus *bus, bool isEnabled) {
+        bus->isPagingEnabled = isEnabled;
+        MapPages(bus);
 }
 
 struct controller *BusGetControllers(struct bus *bus) {
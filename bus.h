@@ -4,7 +4,7 @@
 
   File: bus.h
   Created: 2019-10-16
-  Updated: 2019-12-06
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -48,16 +48,84 @@ BusReset(struct bus *bus);
 //!
 //! The running frequency is determined by the fastest clock in the system - in
 //! this case, the PPU.  Every other clock is some fraction slower than the PPU,
-//! so we compute a modulus every cycle to determine when to increment other
-//! clocks.
+//! so the bus tracks the master clock tick each of them is next due on.
 //!
 //! \param[in,out] bus
 void
 BusTick(struct bus *bus);
 
+//! \brief Run the system until the ppu completes the current frame
+//!
+//! Produces the same results as calling BusTick until PpuIsFrameComplete, but
+//! the cpu runs whole instructions at a time via CpuRun.  The ppu is only
+//! brought up to date when the cpu accesses its registers, when DMA starts, or
+//! when an nmi, the end of an OAM DMA or the end of the frame is scheduled.
+//! BusTick remains the reference.
+//!
+//! \param[in,out] bus
+void
+BusRunFrame(struct bus *bus);
+
+//! \brief Run the ppu on its own thread within BusRunFrame, or stop doing so
+//!
+//! BusRunFrame then sends the ppu's thread the cpu's writes to the ppu, stamped
+//! with the tick they're made on, and lets the cpu run ahead.  The cpu only
+//! waits for the ppu when it reads a ppu register, writes the cart, or reaches
+//! the end of the frame; the nmi is predicted from the control register
+//! instead.  Results are the same either way.  Disabled by default.
+//!
+//! \param[in,out] bus
+//! \param[in] isEnabled
+//! \return false if the thread couldn't be started
+bool
+BusSetPpuThread(struct bus *bus, bool isEnabled);
+
 void
 BusAttachCart(struct bus *bus, struct cart *cart);
 
+//! \brief Choose whether BusRead and BusWrite may use their page tables
+//!
+//! Paging is enabled by default.  With it disabled, every access goes through
+//! the full address decode, as a reference to compare against.
+//!
+//! \param[in,out] bus
+//! \param[in] isEnabled
+void
+BusSetPaging(struct bus *bus, bool isEnabled);
+
+//! \brief Memory behind each page of cpu reads that's safe to cache code from
+//!
+//! An entry is non-NULL only when the page is backed by memory which can't be
+//! written without the bus calling CpuInvalidateDecodeCache.  The table is
+//! updated in place whenever the pages are remapped.
+//!
+//! \param[in] bus
+//! \return table of 256 pages, indexed by the high byte of the address
+uint8_t *const *
+BusGetCodePages(struct bus *bus);
+
+//! \brief Number of ticks reads of addr are sure to return the same value
+//!
+//! Used by CpuRun to skip iterations of loops that poll memory.  Only system
+//! RAM and the ppu status register are ever reported as unchanging.
+//!
+//! \param[in,out] bus
+//! \param[in] addr cpu address polled
+//! \param[out] data what a read of addr issued on the current cpu cycle returns
+//! \return ticks, counted from the current cpu cycle, up to and including the
+//! first one which may change what a read returns; UINT32_MAX if only the cpu
+//! can change it, or 0 if a read has side effects or the value may change at
+//! any time
+uint32_t
+BusTicksUntilChange(struct bus *bus, uint16_t addr, uint8_t *data);
+
+//! \brief The 2KB of internal cpu RAM, mirrored through $0000-$1FFF
+//!
+//! \param[in] bus
+//! \return RAM, valid until BusDeinit
+uint8_t *
+BusGetRam(struct bus *bus);
+
 struct controller *
 BusGetControllers(struct bus *bus);
 
@@ -4,7 +4,7 @@
 
   File: cart.c
   Created: 2019-11-03
-  Updated: 2019-12-02
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -31,12 +31,16 @@ struct cart {
         bool isImageValid;
         uint8_t *prgMem;
         uint8_t *chrMem;
+        uint8_t *chrTiles; //!< Decoded chrMem; see CartPpuTileRow
+        uint8_t *nameTableRam; //!< See CartNameTableRam
+        uint32_t chrSize;
         void *mapper;
         mapper_init_fn mapperInit;
         mapper_deinit_fn mapperDeinit;
         mapper_reset_fn mapperReset;
         map_cpu_read_fn mapCpuRead;
         map_cpu_write_fn mapCpuWrite;
+        map_cpu_register_fn writeRegister;
         map_ppu_read_fn mapPpuRead;
         map_ppu_write_fn mapPpuWrite;
 
@@ -55,6 +59,27 @@ struct header {
         char unused[5];
 };
 
+//! \brief Decode one row of a tile in chr memory into the tile cache
+//!
+//! Each row is stored as its 8 pixel indices from left to right, followed by
+//! the same 8 from right to left.
+//!
+//! \param[in,out] cart
+//! \param[in] mappedAddr address in chrMem of either bit plane of the row
+static void DecodeChrRow(struct cart *cart, uint32_t mappedAddr) {
+        uint32_t lsbAddr = mappedAddr & ~0x0008;
+        uint8_t lsb = cart->chrMem[lsbAddr];
+        uint8_t msb = cart->chrMem[lsbAddr + 8];
+
+        // Tiles are 16 bytes, both planes of 8 rows; rows are 16 bytes decoded.
+        uint8_t *row = &cart->chrTiles[((lsbAddr >> 4) * 8 + (lsbAddr & 0x0007)) * 16];
+        for (int col = 0; col < 8; col++) {
+                uint8_t pixel = (((msb >> (7 - col)) & 0x01) << 1) | ((lsb >> (7 - col)) & 0x01);
+                row[col] = pixel;
+                row[15 - col] = pixel;
+        }
+}
+
 struct cart *CartInit(char *filename) {
         struct cart *cart = (struct cart *)calloc(1, sizeof(struct cart));
         if (NULL == cart) {
@@ -90,6 +115,17 @@ struct cart *CartInit(char *filename) {
         cart->mapperId = ((header.mapper2 >> 4) << 4) | (header.mapper1 >> 4);
         cart->mirror = (header.mapper1 & 0x01) ? MIRROR_VERTICAL : MIRROR_HORIZONTAL;
 
+        // Four screen carts bring their own memory for the other two nametables.
+        if (header.mapper1 & 0x08) {
+                cart->mirror = MIRROR_FOUR_SCREEN;
+                cart->nameTableRam = (uint8_t *)calloc(2, KB_AS_B(1));
+                if (NULL == cart->nameTableRam) {
+                        fclose(f);
+                        free(cart);
+                        return NULL;
+                }
+        }
+
         // "Discover" file format.
         uint8_t file_type = 1;
 
@@ -133,6 +169,22 @@ struct cart *CartInit(char *filename) {
                         return NULL;
                         // TODO Couldn't read data from file - set appropriate error
                 }
+
+                // Chr memory holds 16 bytes per tile, which decode to 8 rows
+                // of 16 pixel indices.
+                cart->chrSize = numBanks * KB_AS_B(8);
+                cart->chrTiles = (uint8_t *)calloc(cart->chrSize, 8);
+                if (NULL == cart->chrTiles) {
+                        fclose(f);
+                        free(cart);
+                        return NULL;
+                }
+
+                for (uint32_t addr = 0; addr < cart->chrSize; addr += 16) {
+                        for (uint32_t row = 0; row < 8; row++) {
+                                DecodeChrRow(cart, addr + row);
+                        }
+                }
         }
 
         if (2 == file_type) {
@@ -146,6 +198,7 @@ struct cart *CartInit(char *filename) {
                         cart->mapperReset = Mapper000_Reset;
                         cart->mapCpuRead = Mapper000_MapCpuRead;
                         cart->mapCpuWrite = Mapper000_MapCpuWrite;
+                        cart->writeRegister = Mapper000_WriteRegister;
                         cart->mapPpuRead = Mapper000_MapPpuRead;
                         cart->mapPpuWrite = Mapper000_MapPpuWrite;
 
@@ -173,9 +226,15 @@ void CartDeinit(struct cart *cart) {
         if (NULL != cart->chrMem)
                 free(cart->chrMem);
 
+        if (NULL != cart->chrTiles)
+                free(cart->chrTiles);
+
         if (NULL != cart->prgMem)
                 free(cart->prgMem);
 
+        if (NULL != cart->nameTableRam)
+                free(cart->nameTableRam);
+
         if (NULL != cart->mapper && NULL != cart->mapperDeinit)
                 cart->mapperDeinit(cart->mapper);
 
@@ -202,6 +261,10 @@ bool CartCpuWrite(struct cart *cart, uint16_t addr, uint8_t data) {
         return false;
 }
 
+bool CartCpuWriteRegister(struct cart *cart, uint16_t addr, uint8_t data) {
+        return cart->writeRegister(cart->mapper, addr, data);
+}
+
 bool CartPpuRead(struct cart *cart, uint16_t addr, uint8_t *data) {
         uint32_t mappedAddr = 0;
         if (cart->mapPpuRead(cart->mapper, addr, &mappedAddr)) {
@@ -216,16 +279,66 @@ bool CartPpuWrite(struct cart *cart, uint16_t addr, uint8_t data) {
         uint32_t mappedAddr = 0;
         if (cart->mapPpuWrite(cart->mapper, addr, &mappedAddr)) {
                 cart->chrMem[mappedAddr] = data;
+                DecodeChrRow(cart, mappedAddr);
                 return true;
         }
 
         return false;
 }
 
+const uint8_t *CartPpuTileRow(struct cart *cart, uint16_t addr, bool isFlipped) {
+        uint32_t mappedAddr = 0;
+        if (!cart->mapPpuRead(cart->mapper, addr, &mappedAddr)) {
+                return NULL;
+        }
+
+        uint32_t row = (mappedAddr >> 4) * 8 + (mappedAddr & 0x0007);
+        return &cart->chrTiles[row * 16 + (isFlipped ? 8 : 0)];
+}
+
+//! \brief Find out how the mapper translates a page of cpu address space
+//!
+//! Mappers switch prg memory in banks of several kilobytes, so a page which
+//! maps its first and last addresses 255 bytes apart is mapped linearly.
+//!
+//! \param[in] cart
+//! \param[in] map the mapper's cpu read or write intercept
+//! \param[in] page
+//! \param[out] mem prg memory backing the whole page, if it's mapped linearly
+//! \return true if the page is intercepted
+static bool MapCpuPage(struct cart *cart, map_cpu_read_fn map, uint8_t page, uint8_t **mem) {
+        uint16_t base = page << 8;
+        uint32_t first = 0;
+        uint32_t last = 0;
+        bool isFirstMapped = map(cart->mapper, base, &first);
+        bool isLastMapped = map(cart->mapper, base | 0x00FF, &last);
+
+        bool isLinear = isFirstMapped && isLastMapped && (last == first + 0x00FF);
+        *mem = isLinear ? &cart->prgMem[first] : NULL;
+
+        return isFirstMapped || isLastMapped;
+}
+
+bool CartCpuReadPage(struct cart *cart, uint8_t page, uint8_t **mem) {
+        return MapCpuPage(cart, cart->mapCpuRead, page, mem);
+}
+
+bool CartCpuWritePage(struct cart *cart, uint8_t page, uint8_t **mem) {
+        return MapCpuPage(cart, cart->mapCpuWrite, page, mem);
+}
+
 enum mirror CartMirroring(struct cart *cart) {
         return cart->mirror;
 }
 
+uint8_t *CartNameTableRam(struct cart *cart) {
+        return cart->nameTableRam;
+}
+
+uint8_t CartMapper(struct cart *cart) {
+        return cart->mapperId;
+}
+
 bool CartIsImageValid(struct cart *cart) {
         return cart->isImageValid;
 }
@@ -4,7 +4,7 @@
 
   File: cart.h
   Created: 2019-11-03
-  Updated: 2019-11-27
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -32,6 +32,7 @@ enum mirror {
         MIRROR_VERTICAL,
         MIRROR_ONESCREEN_LO,
         MIRROR_ONESCREEN_HI,
+        MIRROR_FOUR_SCREEN, //!< Nametables 2 and 3 are in the cart; see CartNameTableRam
 };
 
 struct cart *
@@ -46,15 +47,85 @@ CartCpuRead(struct cart *cart, uint16_t addr, uint8_t *data);
 bool
 CartCpuWrite(struct cart *cart, uint16_t addr, uint8_t data);
 
+//! \brief Write to a mapper register
+//!
+//! For writes to cartridge space CartCpuWrite didn't map to memory.
+//!
+//! \param[in,out] cart
+//! \param[in] addr
+//! \param[in] data
+//! \return true if the write switched banks or changed mirroring, so the
+//! pages from CartCpuReadPage and CartCpuWritePage and CartMirroring may have
+//! changed
+bool
+CartCpuWriteRegister(struct cart *cart, uint16_t addr, uint8_t data);
+
+//! \brief Find the prg memory backing a 256 byte page of cpu reads
+//!
+//! Only valid until the cartridge next intercepts a write, as that may be a
+//! bank switch.
+//!
+//! \param[in] cart
+//! \param[in] page high byte of the cpu address
+//! \param[out] mem memory behind the whole page, or NULL if the mapper doesn't
+//! map the page linearly
+//! \return true if the cartridge intercepts the page
+bool
+CartCpuReadPage(struct cart *cart, uint8_t page, uint8_t **mem);
+
+//! \brief Find the prg memory backing a 256 byte page of cpu writes
+//!
+//! \see CartCpuReadPage
+//!
+//! \param[in] cart
+//! \param[in] page high byte of the cpu address
+//! \param[out] mem memory behind the whole page, or NULL if the mapper doesn't
+//! map the page linearly
+//! \return true if the cartridge intercepts the page
+bool
+CartCpuWritePage(struct cart *cart, uint8_t page, uint8_t **mem);
+
 bool
 CartPpuRead(struct cart *cart, uint16_t addr, uint8_t *data);
 
 bool
 CartPpuWrite(struct cart *cart, uint16_t addr, uint8_t data);
 
+//! \brief Find the pixels of a row of a tile in chr memory, already decoded
+//!
+//! Every row of chr memory is decoded when the cart is loaded, and decoded
+//! again whenever CartPpuWrite changes it.
+//!
+//! \param[in] cart
+//! \param[in] addr ppu address of either bit plane of the row
+//! \param[in] isFlipped whether to return the row flipped horizontally
+//! \return the row's 8 pixel indices, 0 to 3, from left to right; or NULL if
+//! the cartridge doesn't intercept the address
+const uint8_t *
+CartPpuTileRow(struct cart *cart, uint16_t addr, bool isFlipped);
+
+//! \brief How the four nametables map onto nametable memory
+//!
+//! Mappers may change this; the ppu picks up changes through
+//! PpuUpdateMirroring.
 enum mirror
 CartMirroring(struct cart *cart);
 
+//! \brief Nametable memory on the cartridge
+//!
+//! \param[in] cart
+//! \return 2 KB holding nametables 2 and 3 for MIRROR_FOUR_SCREEN; NULL for
+//! any other mirroring
+uint8_t *
+CartNameTableRam(struct cart *cart);
+
+//! \brief iNES mapper number of the loaded image
+//!
+//! \param[in] cart
+//! \return mapper number
+uint8_t
+CartMapper(struct cart *cart);
+
 bool
 CartIsImageValid(struct cart *cart);
 
@@ -4,7 +4,7 @@
 
   File: color.c
   Created: 2019-08-15
-  Updated: 2019-11-15
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU GPLv3 License
 
@@ -14,8 +14,17 @@
  ******************************************************************************/
 //! \file color.c
 
+#include <stdio.h> // fopen, fread
+
 #include "color.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLOR_X86
+#include <immintrin.h>
+#endif
+
+#define COLOR_INDEX_COUNT (COLOR_EMPHASIS_COUNT * COLOR_PALETTE_SIZE)
+
 struct color ColorWhite = { 0xFFFFFFFF };
 struct color ColorBlack = { 0x000000FF };
 struct color ColorRed = { 0xFF0000FF };
@@ -112,3 +121,124 @@ struct color ColorInitInt(uint32_t rgba) {
         color.rgba = rgba;
         return color;
 }
+
+void ColorEmphasizePalette(struct color *palette) {
+        // Each emphasis bit attenuates the other two channels to about 3/4.
+        const char channels[3] = { 'r', 'g', 'b' };
+
+        for (int emphasis = 1; emphasis < COLOR_EMPHASIS_COUNT; emphasis++) {
+                struct color *variant = &palette[emphasis * COLOR_PALETTE_SIZE];
+
+                for (int i = 0; i < COLOR_PALETTE_SIZE; i++) {
+                        variant[i] = palette[i];
+
+                        for (int c = 0; c < 3; c++) {
+                                unsigned int value = ColorGetInt(palette[i], channels[c]);
+                                for (int bit = 0; bit < 3; bit++) {
+                                        if (bit != c && (emphasis & (1 << bit))) {
+                                                value = value * 3 / 4;
+                                        }
+                                }
+                                ColorSetInt(&variant[i], channels[c], value);
+                        }
+                }
+        }
+}
+
+bool ColorLoadPalette(struct color *palette, const char *filename) {
+        FILE *f = fopen(filename, "rb");
+        if (NULL == f) {
+                return false;
+        }
+
+        // Read one byte past the largest size to reject longer files.
+        uint8_t rgb[COLOR_EMPHASIS_COUNT * COLOR_PALETTE_SIZE * 3 + 1];
+        size_t size = fread(rgb, 1, sizeof(rgb), f);
+        fclose(f);
+
+        int count = 0;
+        if (COLOR_PALETTE_SIZE * 3 == size) {
+                count = COLOR_PALETTE_SIZE;
+        } else if (COLOR_EMPHASIS_COUNT * COLOR_PALETTE_SIZE * 3 == size) {
+                count = COLOR_EMPHASIS_COUNT * COLOR_PALETTE_SIZE;
+        } else {
+                return false;
+        }
+
+        for (int i = 0; i < count; i++) {
+                palette[i] = ColorInitInts(rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2], 255);
+        }
+
+        if (COLOR_PALETTE_SIZE == count) {
+                ColorEmphasizePalette(palette);
+        }
+
+        return true;
+}
+
+//! \brief Lay out a color as the given format
+static uint32_t FormatColor(struct color color, enum color_format format) {
+        uint32_t r = ColorGetInt(color, 'r');
+        uint32_t g = ColorGetInt(color, 'g');
+        uint32_t b = ColorGetInt(color, 'b');
+        uint32_t a = ColorGetInt(color, 'a');
+
+        switch (format) {
+                case COLOR_FORMAT_ARGB8888:
+                        return (a << 24) | (r << 16) | (g << 8) | b;
+                case COLOR_FORMAT_RGB565:
+                        return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+                case COLOR_FORMAT_RGBA8888:
+                default:
+                        return color.rgba;
+        }
+}
+
+#ifdef COLOR_X86
+
+//! \brief Look up 32-bit pixels 8 at a time
+__attribute__((target("avx2")))
+static void ConvertIndexed32Avx2(uint32_t *out, const uint16_t *indices, uint32_t count, const uint32_t *table) {
+        const __m256i mask = _mm256_set1_epi32(COLOR_INDEX_COUNT - 1);
+
+        uint32_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+                __m256i offsets = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)&indices[i]));
+                offsets = _mm256_and_si256(offsets, mask);
+                __m256i pixels = _mm256_i32gather_epi32((const int *)table, offsets, 4);
+                _mm256_storeu_si256((__m256i *)&out[i], pixels);
+        }
+        for (; i < count; i++) {
+                out[i] = table[indices[i] & (COLOR_INDEX_COUNT - 1)];
+        }
+}
+
+#endif // COLOR_X86
+
+void ColorConvertIndexed(void *out, enum color_format format, const uint16_t *indices, uint32_t count, const struct color *palette) {
+        // Converting the whole palette first leaves a single lookup per pixel.
+        uint32_t table[COLOR_INDEX_COUNT];
+        for (int i = 0; i < COLOR_INDEX_COUNT; i++) {
+                table[i] = FormatColor(palette[i], format);
+        }
+
+        if (COLOR_FORMAT_RGB565 == format) {
+                uint16_t *pixels = (uint16_t *)out;
+                for (uint32_t i = 0; i < count; i++) {
+                        pixels[i] = (uint16_t)table[indices[i] & (COLOR_INDEX_COUNT - 1)];
+                }
+                return;
+        }
+
+#ifdef COLOR_X86
+        if (__builtin_cpu_supports("avx2")) {
+                ConvertIndexed32Avx2((uint32_t *)out, indices, count, table);
+                return;
+        }
+#endif
+
+        uint32_t *pixels = (uint32_t *)out;
+        for (uint32_t i = 0; i < count; i++) {
+                pixels[i] = table[indices[i] & (COLOR_INDEX_COUNT - 1)];
+        }
+}
@@ -4,7 +4,7 @@
 
   File: color.h
   Created: 2019-08-15
-  Updated: 2019-11-15
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU GPLv3 License
 
@@ -20,6 +20,7 @@
 //! elements: RGBA.  These elements are stored as written: RGBA, or, visually
 //! mapped as hex symbols: RRGGBBAA.
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifndef COLOR_VERSION
 #define COLOR_VERSION "0.2-gsnes" //!< include guard
@@ -96,6 +97,53 @@ ColorSetInt(struct color *color, char component, unsigned int value);
 void
 ColorSetFloat(struct color *color, char component, float value);
 
+#define COLOR_PALETTE_SIZE 64 //!< Colors the NES can produce
+#define COLOR_EMPHASIS_COUNT 8 //!< Combinations of the red, green and blue emphasis bits
+
+//! Pixel layouts ColorConvertIndexed can produce
+enum color_format {
+        COLOR_FORMAT_RGBA8888, //!< As struct color
+        COLOR_FORMAT_ARGB8888,
+        COLOR_FORMAT_RGB565,
+};
+
+//! \brief Derive the emphasized variants of a NES palette
+//!
+//! Each emphasis bit darkens the two channels it doesn't name.  The variants
+//! are ordered by the emphasis bits of the ppu mask register, red lowest.
+//!
+//! \param[in,out] palette COLOR_EMPHASIS_COUNT * COLOR_PALETTE_SIZE colors; the
+//! first COLOR_PALETTE_SIZE are read, the rest are written
+void
+ColorEmphasizePalette(struct color *palette);
+
+//! \brief Load a NES palette from a .pal file
+//!
+//! A .pal file is packed 8-bit r,g,b triples: either the 64 colors, from which
+//! the emphasized variants are derived, or all 512 with emphasis applied.
+//!
+//! \param[out] palette COLOR_EMPHASIS_COUNT * COLOR_PALETTE_SIZE colors; left
+//! untouched if the file can't be loaded
+//! \param[in] filename
+//! \return false if the file can't be read or is neither size
+bool
+ColorLoadPalette(struct color *palette, const char *filename);
+
+//! \brief Convert NES color indices to pixels
+//!
+//! An index is a NES color in the low 6 bits and the emphasis bits above
+//! them, so it indexes a palette of COLOR_EMPHASIS_COUNT * COLOR_PALETTE_SIZE
+//! colors directly.
+//!
+//! \param[out] out count pixels; uint32_t for the 8888 formats, uint16_t for
+//! COLOR_FORMAT_RGB565
+//! \param[in] format
+//! \param[in] indices count indices
+//! \param[in] count
+//! \param[in] palette COLOR_EMPHASIS_COUNT * COLOR_PALETTE_SIZE colors
+void
+ColorConvertIndexed(void *out, enum color_format format, const uint16_t *indices, uint32_t count, const struct color *palette);
+
 extern struct color ColorWhite;
 extern struct color ColorBlack;
 extern struct color ColorRed;
@@ -0,0 +1,215 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: compose.c
+  Created: 2019-12-17
+  Updated: 2019-12-17
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file compose.c
+//! The vector kernels are built for their instruction set whatever the
+//! compiler flags, and only used once the cpu is known to support it.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h> // NULL
+
+#include "compose.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COMPOSE_X86
+#include <immintrin.h>
+#endif
+
+typedef bool (*compose_fn)(uint32_t *out, const uint8_t *bg, const uint8_t *fg, const uint32_t *colors, int hitStart);
+
+static const char *kernelNames[COMPOSE_KERNEL_COUNT] = {
+        [COMPOSE_KERNEL_SCALAR] = "scalar",
+        [COMPOSE_KERNEL_SSE2] = "sse2",
+        [COMPOSE_KERNEL_AVX2] = "avx2",
+};
+
+static bool ComposeLineScalar(uint32_t *out, const uint8_t *bg, const uint8_t *fg, const uint32_t *colors, int hitStart) {
+        bool isHit = false;
+
+        for (int x = 0; x < COMPOSE_LINE_WIDTH; x++) {
+                bool isBgOpaque = bg[x] & 0x03;
+                bool isFgOpaque = fg[x] & 0x03;
+
+                if (isFgOpaque && (!isBgOpaque || (fg[x] & COMPOSE_SPRITE_FRONT))) {
+                        out[x] = colors[fg[x] & 0x1F];
+                } else {
+                        out[x] = colors[isBgOpaque ? bg[x] : 0x00];
+                }
+
+                if (isBgOpaque && isFgOpaque && (fg[x] & COMPOSE_SPRITE_ZERO) && x >= hitStart) {
+                        isHit = true;
+                }
+        }
+
+        return isHit;
+}
+
+#ifdef COMPOSE_X86
+
+__attribute__((target("sse2")))
+static bool ComposeLineSse2(uint32_t *out, const uint8_t *bg, const uint8_t *fg, const uint32_t *colors, int hitStart) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i pixelMask = _mm_set1_epi8(0x03);
+        const __m128i indexMask = _mm_set1_epi8(0x1F);
+        const __m128i front = _mm_set1_epi8(COMPOSE_SPRITE_FRONT);
+
+        // With no hits possible, no pixel is taken to be sprite zero's.
+        bool isHitPossible = hitStart < COMPOSE_LINE_WIDTH;
+        const __m128i spriteZero = _mm_set1_epi8(isHitPossible ? COMPOSE_SPRITE_ZERO : 0x00);
+        const __m128i start = _mm_set1_epi8((char)(isHitPossible ? hitStart : 0));
+        const __m128i step = _mm_set1_epi8(16);
+
+        __m128i x = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        __m128i hits = zero;
+        uint8_t indices[16];
+
+        for (int i = 0; i < COMPOSE_LINE_WIDTH; i += 16) {
+                __m128i b = _mm_loadu_si128((const __m128i *)&bg[i]);
+                __m128i f = _mm_loadu_si128((const __m128i *)&fg[i]);
+
+                __m128i isBgClear = _mm_cmpeq_epi8(_mm_and_si128(b, pixelMask), zero);
+                __m128i isFgClear = _mm_cmpeq_epi8(_mm_and_si128(f, pixelMask), zero);
+                __m128i isFront = _mm_cmpeq_epi8(_mm_and_si128(f, front), front);
+                __m128i isNotZero = _mm_cmpeq_epi8(_mm_and_si128(f, spriteZero), zero);
+
+                // The sprite shows where it's opaque, unless it's behind an
+                // opaque background.
+                __m128i isFg = _mm_andnot_si128(isFgClear, _mm_or_si128(isBgClear, isFront));
+                __m128i index = _mm_or_si128(
+                        _mm_and_si128(isFg, _mm_and_si128(f, indexMask)),
+                        _mm_andnot_si128(isFg, _mm_andnot_si128(isBgClear, b)));
+
+                // Unsigned x >= start.
+                __m128i isInRange = _mm_cmpeq_epi8(_mm_subs_epu8(start, x), zero);
+                __m128i isClear = _mm_or_si128(_mm_or_si128(isBgClear, isFgClear), isNotZero);
+                hits = _mm_or_si128(hits, _mm_andnot_si128(isClear, isInRange));
+                x = _mm_add_epi8(x, step);
+
+                _mm_storeu_si128((__m128i *)indices, index);
+                for (int j = 0; j < 16; j++) {
+                        out[i + j] = colors[indices[j]];
+                }
+        }
+
+        return 0 != _mm_movemask_epi8(hits);
+}
+
+__attribute__((target("avx2")))
+static bool ComposeLineAvx2(uint32_t *out, const uint8_t *bg, const uint8_t *fg, const uint32_t *colors, int hitStart) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i pixelMask = _mm256_set1_epi8(0x03);
+        const __m256i indexMask = _mm256_set1_epi8(0x1F);
+        const __m256i front = _mm256_set1_epi8(COMPOSE_SPRITE_FRONT);
+
+        // With no hits possible, no pixel is taken to be sprite zero's.
+        bool isHitPossible = hitStart < COMPOSE_LINE_WIDTH;
+        const __m256i spriteZero = _mm256_set1_epi8(isHitPossible ? COMPOSE_SPRITE_ZERO : 0x00);
+        const __m256i start = _mm256_set1_epi8((char)(isHitPossible ? hitStart : 0));
+        const __m256i step = _mm256_set1_epi8(32);
+
+        __m256i x = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                     16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+        __m256i hits = zero;
+        uint8_t indices[32];
+
+        for (int i = 0; i < COMPOSE_LINE_WIDTH; i += 32) {
+                __m256i b = _mm256_loadu_si256((const __m256i *)&bg[i]);
+                __m256i f = _mm256_loadu_si256((const __m256i *)&fg[i]);
+
+                __m256i isBgClear = _mm256_cmpeq_epi8(_mm256_and_si256(b, pixelMask), zero);
+                __m256i isFgClear = _mm256_cmpeq_epi8(_mm256_and_si256(f, pixelMask), zero);
+                __m256i isFront = _mm256_cmpeq_epi8(_mm256_and_si256(f, front), front);
+                __m256i isNotZero = _mm256_cmpeq_epi8(_mm256_and_si256(f, spriteZero), zero);
+
+                // As ComposeLineSse2.
+                __m256i isFg = _mm256_andnot_si256(isFgClear, _mm256_or_si256(isBgClear, isFront));
+                __m256i index = _mm256_blendv_epi8(
+                        _mm256_andnot_si256(isBgClear, b),
+                        _mm256_and_si256(f, indexMask),
+                        isFg);
+
+                __m256i isInRange = _mm256_cmpeq_epi8(_mm256_subs_epu8(start, x), zero);
+                __m256i isClear = _mm256_or_si256(_mm256_or_si256(isBgClear, isFgClear), isNotZero);
+                hits = _mm256_or_si256(hits, _mm256_andnot_si256(isClear, isInRange));
+                x = _mm256_add_epi8(x, step);
+
+                // Gather the colors 8 at a time.
+                _mm256_storeu_si256((__m256i *)indices, index);
+                for (int j = 0; j < 32; j += 8) {
+                        __m256i offsets = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&indices[j]));
+                        __m256i rgba = _mm256_i32gather_epi32((const int *)colors, offsets, 4);
+                        _mm256_storeu_si256((__m256i *)&out[i + j], rgba);
+                }
+        }
+
+        return 0 != _mm256_movemask_epi8(hits);
+}
+
+static compose_fn kernels[COMPOSE_KERNEL_COUNT] = {
+        [COMPOSE_KERNEL_SCALAR] = ComposeLineScalar,
+        [COMPOSE_KERNEL_SSE2] = ComposeLineSse2,
+        [COMPOSE_KERNEL_AVX2] = ComposeLineAvx2,
+};
+
+#else
+
+static compose_fn kernels[COMPOSE_KERNEL_COUNT] = {
+        [COMPOSE_KERNEL_SCALAR] = ComposeLineScalar,
+};
+
+#endif // COMPOSE_X86
+
+bool ComposeIsKernelSupported(enum compose_kernel kernel) {
+        if (kernel >= COMPOSE_KERNEL_COUNT || NULL == kernels[kernel]) {
+                return false;
+        }
+
+#ifdef COMPOSE_X86
+        if (COMPOSE_KERNEL_SSE2 == kernel) {
+                return __builtin_cpu_supports("sse2");
+        }
+        if (COMPOSE_KERNEL_AVX2 == kernel) {
+                return __builtin_cpu_supports("avx2");
+        }
+#endif
+
+        return true;
+}
+
+const char *ComposeKernelName(enum compose_kernel kernel) {
+        if (kernel >= COMPOSE_KERNEL_COUNT) {
+                return "unknown";
+        }
+        return kernelNames[kernel];
+}
+
+bool ComposeLineWith(enum compose_kernel kernel, uint32_t *out, const uint8_t *bg, const uint8_t *fg, const uint32_t *colors, int hitStart) {
+        return kernels[kernel](out, bg, fg, colors, hitStart);
+}
+
+bool ComposeLine(uint32_t *out, const uint8_t *bg, const uint8_t *fg, const uint32_t *colors, int hitStart) {
+        static compose_fn best = NULL;
+
+        if (NULL == best) {
+                best = kernels[COMPOSE_KERNEL_SCALAR];
+                for (int kernel = COMPOSE_KERNEL_SCALAR + 1; kernel < COMPOSE_KERNEL_COUNT; kernel++) {
+                        if (ComposeIsKernelSupported(kernel)) {
+                                best = kernels[kernel];
+                        }
+                }
+        }
+
+        return best(out, bg, fg, colors, hitStart);
+}
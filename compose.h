@@ -0,0 +1,69 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: compose.h
+  Created: 2019-12-17
+  Updated: 2019-12-17
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file compose.h
+//! Kernels compositing a scanline of background and sprite pixels.
+//!
+//! A line is 256 pixels.  Every pixel is an index into palette memory: the
+//! palette shifted left 2 bits or'd with the pixel, where a pixel of 0 is
+//! transparent.  Background pixels use palettes 0 to 3 and sprite pixels
+//! palettes 4 to 7, along with the COMPOSE_SPRITE_* flags.
+//!
+//! The kernels all produce the same output; ComposeLine uses the fastest one
+//! the cpu supports.
+#ifndef COMPOSE_VERSION
+#define COMPOSE_VERSION "0.1.0"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define COMPOSE_LINE_WIDTH 256
+#define COMPOSE_SPRITE_FRONT 0x20 //!< Sprite pixel is drawn over the background
+#define COMPOSE_SPRITE_ZERO 0x40 //!< Sprite pixel belongs to sprite zero
+
+enum compose_kernel {
+        COMPOSE_KERNEL_SCALAR,
+        COMPOSE_KERNEL_SSE2,
+        COMPOSE_KERNEL_AVX2,
+        COMPOSE_KERNEL_COUNT,
+};
+
+//! \brief Composite a line of background pixels with a line of sprite pixels
+//!
+//! \param[out] out COMPOSE_LINE_WIDTH colors
+//! \param[in] bg COMPOSE_LINE_WIDTH background pixels
+//! \param[in] fg COMPOSE_LINE_WIDTH sprite pixels
+//! \param[in] colors the 32 colors in palette memory
+//! \param[in] hitStart first x on which sprite zero can hit; COMPOSE_LINE_WIDTH
+//! if it can't
+//! \return true if an opaque pixel of sprite zero overlaps an opaque background
+//! pixel at or after hitStart
+bool
+ComposeLine(uint32_t *out, const uint8_t *bg, const uint8_t *fg, const uint32_t *colors, int hitStart);
+
+//! \brief As ComposeLine, with the given kernel
+//!
+//! The kernel must be supported; see ComposeIsKernelSupported.
+bool
+ComposeLineWith(enum compose_kernel kernel, uint32_t *out, const uint8_t *bg, const uint8_t *fg, const uint32_t *colors, int hitStart);
+
+//! \brief Whether this build and the cpu it's running on support the kernel
+bool
+ComposeIsKernelSupported(enum compose_kernel kernel);
+
+const char *
+ComposeKernelName(enum compose_kernel kernel);
+
+#endif // COMPOSE_VERSION
@@ -5,7 +5,7 @@
 
   File: cpu.c
   Created: 2019-10-16
-  Updated: 2019-12-06
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -18,7 +18,14 @@
 #include <stdbool.h> // bool
 #include <stdio.h> // snprintf
 #include <stdlib.h> // malloc, free
-#include <string.h> // strncpy
+#include <string.h> // memset, strncpy
+#include <stddef.h> // offsetof
+
+#if defined(__x86_64__)
+#include <sys/mman.h> // mmap, mprotect, munmap
+
+#define NATIVE_CODE_SIZE (1 << 20) //!< Bytes of native code the jit core keeps
+#endif
 
 #include "cpu.h"
 #include "bus.h"
@@ -56,6 +63,14 @@ uint8_t SEC(struct cpu *cpu); uint8_t SED(struct cpu *cpu); uint8_t SEI(struct c
 uint8_t STX(struct cpu *cpu); uint8_t STY(struct cpu *cpu); uint8_t TAX(struct cpu *cpu); uint8_t TAY(struct cpu *cpu);
 uint8_t TSX(struct cpu *cpu); uint8_t TXA(struct cpu *cpu); uint8_t TXS(struct cpu *cpu); uint8_t TYA(struct cpu *cpu);
 
+// Interpreter Cores
+static void StepTable(struct cpu *cpu);
+static void StepFused(struct cpu *cpu);
+static uint32_t RunBlock(struct cpu *cpu, uint32_t cycleBudget);
+static uint32_t RunTranslated(struct cpu *cpu, uint32_t cycleBudget);
+static uint32_t StepPair(struct cpu *cpu, uint32_t cycleBudget);
+static uint32_t SkipIdleLoop(struct cpu *cpu, uint32_t cycleBudget);
+
 struct instruction {
         char *name;
         uint8_t (*operate)(struct cpu *cpu);
@@ -63,6 +78,26 @@ struct instruction {
         uint8_t cycles;
 };
 
+//! \brief An instruction as fetched from memory, ready for the fused core
+struct decoded_instruction {
+        uint8_t opcode;
+        uint8_t length; //!< Bytes including the opcode; 0 for an empty cache entry
+        uint8_t cycles; //!< Base cycle count from instructionMap
+        uint8_t pair; //!< enum cpu_pair formed with the next instruction
+        uint16_t operand; //!< Operand bytes, little endian
+        uint8_t blockCount; //!< Instructions in the block starting here; 0 until it's been found
+        bool isPairKnown; //!< pair has been looked up; see FindPair
+        uint16_t blockCycles; //!< Most cycles the block starting here can take
+        uint8_t nativeStart; //!< First instruction of the block in its native code; see CompileBlock
+        uint32_t native; //!< Offset of the block's native code in nativeCode plus one; 0 until compiled
+};
+
+// Native Blocks
+#if defined(__x86_64__)
+static uint8_t NativeStart(struct cpu *cpu, struct decoded_instruction *block, uint16_t pc);
+static uint32_t RunNative(struct cpu *cpu, struct decoded_instruction *block, uint8_t count);
+#endif
+
 static struct instruction instructionMap[] = {
         { "BRK", BRK, IMM, 7 },{ "ORA", ORA, IZX, 6 },{ "???", XXX, IMP, 2 },{ "???", XXX, IMP, 8 },{ "???", NOP, IMP, 3 },{ "ORA", ORA, ZP0, 3 },{ "ASL", ASL, ZP0, 5 },{ "???", XXX, IMP, 5 },{ "PHP", PHP, IMP, 3 },{ "ORA", ORA, IMM, 2 },{ "ASL", ASL, IMP, 2 },{ "???", XXX, IMP, 2 },{ "???", NOP, IMP, 4 },{ "ORA", ORA, ABS, 4 },{ "ASL", ASL, ABS, 6 },{ "???", XXX, IMP, 6 },
         { "BPL", BPL, REL, 2 },{ "ORA", ORA, IZY, 5 },{ "???", XXX, IMP, 2 },{ "???", XXX, IMP, 8 },{ "???", NOP, IMP, 4 },{ "ORA", ORA, ZPX, 4 },{ "ASL", ASL, ZPX, 6 },{ "???", XXX, IMP, 6 },{ "CLC", CLC, IMP, 2 },{ "ORA", ORA, ABY, 4 },{ "???", NOP, IMP, 2 },{ "???", XXX, IMP, 7 },{ "???", NOP, IMP, 4 },{ "ORA", ORA, ABX, 4 },{ "ASL", ASL, ABX, 7 },{ "???", XXX, IMP, 7 },
@@ -89,7 +124,15 @@ struct cpu {
         uint8_t y;
         uint8_t sp; //!< Stack Pointer
         uint16_t pc; //!< Program Counter
-        uint8_t status; //!< Status Register
+        uint8_t status; //!< Status Register; N, V, Z and C live in the fields below
+
+        // N, V, Z and C are recorded as the values they're derived from, and
+        // only packed into a status byte when something reads the whole
+        // register; see PackStatus.
+        uint8_t flagN; //!< N is bit 7 of this
+        uint8_t flagV; //!< V is set if this is non-zero
+        uint8_t flagZ; //!< Z is set if this is zero
+        uint8_t flagC; //!< C, as 0 or 1
 
         uint8_t fetched; //!< Any data fetched for the current instruction
         uint16_t addrAbs;
@@ -97,6 +140,24 @@ struct cpu {
         uint8_t opcode; //!< Opcode for the currently executing instruction
         uint8_t cycles; //!< How many cycles the current instruction takes
         uint32_t tickCount;
+        uint64_t instructionCount; //!< Instructions started since CpuInit
+        enum cpu_core core; //!< Interpreter used by CpuTick
+        bool isYieldRequested; //!< CpuRun should return after the current instruction
+
+        uint8_t *const *codePages; //!< Pages instructions may be cached from; see BusGetCodePages
+        uint8_t *decodedPages[128]; //!< codePages entry each page of decodeCache was filled from
+        struct decoded_instruction *decodeCache; //!< One entry per address from $8000
+        struct cpu_decode_stats decodeStats;
+
+        const struct cpu_translated_block *translation; //!< One entry per address from $8000; see CpuSetTranslation
+        uint8_t *ram; //!< Internal RAM, as passed to translated blocks and used by native code
+
+        uint8_t *nativeCode; //!< Executable memory for the jit core; see CompileBlock
+        uint32_t nativeUsed; //!< Bytes of nativeCode written
+        bool isNativeUnavailable; //!< nativeCode couldn't be allocated or protected; the jit core interprets blocks
+
+        bool isIdleSkipEnabled; //!< CpuRun skips iterations of idle loops; see SkipIdleLoop
+        uint64_t idleCyclesSkipped;
 };
 
 enum status_flags {
@@ -110,12 +171,20 @@ enum status_flags {
         N = (1 << 7), //!< Negative
 };
 
+static void UnpackStatus(struct cpu *cpu, uint8_t status);
+
 struct cpu *CpuInit() {
         struct cpu *cpu = (struct cpu *)calloc(1, sizeof(struct cpu));
         if (NULL == cpu) {
                 return NULL;
         }
 
+        cpu->decodeCache = (struct decoded_instruction *)calloc(0x8000, sizeof(struct decoded_instruction));
+        if (NULL == cpu->decodeCache) {
+                CpuDeinit(cpu);
+                return NULL;
+        }
+
         cpu->bus = NULL;
 
         cpu->a = 0x00;
@@ -123,36 +192,94 @@ struct cpu *CpuInit() {
         cpu->y = 0x00;
         cpu->sp = 0x00;
         cpu->pc = 0x0000;
-        cpu->status = 0x00;
+        UnpackStatus(cpu, 0x00);
 
         cpu->addrAbs = 0x0000;
         cpu->addrRel = 0x00;
         cpu->opcode = 0x00;
         cpu->cycles = 0;
         cpu->tickCount = 0;
+        cpu->instructionCount = 0;
+        cpu->core = CPU_CORE_FUSED;
+        cpu->isYieldRequested = false;
+        cpu->translation = NULL;
+        cpu->ram = NULL;
+        cpu->nativeCode = NULL;
+        cpu->nativeUsed = 0;
+        cpu->isNativeUnavailable = false;
+        cpu->isIdleSkipEnabled = true;
+        cpu->idleCyclesSkipped = 0;
 
         return cpu;
 }
 
 void CpuDeinit(struct cpu *cpu) {
-        if (NULL != cpu) {
-                free(cpu);
+        if (NULL == cpu) {
+                return;
+        }
+
+        if (NULL != cpu->decodeCache) {
+                free(cpu->decodeCache);
+        }
+
+#if defined(__x86_64__)
+        if (NULL != cpu->nativeCode) {
+                munmap(cpu->nativeCode, NATIVE_CODE_SIZE);
         }
+#endif
+
+        free(cpu);
 }
 
 void CpuConnectBus(struct cpu *cpu, struct bus *bus) {
         cpu->bus = bus;
+        cpu->codePages = BusGetCodePages(bus);
+        cpu->ram = BusGetRam(bus);
+        memset(cpu->decodedPages, 0, sizeof(cpu->decodedPages));
+}
+
+static inline uint8_t GetFlag(struct cpu *cpu, enum status_flags f) {
+        switch (f) {
+                case N: return cpu->flagN >> 7;
+                case V: return (0 != cpu->flagV) ? 1 : 0;
+                case Z: return (0 == cpu->flagZ) ? 1 : 0;
+                case C: return cpu->flagC;
+                default: return ((cpu->status & f) > 0) ? 1 : 0;
+        }
+}
+
+static inline void SetFlag(struct cpu *cpu, enum status_flags f, bool v) {
+        switch (f) {
+                case N: cpu->flagN = v ? 0x80 : 0x00; break;
+                case V: cpu->flagV = v; break;
+                case Z: cpu->flagZ = !v; break;
+                case C: cpu->flagC = v; break;
+                default:
+                        if (v)
+                                cpu->status |= f;
+                        else
+                                cpu->status &= ~f;
+                        break;
+        }
 }
 
-static uint8_t GetFlag(struct cpu *cpu, enum status_flags f) {
-        return ((cpu->status & f) > 0) ? 1 : 0;
+//! \brief Build the whole status register from the lazily evaluated flags
+static uint8_t PackStatus(struct cpu *cpu) {
+        uint8_t status = cpu->status & ~(N | V | Z | C);
+        status |= cpu->flagN & N;
+        status |= (0 != cpu->flagV) ? V : 0;
+        status |= (0 == cpu->flagZ) ? Z : 0;
+        status |= cpu->flagC & C;
+        return status;
 }
 
-static void SetFlag(struct cpu *cpu, enum status_flags f, bool v) {
-        if (v)
-                cpu->status |= f;
-        else
-                cpu->status &= ~f;
+//! \brief Replace the whole status register, as PLP and RTI do
+static void UnpackStatus(struct cpu *cpu, uint8_t status) {
+        cpu->status = status;
+        cpu->flagN = status & N;
+        cpu->flagV = status & V;
+        cpu->flagZ = ~status & Z;
+        cpu->flagC = status & C;
 }
 
 static uint8_t Fetch(struct cpu* cpu) {
@@ -166,35 +293,223 @@ static uint8_t Fetch(struct cpu* cpu) {
 //! \brief Simulate clock ticks
 void CpuTick(struct cpu *cpu) {
         if (0 == cpu->cycles) {
-                // Read the next byte to determine which opcode we are using.
-                cpu->opcode = BusRead(cpu->bus, cpu->pc, false);
-                cpu->pc++;
+                if (CPU_CORE_TABLE == cpu->core) {
+                        StepTable(cpu);
+                } else {
+                        StepFused(cpu);
+                }
+                cpu->instructionCount++;
+        }
+
+        cpu->tickCount++;
+        cpu->cycles--;
+}
+
+uint32_t CpuRun(struct cpu *cpu, uint32_t cycleBudget) {
+        cpu->isYieldRequested = false;
+
+        // Drain whatever is left of the instruction already in flight.
+        if (cpu->cycles >= cycleBudget) {
+                cpu->cycles -= cycleBudget;
+                cpu->tickCount += cycleBudget;
+                return cycleBudget;
+        }
+
+        uint32_t elapsed = cpu->cycles;
+        cpu->tickCount += cpu->cycles;
+        cpu->cycles = 0;
+
+        uint16_t lastPc = cpu->pc;
+        while (elapsed < cycleBudget) {
+                // Idle loops are tiny, so only look for one after jumping
+                // back a few bytes.
+                if (cpu->isIdleSkipEnabled && cpu->pc <= lastPc && lastPc - cpu->pc < 8) {
+                        elapsed += SkipIdleLoop(cpu, cycleBudget - elapsed);
+                        if (elapsed >= cycleBudget) {
+                                break;
+                        }
+                }
+                lastPc = cpu->pc;
+
+                if (NULL != cpu->translation) {
+                        uint32_t ran = RunTranslated(cpu, cycleBudget - elapsed);
+                        if (0 != ran) {
+                                elapsed += ran;
+                                continue;
+                        }
+                }
+
+                if (CPU_CORE_BLOCK == cpu->core || CPU_CORE_JIT == cpu->core) {
+                        uint32_t ran = RunBlock(cpu, cycleBudget - elapsed);
+                        if (0 != ran) {
+                                elapsed += ran;
+                                if (cpu->isYieldRequested) {
+                                        break;
+                                }
+                                continue;
+                        }
+                }
 
-                SetFlag(cpu, U, 1);
+                if (CPU_CORE_TABLE == cpu->core) {
+                        StepTable(cpu);
+                } else {
+                        // The first half of a superinstruction is run in full,
+                        // leaving the second half to be accounted for here.
+                        elapsed += StepPair(cpu, cycleBudget - elapsed);
+                }
+                cpu->instructionCount++;
 
-                // Now use the instruction map to get the instruction our opcode is implementing.
-                struct instruction *instruction = &instructionMap[cpu->opcode];
+                // The instruction takes effect on its first cycle, exactly as
+                // in CpuTick.
+                cpu->tickCount++;
+                cpu->cycles--;
+                elapsed++;
 
-                cpu->cycles = instruction->cycles; // Get starting number of cycles
-                uint8_t needMoreCycles1 = instruction->address(cpu);
-                uint8_t needMoreCycles2 = instruction->operate(cpu);
+                if (cpu->isYieldRequested) {
+                        break;
+                }
 
-                // If both the address and operate functions indicate that an
-                // additional cycle was required, then increase the number of
-                // cycles by 1.
-                cpu->cycles += (needMoreCycles1 & needMoreCycles2);
+                uint32_t remaining = cycleBudget - elapsed;
+                if (cpu->cycles >= remaining) {
+                        cpu->cycles -= remaining;
+                        cpu->tickCount += remaining;
+                        elapsed = cycleBudget;
+                        break;
+                }
 
-                SetFlag(cpu, U, 1);
+                elapsed += cpu->cycles;
+                cpu->tickCount += cpu->cycles;
+                cpu->cycles = 0;
         }
 
-        cpu->tickCount++;
-        cpu->cycles--;
+        return elapsed;
+}
+
+uint32_t CpuRunBlock(struct cpu *cpu) {
+        uint32_t elapsed = cpu->cycles;
+        cpu->tickCount += cpu->cycles;
+        cpu->cycles = 0;
+
+        uint32_t ran = RunBlock(cpu, UINT32_MAX);
+        if (0 == ran) {
+                StepFused(cpu);
+                cpu->instructionCount++;
+                ran = cpu->cycles;
+                cpu->tickCount += cpu->cycles;
+                cpu->cycles = 0;
+        }
+
+        return elapsed + ran;
+}
+
+void CpuYield(struct cpu *cpu) {
+        cpu->isYieldRequested = true;
+}
+
+uint32_t CpuTickCount(struct cpu *cpu) {
+        return cpu->tickCount;
+}
+
+//! \brief Begin the next instruction using the reference instructionMap core
+//!
+//! Every instruction costs two indirect calls, plus a table lookup in Fetch to
+//! find out whether the operand lives in memory.
+//!
+//! \param[in,out] cpu
+static void StepTable(struct cpu *cpu) {
+        // Read the next byte to determine which opcode we are using.
+        cpu->opcode = BusRead(cpu->bus, cpu->pc, false);
+        cpu->pc++;
+
+        SetFlag(cpu, U, 1);
+
+        // Now use the instruction map to get the instruction our opcode is implementing.
+        struct instruction *instruction = &instructionMap[cpu->opcode];
+
+        cpu->cycles = instruction->cycles; // Get starting number of cycles
+        uint8_t needMoreCycles1 = instruction->address(cpu);
+        uint8_t needMoreCycles2 = instruction->operate(cpu);
+
+        // If both the address and operate functions indicate that an
+        // additional cycle was required, then increase the number of
+        // cycles by 1.
+        cpu->cycles += (needMoreCycles1 & needMoreCycles2);
+
+        SetFlag(cpu, U, 1);
 }
 
 int CpuIsComplete(struct cpu *cpu) {
         return (0 == cpu->cycles);
 }
 
+void CpuSetCore(struct cpu *cpu, enum cpu_core core) {
+        cpu->core = core;
+}
+
+enum cpu_core CpuGetCore(struct cpu *cpu) {
+        return cpu->core;
+}
+
+uint64_t CpuInstructionCount(struct cpu *cpu) {
+        return cpu->instructionCount;
+}
+
+void CpuGetDecodeStats(struct cpu *cpu, struct cpu_decode_stats *stats) {
+        *stats = cpu->decodeStats;
+}
+
+void CpuSetIdleSkip(struct cpu *cpu, bool isEnabled) {
+        cpu->isIdleSkipEnabled = isEnabled;
+}
+
+uint64_t CpuIdleCyclesSkipped(struct cpu *cpu) {
+        return cpu->idleCyclesSkipped;
+}
+
+void CpuInvalidateDecodeCache(struct cpu *cpu, uint16_t addr) {
+        // A translation can't be patched, so any write to prg memory retires
+        // it for good.
+        if (addr >= 0x8000) {
+                cpu->translation = NULL;
+        }
+
+        uint8_t *mem = cpu->codePages[addr >> 8];
+        if (NULL == mem) {
+                return;
+        }
+
+        // Instructions are at most three bytes and never straddle pages, so
+        // only entries starting up to two bytes before addr can contain it.
+        uint8_t offset = addr & 0x00FF;
+        uint8_t first = (offset < 2) ? 0 : offset - 2;
+
+        for (int slot = 0; slot < 128; slot++) {
+                if (cpu->decodedPages[slot] != mem) {
+                        continue;
+                }
+                for (int i = first; i <= offset; i++) {
+                        cpu->decodeCache[slot << 8 | i].length = 0;
+                }
+
+                // Any block in the page may run through addr.
+                for (int i = 0; i < 256; i++) {
+                        cpu->decodeCache[slot << 8 | i].blockCount = 0;
+                        cpu->decodeCache[slot << 8 | i].isPairKnown = false;
+                        cpu->decodeCache[slot << 8 | i].native = 0;
+                }
+        }
+}
+
+void CpuGetState(struct cpu *cpu, struct cpu_state *state) {
+        state->a = cpu->a;
+        state->x = cpu->x;
+        state->y = cpu->y;
+        state->sp = cpu->sp;
+        state->pc = cpu->pc;
+        state->status = PackStatus(cpu);
+        state->cycles = cpu->cycles;
+}
+
 void CpuReset(struct cpu *cpu) {
         cpu->addrAbs = 0xFFFC;
         uint16_t lo = BusRead(cpu->bus, cpu->addrAbs + 0, false);
@@ -206,7 +521,7 @@ void CpuReset(struct cpu *cpu) {
         cpu->x = 0;
         cpu->y = 0;
         cpu->sp = 0xFD;
-        cpu->status = 0x00 | U;
+        UnpackStatus(cpu, 0x00 | U);
 
         cpu->addrRel = 0x0000;
         cpu->addrAbs = 0x0000;
@@ -226,7 +541,7 @@ void Irq(struct cpu *cpu) {
         SetFlag(cpu, B, 0);
         SetFlag(cpu, U, 1);
         SetFlag(cpu, I, 1);
-        BusWrite(cpu->bus, 0x0100 + cpu->sp, cpu->status);
+        BusWrite(cpu->bus, 0x0100 + cpu->sp, PackStatus(cpu));
         cpu->sp--;
 
         cpu->addrAbs = 0xFFFE;
@@ -246,7 +561,7 @@ void CpuNmi(struct cpu *cpu) {
         SetFlag(cpu, B, 0);
         SetFlag(cpu, U, 1);
         SetFlag(cpu, I, 1);
-        BusWrite(cpu->bus, 0x0100 + cpu->sp, cpu->status);
+        BusWrite(cpu->bus, 0x0100 + cpu->sp, PackStatus(cpu));
         cpu->sp--;
 
         cpu->addrAbs = 0xFFFA;
@@ -747,7 +1062,7 @@ uint8_t BRK(struct cpu*cpu) {
         cpu->sp--;
 
         SetFlag(cpu, B, 1);
-        BusWrite(cpu->bus, 0x0100 + cpu->sp, cpu->status);
+        BusWrite(cpu->bus, 0x0100 + cpu->sp, PackStatus(cpu));
         cpu->sp--;
         SetFlag(cpu, B, 0);
 
@@ -1143,7 +1458,7 @@ uint8_t PHA(struct cpu *cpu) {
 //! \param[in,out] cpu
 //! \return 0 This instruction will take no additional cycles
 uint8_t PHP(struct cpu *cpu) {
-        BusWrite(cpu->bus, 0x0100 + cpu->sp, cpu->status | B | U);
+        BusWrite(cpu->bus, 0x0100 + cpu->sp, PackStatus(cpu) | B | U);
         SetFlag(cpu, B, 0);
         SetFlag(cpu, U, 0);
         cpu->sp--;
@@ -1172,7 +1487,7 @@ uint8_t PLA(struct cpu *cpu) {
 //! \return 0 This instruction will take no additional cycles
 uint8_t PLP(struct cpu *cpu) {
         cpu->sp++;
-        cpu->status = BusRead(cpu->bus, 0x0100 + cpu->sp, false);
+        UnpackStatus(cpu, BusRead(cpu->bus, 0x0100 + cpu->sp, false));
         SetFlag(cpu, U, 1);
         return 0;
 }
@@ -1224,7 +1539,7 @@ uint8_t ROR(struct cpu *cpu) {
 //! \return 0 This instruction will take no additional cycles
 uint8_t RTI(struct cpu *cpu) {
         cpu->sp++;
-        cpu->status = BusRead(cpu->bus, 0x0100 + cpu->sp, false);
+        UnpackStatus(cpu, BusRead(cpu->bus, 0x0100 + cpu->sp, false));
         cpu->status &= ~B;
         cpu->status &= ~U;
 
@@ -1401,6 +1716,1767 @@ uint8_t XXX(struct cpu *cpu) {
 }
 
 
+//-- Fused Interpreter ---------------------------------------------------------
+
+
+// The fused core computes effective addresses into a local rather than through
+// cpu->addrAbs, and instructions take their operand as a parameter instead of
+// calling Fetch, so no instructionMap lookup is needed to locate the data.
+// Instructions which don't touch operands are shared with the reference core.
+//
+// Instructions are fetched whole before they execute, so pc already points past
+// the operand and the addressing helpers take the operand as a parameter.
+// Instructions in prg memory are fetched from the decode cache.
+
+//! \brief Number of bytes taken by an instruction, including the opcode
+static uint8_t InstructionLength(uint8_t opcode) {
+        uint8_t (*address)(struct cpu *) = instructionMap[opcode].address;
+
+        if (address == IMP) {
+                return 1;
+        } else if (address == ABS || address == ABX || address == ABY || address == IND) {
+                return 3;
+        } else {
+                return 2;
+        }
+}
+
+//! \brief Read the instruction at addr from memory
+static void FusedDecode(struct cpu *cpu, uint16_t addr, struct decoded_instruction *instruction) {
+        instruction->opcode = BusRead(cpu->bus, addr, false);
+        instruction->length = InstructionLength(instruction->opcode);
+        instruction->cycles = instructionMap[instruction->opcode].cycles;
+        instruction->operand = 0x0000;
+        instruction->blockCount = 0;
+        instruction->blockCycles = 0;
+        instruction->pair = CPU_PAIR_NONE;
+        instruction->isPairKnown = false;
+        instruction->native = 0;
+
+        // BRK skips a padding byte, but never reads it.
+        if (instruction->length > 1 && 0x00 != instruction->opcode) {
+                instruction->operand = BusRead(cpu->bus, addr + 1, false);
+        }
+        if (instruction->length > 2) {
+                instruction->operand |= BusRead(cpu->bus, addr + 2, false) << 8;
+        }
+}
+
+//! \brief Fetch the instruction at pc, from the decode cache where possible
+//!
+//! Only pages with stable memory behind them are cached.  The cache entries for
+//! a page are dropped whenever different memory is mapped there, so an entry
+//! is effectively keyed by both address and bank.  Instructions straddling two
+//! pages aren't cached, as the second page could be remapped independently.
+//!
+//! \param[in,out] cpu
+//! \param[out] instruction
+static inline void FusedFetch(struct cpu *cpu, struct decoded_instruction *instruction) {
+        uint16_t pc = cpu->pc;
+        uint8_t page = pc >> 8;
+        uint8_t *mem = cpu->codePages[page];
+
+        if (page < 0x80 || NULL == mem) {
+                cpu->decodeStats.uncached++;
+                FusedDecode(cpu, pc, instruction);
+                return;
+        }
+
+        uint8_t slot = page & 0x7F;
+        if (cpu->decodedPages[slot] != mem) {
+                memset(&cpu->decodeCache[slot << 8], 0, 256 * sizeof(struct decoded_instruction));
+                cpu->decodedPages[slot] = mem;
+        }
+
+        struct decoded_instruction *entry = &cpu->decodeCache[pc & 0x7FFF];
+        if (0 != entry->length) {
+                cpu->decodeStats.hits++;
+                *instruction = *entry;
+                return;
+        }
+
+        FusedDecode(cpu, pc, instruction);
+
+        if ((pc & 0x00FF) + instruction->length <= 0x0100) {
+                cpu->decodeStats.misses++;
+                *entry = *instruction;
+        } else {
+                cpu->decodeStats.uncached++;
+        }
+}
+
+//! \brief Absolute addressing with a register offset; see ABX, ABY
+//! \param[out] crossed set to 1 if a page boundary was crossed, else 0
+static inline uint16_t FusedAbsIndexed(uint16_t base, uint8_t offset, uint8_t *crossed) {
+        uint16_t addr = base + offset;
+        *crossed = (addr & 0xFF00) != (base & 0xFF00);
+        return addr;
+}
+
+static inline uint16_t FusedZp(uint16_t operand, uint8_t offset) {
+        return (operand + offset) & 0x00FF;
+}
+
+//! \brief Indirect addressing, including the page wrap bug; see IND
+static inline uint16_t FusedInd(struct cpu *cpu, uint16_t ptr) {
+        if ((ptr & 0x00FF) == 0x00FF) {
+                return (BusRead(cpu->bus, ptr & 0xFF00, false) << 8) | BusRead(cpu->bus, ptr + 0, false);
+        } else {
+                return (BusRead(cpu->bus, ptr + 1, false) << 8) | BusRead(cpu->bus, ptr + 0, false);
+        }
+}
+
+static inline uint16_t FusedIzx(struct cpu *cpu, uint16_t t) {
+        uint16_t offset = t + (uint16_t)(cpu->x);
+        uint16_t lo = BusRead(cpu->bus, offset & 0x00FF, false);
+        uint16_t hi = BusRead(cpu->bus, (offset + 1) & 0x00FF, false);
+
+        return (hi << 8) | lo;
+}
+
+//! \param[out] crossed set to 1 if a page boundary was crossed, else 0
+static inline uint16_t FusedIzy(struct cpu *cpu, uint16_t t, uint8_t *crossed) {
+        uint16_t lo = BusRead(cpu->bus, t & 0x00FF, false);
+        uint16_t hi = BusRead(cpu->bus, (t + 1) & 0x00FF, false);
+
+        uint16_t addr = ((hi << 8) | lo) + cpu->y;
+        *crossed = (addr & 0xFF00) != (hi << 8);
+        return addr;
+}
+
+static inline uint8_t FusedRead(struct cpu *cpu, uint16_t addr) {
+        return BusRead(cpu->bus, addr, false);
+}
+
+//! \brief Whether the branch with the given opcode is taken; see BCC
+static inline bool FusedIsTaken(struct cpu *cpu, uint8_t opcode) {
+        switch (opcode) {
+                case 0x10: return !GetFlag(cpu, N);
+                case 0x30: return GetFlag(cpu, N);
+                case 0x50: return !GetFlag(cpu, V);
+                case 0x70: return GetFlag(cpu, V);
+                case 0x90: return !GetFlag(cpu, C);
+                case 0xB0: return GetFlag(cpu, C);
+                case 0xD0: return !GetFlag(cpu, Z);
+                case 0xF0: return GetFlag(cpu, Z);
+                default: return false;
+        }
+}
+
+//! \brief Relative addressing and conditional branch; see REL, BCC
+static inline void FusedBranch(struct cpu *cpu, uint16_t rel, bool taken) {
+        if (!taken)
+                return;
+
+        if (rel & 0x80)
+                rel |= 0xFF00;
+
+        uint16_t addr = cpu->pc + rel;
+        cpu->cycles++;
+        if ((addr & 0xFF00) != (cpu->pc & 0xFF00))
+                cpu->cycles++;
+
+        cpu->pc = addr;
+}
+
+// The fused helpers record flags straight into the lazily evaluated fields,
+// without the branches in SetFlag.
+
+static inline void FusedSetZN(struct cpu *cpu, uint8_t value) {
+        cpu->flagN = value;
+        cpu->flagZ = value;
+}
+
+//! \brief Add with Carry; see ADC
+static inline void FusedAdc(struct cpu *cpu, uint8_t fetched) {
+        uint16_t tmp = (uint16_t)cpu->a + (uint16_t)fetched + (uint16_t)cpu->flagC;
+
+        cpu->flagC = tmp >> 8;
+        cpu->flagV = (~((uint16_t)cpu->a ^ (uint16_t)fetched) & ((uint16_t)cpu->a ^ (uint16_t)tmp)) & 0x0080;
+
+        cpu->a = tmp & 0x00FF;
+        FusedSetZN(cpu, cpu->a);
+}
+
+//! \brief Subtraction with Borrow; see SBC
+static inline void FusedSbc(struct cpu *cpu, uint8_t fetched) {
+        uint16_t value = ((uint16_t)fetched) ^ 0x00FF;
+        uint16_t tmp = (uint16_t)cpu->a + value + (uint16_t)cpu->flagC;
+
+        cpu->flagC = tmp >> 8;
+        cpu->flagV = (tmp ^ (uint16_t)cpu->a) & (tmp ^ value) & 0x0080;
+
+        cpu->a = tmp & 0x00FF;
+        FusedSetZN(cpu, cpu->a);
+}
+
+//! \brief Shared body of CMP, CPX and CPY
+static inline void FusedCompare(struct cpu *cpu, uint8_t reg, uint8_t fetched) {
+        cpu->flagC = reg >= fetched;
+        FusedSetZN(cpu, reg - fetched);
+}
+
+//! \brief Bit test operation; see BIT
+static inline void FusedBit(struct cpu *cpu, uint8_t fetched) {
+        cpu->flagZ = cpu->a & fetched;
+        cpu->flagN = fetched;
+        cpu->flagV = fetched & V;
+}
+
+//! \brief Arithmetic Shift Left; see ASL
+//! \return the shifted value, to be stored by the caller
+static inline uint8_t FusedAsl(struct cpu *cpu, uint8_t fetched) {
+        uint8_t tmp = fetched << 1;
+        cpu->flagC = fetched >> 7;
+        FusedSetZN(cpu, tmp);
+        return tmp;
+}
+
+//! \brief Logical Shift Right; see LSR
+//! \return the shifted value, to be stored by the caller
+static inline uint8_t FusedLsr(struct cpu *cpu, uint8_t fetched) {
+        uint8_t tmp = fetched >> 1;
+        cpu->flagC = fetched & 0x01;
+        FusedSetZN(cpu, tmp);
+        return tmp;
+}
+
+//! \brief Rotate Left; see ROL
+//! \return the rotated value, to be stored by the caller
+static inline uint8_t FusedRol(struct cpu *cpu, uint8_t fetched) {
+        uint8_t tmp = (fetched << 1) | cpu->flagC;
+        cpu->flagC = fetched >> 7;
+        FusedSetZN(cpu, tmp);
+        return tmp;
+}
+
+//! \brief Rotate Right; see ROR
+//! \return the rotated value, to be stored by the caller
+static inline uint8_t FusedRor(struct cpu *cpu, uint8_t fetched) {
+        uint8_t tmp = (cpu->flagC << 7) | (fetched >> 1);
+        cpu->flagC = fetched & 0x01;
+        FusedSetZN(cpu, tmp);
+        return tmp;
+}
+
+//! \brief Read-modify-write increment or decrement of memory; see INC, DEC
+static inline void FusedIncDec(struct cpu *cpu, uint16_t addr, int8_t delta) {
+        uint8_t tmp = FusedRead(cpu, addr) + delta;
+        BusWrite(cpu->bus, addr, tmp);
+        FusedSetZN(cpu, tmp);
+}
+
+//! \brief Begin an already fetched instruction using the fused core
+//!
+//! Every opcode is a single case in a dense switch, which the compiler lowers
+//! to one jump table. Cycle counts still come from instructionMap so both cores
+//! share a single source of truth for timing, and the extra page-crossing cycle
+//! is only added by those cases where both the addressing mode and the
+//! instruction would have reported it in the reference core.
+//!
+//! Opcodes with no case are the illegal opcodes and NOPs, which do nothing
+//! beyond consuming cycles in the reference core.
+//!
+//! \param[in,out] cpu
+//! \param[in] instruction the instruction at pc
+static inline void FusedExecute(struct cpu *cpu, const struct decoded_instruction *instruction) {
+        uint8_t extra = 0;
+        uint8_t crossed = 0; // Page crossings which don't cost a cycle
+        uint16_t addr = 0;
+        uint16_t operand = instruction->operand;
+
+        cpu->opcode = instruction->opcode;
+        cpu->pc += instruction->length;
+
+        SetFlag(cpu, U, 1);
+        cpu->cycles = instruction->cycles;
+
+        switch (cpu->opcode) {
+                // ADC
+                case 0x69: FusedAdc(cpu, (uint8_t)operand); break;
+                case 0x65: addr = FusedZp(operand, 0); FusedAdc(cpu, FusedRead(cpu, addr)); break;
+                case 0x75: addr = FusedZp(operand, cpu->x); FusedAdc(cpu, FusedRead(cpu, addr)); break;
+                case 0x6D: addr = operand; FusedAdc(cpu, FusedRead(cpu, addr)); break;
+                case 0x7D: addr = FusedAbsIndexed(operand, cpu->x, &extra); FusedAdc(cpu, FusedRead(cpu, addr)); break;
+                case 0x79: addr = FusedAbsIndexed(operand, cpu->y, &extra); FusedAdc(cpu, FusedRead(cpu, addr)); break;
+                case 0x61: addr = FusedIzx(cpu, operand); FusedAdc(cpu, FusedRead(cpu, addr)); break;
+                case 0x71: addr = FusedIzy(cpu, operand, &extra); FusedAdc(cpu, FusedRead(cpu, addr)); break;
+
+                // SBC
+                case 0xE9: FusedSbc(cpu, (uint8_t)operand); break;
+                case 0xE5: addr = FusedZp(operand, 0); FusedSbc(cpu, FusedRead(cpu, addr)); break;
+                case 0xF5: addr = FusedZp(operand, cpu->x); FusedSbc(cpu, FusedRead(cpu, addr)); break;
+                case 0xED: addr = operand; FusedSbc(cpu, FusedRead(cpu, addr)); break;
+                case 0xFD: addr = FusedAbsIndexed(operand, cpu->x, &extra); FusedSbc(cpu, FusedRead(cpu, addr)); break;
+                case 0xF9: addr = FusedAbsIndexed(operand, cpu->y, &extra); FusedSbc(cpu, FusedRead(cpu, addr)); break;
+                case 0xE1: addr = FusedIzx(cpu, operand); FusedSbc(cpu, FusedRead(cpu, addr)); break;
+                case 0xF1: addr = FusedIzy(cpu, operand, &extra); FusedSbc(cpu, FusedRead(cpu, addr)); break;
+                case 0xEB: cpu->fetched = cpu->a; FusedSbc(cpu, cpu->a); break; // Illegal, but mapped to SBC {IMP}
+
+                // AND
+                case 0x29: cpu->a &= (uint8_t)operand; FusedSetZN(cpu, cpu->a); break;
+                case 0x25: addr = FusedZp(operand, 0); cpu->a &= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x35: addr = FusedZp(operand, cpu->x); cpu->a &= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x2D: addr = operand; cpu->a &= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x3D: addr = FusedAbsIndexed(operand, cpu->x, &extra); cpu->a &= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x39: addr = FusedAbsIndexed(operand, cpu->y, &extra); cpu->a &= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x21: addr = FusedIzx(cpu, operand); cpu->a &= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x31: addr = FusedIzy(cpu, operand, &extra); cpu->a &= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+
+                // ORA
+                case 0x09: cpu->a |= (uint8_t)operand; FusedSetZN(cpu, cpu->a); break;
+                case 0x05: addr = FusedZp(operand, 0); cpu->a |= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x15: addr = FusedZp(operand, cpu->x); cpu->a |= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x0D: addr = operand; cpu->a |= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x1D: addr = FusedAbsIndexed(operand, cpu->x, &extra); cpu->a |= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x19: addr = FusedAbsIndexed(operand, cpu->y, &extra); cpu->a |= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x01: addr = FusedIzx(cpu, operand); cpu->a |= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x11: addr = FusedIzy(cpu, operand, &extra); cpu->a |= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+
+                // EOR
+                case 0x49: cpu->a ^= (uint8_t)operand; FusedSetZN(cpu, cpu->a); break;
+                case 0x45: addr = FusedZp(operand, 0); cpu->a ^= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x55: addr = FusedZp(operand, cpu->x); cpu->a ^= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x4D: addr = operand; cpu->a ^= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x5D: addr = FusedAbsIndexed(operand, cpu->x, &extra); cpu->a ^= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x59: addr = FusedAbsIndexed(operand, cpu->y, &extra); cpu->a ^= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x41: addr = FusedIzx(cpu, operand); cpu->a ^= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0x51: addr = FusedIzy(cpu, operand, &extra); cpu->a ^= FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+
+                // CMP
+                case 0xC9: FusedCompare(cpu, cpu->a, (uint8_t)operand); break;
+                case 0xC5: addr = FusedZp(operand, 0); FusedCompare(cpu, cpu->a, FusedRead(cpu, addr)); break;
+                case 0xD5: addr = FusedZp(operand, cpu->x); FusedCompare(cpu, cpu->a, FusedRead(cpu, addr)); break;
+                case 0xCD: addr = operand; FusedCompare(cpu, cpu->a, FusedRead(cpu, addr)); break;
+                case 0xDD: addr = FusedAbsIndexed(operand, cpu->x, &extra); FusedCompare(cpu, cpu->a, FusedRead(cpu, addr)); break;
+                case 0xD9: addr = FusedAbsIndexed(operand, cpu->y, &extra); FusedCompare(cpu, cpu->a, FusedRead(cpu, addr)); break;
+                case 0xC1: addr = FusedIzx(cpu, operand); FusedCompare(cpu, cpu->a, FusedRead(cpu, addr)); break;
+                case 0xD1: addr = FusedIzy(cpu, operand, &extra); FusedCompare(cpu, cpu->a, FusedRead(cpu, addr)); break;
+
+                // CPX, CPY
+                case 0xE0: FusedCompare(cpu, cpu->x, (uint8_t)operand); break;
+                case 0xE4: addr = FusedZp(operand, 0); FusedCompare(cpu, cpu->x, FusedRead(cpu, addr)); break;
+                case 0xEC: addr = operand; FusedCompare(cpu, cpu->x, FusedRead(cpu, addr)); break;
+                case 0xC0: FusedCompare(cpu, cpu->y, (uint8_t)operand); break;
+                case 0xC4: addr = FusedZp(operand, 0); FusedCompare(cpu, cpu->y, FusedRead(cpu, addr)); break;
+                case 0xCC: addr = operand; FusedCompare(cpu, cpu->y, FusedRead(cpu, addr)); break;
+
+                // BIT
+                case 0x24: addr = FusedZp(operand, 0); FusedBit(cpu, FusedRead(cpu, addr)); break;
+                case 0x2C: addr = operand; FusedBit(cpu, FusedRead(cpu, addr)); break;
+
+                // LDA
+                case 0xA9: cpu->a = (uint8_t)operand; FusedSetZN(cpu, cpu->a); break;
+                case 0xA5: addr = FusedZp(operand, 0); cpu->a = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0xB5: addr = FusedZp(operand, cpu->x); cpu->a = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0xAD: addr = operand; cpu->a = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0xBD: addr = FusedAbsIndexed(operand, cpu->x, &extra); cpu->a = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0xB9: addr = FusedAbsIndexed(operand, cpu->y, &extra); cpu->a = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0xA1: addr = FusedIzx(cpu, operand); cpu->a = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+                case 0xB1: addr = FusedIzy(cpu, operand, &extra); cpu->a = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->a); break;
+
+                // LDX
+                case 0xA2: cpu->x = (uint8_t)operand; FusedSetZN(cpu, cpu->x); break;
+                case 0xA6: addr = FusedZp(operand, 0); cpu->x = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->x); break;
+                case 0xB6: addr = FusedZp(operand, cpu->y); cpu->x = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->x); break;
+                case 0xAE: addr = operand; cpu->x = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->x); break;
+                case 0xBE: addr = FusedAbsIndexed(operand, cpu->y, &extra); cpu->x = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->x); break;
+
+                // LDY
+                case 0xA0: cpu->y = (uint8_t)operand; FusedSetZN(cpu, cpu->y); break;
+                case 0xA4: addr = FusedZp(operand, 0); cpu->y = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->y); break;
+                case 0xB4: addr = FusedZp(operand, cpu->x); cpu->y = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->y); break;
+                case 0xAC: addr = operand; cpu->y = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->y); break;
+                case 0xBC: addr = FusedAbsIndexed(operand, cpu->x, &extra); cpu->y = FusedRead(cpu, addr); FusedSetZN(cpu, cpu->y); break;
+
+                // STA, STX, STY
+                case 0x85: addr = FusedZp(operand, 0); BusWrite(cpu->bus, addr, cpu->a); break;
+                case 0x95: addr = FusedZp(operand, cpu->x); BusWrite(cpu->bus, addr, cpu->a); break;
+                case 0x8D: addr = operand; BusWrite(cpu->bus, addr, cpu->a); break;
+                case 0x9D: addr = FusedAbsIndexed(operand, cpu->x, &crossed); BusWrite(cpu->bus, addr, cpu->a); break;
+                case 0x99: addr = FusedAbsIndexed(operand, cpu->y, &crossed); BusWrite(cpu->bus, addr, cpu->a); break;
+                case 0x81: addr = FusedIzx(cpu, operand); BusWrite(cpu->bus, addr, cpu->a); break;
+                case 0x91: addr = FusedIzy(cpu, operand, &crossed); BusWrite(cpu->bus, addr, cpu->a); break;
+                case 0x86: addr = FusedZp(operand, 0); BusWrite(cpu->bus, addr, cpu->x); break;
+                case 0x96: addr = FusedZp(operand, cpu->y); BusWrite(cpu->bus, addr, cpu->x); break;
+                case 0x8E: addr = operand; BusWrite(cpu->bus, addr, cpu->x); break;
+                case 0x84: addr = FusedZp(operand, 0); BusWrite(cpu->bus, addr, cpu->y); break;
+                case 0x94: addr = FusedZp(operand, cpu->x); BusWrite(cpu->bus, addr, cpu->y); break;
+                case 0x8C: addr = operand; BusWrite(cpu->bus, addr, cpu->y); break;
+
+                // ASL
+                case 0x0A: cpu->fetched = cpu->a; cpu->a = FusedAsl(cpu, cpu->a); break;
+                case 0x06: addr = FusedZp(operand, 0); BusWrite(cpu->bus, addr, FusedAsl(cpu, FusedRead(cpu, addr))); break;
+                case 0x16: addr = FusedZp(operand, cpu->x); BusWrite(cpu->bus, addr, FusedAsl(cpu, FusedRead(cpu, addr))); break;
+                case 0x0E: addr = operand; BusWrite(cpu->bus, addr, FusedAsl(cpu, FusedRead(cpu, addr))); break;
+                case 0x1E: addr = FusedAbsIndexed(operand, cpu->x, &crossed); BusWrite(cpu->bus, addr, FusedAsl(cpu, FusedRead(cpu, addr))); break;
+
+                // LSR
+                case 0x4A: cpu->fetched = cpu->a; cpu->a = FusedLsr(cpu, cpu->a); break;
+                case 0x46: addr = FusedZp(operand, 0); BusWrite(cpu->bus, addr, FusedLsr(cpu, FusedRead(cpu, addr))); break;
+                case 0x56: addr = FusedZp(operand, cpu->x); BusWrite(cpu->bus, addr, FusedLsr(cpu, FusedRead(cpu, addr))); break;
+                case 0x4E: addr = operand; BusWrite(cpu->bus, addr, FusedLsr(cpu, FusedRead(cpu, addr))); break;
+                case 0x5E: addr = FusedAbsIndexed(operand, cpu->x, &crossed); BusWrite(cpu->bus, addr, FusedLsr(cpu, FusedRead(cpu, addr))); break;
+
+                // ROL
+                case 0x2A: cpu->fetched = cpu->a; cpu->a = FusedRol(cpu, cpu->a); break;
+                case 0x26: addr = FusedZp(operand, 0); BusWrite(cpu->bus, addr, FusedRol(cpu, FusedRead(cpu, addr))); break;
+                case 0x36: addr = FusedZp(operand, cpu->x); BusWrite(cpu->bus, addr, FusedRol(cpu, FusedRead(cpu, addr))); break;
+                case 0x2E: addr = operand; BusWrite(cpu->bus, addr, FusedRol(cpu, FusedRead(cpu, addr))); break;
+                case 0x3E: addr = FusedAbsIndexed(operand, cpu->x, &crossed); BusWrite(cpu->bus, addr, FusedRol(cpu, FusedRead(cpu, addr))); break;
+
+                // ROR
+                case 0x6A: cpu->fetched = cpu->a; cpu->a = FusedRor(cpu, cpu->a); break;
+                case 0x66: addr = FusedZp(operand, 0); BusWrite(cpu->bus, addr, FusedRor(cpu, FusedRead(cpu, addr))); break;
+                case 0x76: addr = FusedZp(operand, cpu->x); BusWrite(cpu->bus, addr, FusedRor(cpu, FusedRead(cpu, addr))); break;
+                case 0x6E: addr = operand; BusWrite(cpu->bus, addr, FusedRor(cpu, FusedRead(cpu, addr))); break;
+                case 0x7E: addr = FusedAbsIndexed(operand, cpu->x, &crossed); BusWrite(cpu->bus, addr, FusedRor(cpu, FusedRead(cpu, addr))); break;
+
+                // INC, DEC
+                case 0xE6: addr = FusedZp(operand, 0); FusedIncDec(cpu, addr, 1); break;
+                case 0xF6: addr = FusedZp(operand, cpu->x); FusedIncDec(cpu, addr, 1); break;
+                case 0xEE: addr = operand; FusedIncDec(cpu, addr, 1); break;
+                case 0xFE: addr = FusedAbsIndexed(operand, cpu->x, &crossed); FusedIncDec(cpu, addr, 1); break;
+                case 0xC6: addr = FusedZp(operand, 0); FusedIncDec(cpu, addr, -1); break;
+                case 0xD6: addr = FusedZp(operand, cpu->x); FusedIncDec(cpu, addr, -1); break;
+                case 0xCE: addr = operand; FusedIncDec(cpu, addr, -1); break;
+                case 0xDE: addr = FusedAbsIndexed(operand, cpu->x, &crossed); FusedIncDec(cpu, addr, -1); break;
+
+                // Branches
+                case 0x10: case 0x30: case 0x50: case 0x70:
+                case 0x90: case 0xB0: case 0xD0: case 0xF0:
+                        FusedBranch(cpu, operand, FusedIsTaken(cpu, cpu->opcode));
+                        break;
+
+                // Jumps, subroutines and interrupts
+                case 0x4C: cpu->pc = operand; break;
+                case 0x6C: cpu->pc = FusedInd(cpu, operand); break;
+                case 0x20: cpu->addrAbs = operand; JSR(cpu); break;
+                case 0x60: RTS(cpu); break;
+                case 0x40: RTI(cpu); break;
+                case 0x00: BRK(cpu); break;
+
+                // Stack
+                case 0x48: PHA(cpu); break;
+                case 0x08: PHP(cpu); break;
+                case 0x68: PLA(cpu); break;
+                case 0x28: PLP(cpu); break;
+
+                // Register transfers, increments and flags
+                case 0xAA: TAX(cpu); break;
+                case 0xA8: TAY(cpu); break;
+                case 0xBA: TSX(cpu); break;
+                case 0x8A: TXA(cpu); break;
+                case 0x9A: TXS(cpu); break;
+                case 0x98: TYA(cpu); break;
+                case 0xE8: INX(cpu); break;
+                case 0xC8: INY(cpu); break;
+                case 0xCA: DEX(cpu); break;
+                case 0x88: DEY(cpu); break;
+                case 0x18: CLC(cpu); break;
+                case 0xD8: CLD(cpu); break;
+                case 0x58: CLI(cpu); break;
+                case 0xB8: CLV(cpu); break;
+                case 0x38: SEC(cpu); break;
+                case 0xF8: SED(cpu); break;
+                case 0x78: SEI(cpu); break;
+
+                default:
+                        // Illegal opcodes and NOPs are all implied mode in
+                        // instructionMap.
+                        cpu->fetched = cpu->a;
+                        break;
+        }
+
+        cpu->cycles += extra;
+
+        SetFlag(cpu, U, 1);
+}
+
+//! \brief Fetch and begin the next instruction using the fused core
+static void StepFused(struct cpu *cpu) {
+        struct decoded_instruction instruction;
+        FusedFetch(cpu, &instruction);
+        FusedExecute(cpu, &instruction);
+}
+
+
+//-- Superinstructions ---------------------------------------------------------
+
+
+// A handful of instruction pairs make up much of what games run: counting
+// loops, copies and comparisons.  CpuRun runs those pairs as one, with a
+// handler written for the pair rather than two trips through FusedExecute.
+// The first instruction of a pair only ever reads, or writes zero page, so it
+// can't yield or change the code after it.
+
+static const char *pairNames[CPU_PAIR_COUNT] = {
+        "none", "DEX/BNE", "DEY/BNE", "LDA/STA", "INC/branch", "CMP/branch",
+};
+
+const char *CpuPairName(enum cpu_pair pair) {
+        return pairNames[pair];
+}
+
+//! \brief Which superinstruction, if any, an instruction forms with the next
+static enum cpu_pair PairOf(struct decoded_instruction *first, struct decoded_instruction *second) {
+        uint8_t next = second->opcode;
+        bool isBranch = (next & 0x1F) == 0x10;
+
+        switch (first->opcode) {
+                case 0xCA: // DEX
+                        return (0xD0 == next) ? CPU_PAIR_DEX_BNE : CPU_PAIR_NONE;
+                case 0x88: // DEY
+                        return (0xD0 == next) ? CPU_PAIR_DEY_BNE : CPU_PAIR_NONE;
+                case 0xA9: case 0xA5: case 0xAD: // LDA
+                        return (0x85 == next || 0x8D == next) ? CPU_PAIR_LDA_STA : CPU_PAIR_NONE;
+                case 0xE6: // INC
+                        return (0x10 == next || 0x30 == next || 0xD0 == next || 0xF0 == next) ?
+                                CPU_PAIR_INC_BRANCH : CPU_PAIR_NONE;
+                case 0xC9: case 0xC5: // CMP
+                        return (isBranch && 0x50 != next && 0x70 != next) ? CPU_PAIR_CMP_BRANCH : CPU_PAIR_NONE;
+                default:
+                        return CPU_PAIR_NONE;
+        }
+}
+
+//! \brief Find the cached instruction at pc, looking up its pair if needed
+//!
+//! Pairs are only formed from instructions already in the decode cache, and
+//! never span pages, so that they're forgotten along with their page.
+//!
+//! \param[in,out] cpu
+//! \return the cached instruction, or NULL if pc isn't cached
+static struct decoded_instruction *FindPair(struct cpu *cpu) {
+        uint16_t pc = cpu->pc;
+        uint8_t page = pc >> 8;
+        uint8_t *mem = cpu->codePages[page];
+        if (page < 0x80 || NULL == mem || cpu->decodedPages[page & 0x7F] != mem) {
+                return NULL;
+        }
+
+        struct decoded_instruction *first = &cpu->decodeCache[pc & 0x7FFF];
+        if (0 == first->length) {
+                return NULL;
+        }
+
+        if (!first->isPairKnown) {
+                first->isPairKnown = true;
+                first->pair = CPU_PAIR_NONE;
+
+                uint16_t next = pc + first->length;
+                if ((next & 0xFF00) == (pc & 0xFF00)) {
+                        struct decoded_instruction *second = &cpu->decodeCache[next & 0x7FFF];
+                        if (0 == second->length) {
+                                struct decoded_instruction decoded;
+                                FusedDecode(cpu, next, &decoded);
+                                if ((next & 0x00FF) + decoded.length <= 0x0100) {
+                                        *second = decoded;
+                                }
+                        }
+                        if (0 != second->length) {
+                                first->pair = PairOf(first, second);
+                        }
+                }
+        }
+
+        return first;
+}
+
+//! \brief Begin the next instruction with the fused core, first running the
+//! one before it in full if the two form a superinstruction
+//!
+//! A pair is only run when its second instruction would be started within
+//! cycleBudget anyway, so nothing outside the cpu, such as an nmi, can fall
+//! between the two.
+//!
+//! \param[in,out] cpu
+//! \param[in] cycleBudget
+//! \return cycles taken by the first instruction of a pair, or 0
+static uint32_t StepPair(struct cpu *cpu, uint32_t cycleBudget) {
+        struct decoded_instruction *first = FindPair(cpu);
+        if (NULL == first) {
+                StepFused(cpu);
+                return 0;
+        }
+
+        // As StepFused would, for a cache hit.
+        if (CPU_PAIR_NONE == first->pair || first->cycles >= cycleBudget) {
+                cpu->decodeStats.hits++;
+                FusedExecute(cpu, first);
+                return 0;
+        }
+
+        // Both instructions are cached, in the same page.
+        struct decoded_instruction *second = first + first->length;
+        uint16_t operand = first->operand;
+
+        SetFlag(cpu, U, 1);
+        cpu->pc += first->length;
+        switch (first->pair) {
+                case CPU_PAIR_DEX_BNE:
+                        cpu->x--;
+                        FusedSetZN(cpu, cpu->x);
+                        break;
+
+                case CPU_PAIR_DEY_BNE:
+                        cpu->y--;
+                        FusedSetZN(cpu, cpu->y);
+                        break;
+
+                case CPU_PAIR_LDA_STA:
+                        cpu->a = (0xA9 == first->opcode) ? (uint8_t)operand : FusedRead(cpu, operand);
+                        FusedSetZN(cpu, cpu->a);
+                        break;
+
+                case CPU_PAIR_INC_BRANCH:
+                        FusedIncDec(cpu, operand, 1);
+                        break;
+
+                case CPU_PAIR_CMP_BRANCH:
+                        FusedCompare(cpu, cpu->a, (0xC9 == first->opcode) ? (uint8_t)operand : FusedRead(cpu, operand));
+                        break;
+        }
+
+        // None of the first instructions take extra cycles.
+        cpu->tickCount += first->cycles;
+        cpu->instructionCount++;
+
+        cpu->opcode = second->opcode;
+        cpu->pc += second->length;
+        cpu->cycles = second->cycles;
+        if (CPU_PAIR_LDA_STA == first->pair) {
+                BusWrite(cpu->bus, second->operand, cpu->a);
+        } else {
+                FusedBranch(cpu, second->operand, FusedIsTaken(cpu, second->opcode));
+        }
+
+        cpu->decodeStats.hits += 2;
+        cpu->decodeStats.pairs[first->pair]++;
+
+        return first->cycles;
+}
+
+
+//-- Block Executor ------------------------------------------------------------
+
+
+// The block core runs straight-line runs of cached instructions back to back,
+// only accounting for their cycles once the whole block is done.  That's only
+// safe while nothing can observe the cpu's cycle count mid-block, so a block
+// may only touch RAM and prg memory; except for its first instruction, which
+// runs with an exact cycle count like any other.  Blocks end with the first
+// instruction which transfers control, and never span pages.
+
+//! \brief Whether an instruction may transfer control; see BCC, JMP
+static bool IsControlFlow(struct instruction *instruction) {
+        uint8_t (*op)(struct cpu *) = instruction->operate;
+        return op == BCC || op == BCS || op == BEQ || op == BMI || op == BNE || op == BPL || op == BVC || op == BVS ||
+                op == JMP || op == JSR || op == RTS || op == RTI || op == BRK;
+}
+
+//! \brief Whether an instruction can only access RAM, or read prg memory
+//!
+//! Mapper000 doesn't intercept $4020-$7FFF, but other mappers may, so only
+//! $8000 and up is treated as prg memory.
+static bool IsBlockSafe(struct decoded_instruction *decoded) {
+        struct instruction *instruction = &instructionMap[decoded->opcode];
+        uint8_t (*address)(struct cpu *) = instruction->address;
+        uint8_t (*op)(struct cpu *) = instruction->operate;
+
+        if (address == IMP || address == IMM || address == REL ||
+            address == ZP0 || address == ZPX || address == ZPY) {
+                return true;
+        }
+
+        if (op == JMP || op == JSR) {
+                return address == ABS;
+        }
+
+        // The lowest and highest addresses which could be accessed.
+        uint32_t lo = decoded->operand;
+        uint32_t hi = decoded->operand;
+        if (address == ABX || address == ABY) {
+                hi += 0xFF;
+        } else if (address != ABS) {
+                return false; // IND, IZX, IZY
+        }
+
+        bool isWrite = op == STA || op == STX || op == STY || op == INC || op == DEC ||
+                op == ASL || op == LSR || op == ROL || op == ROR;
+
+        return hi < 0x2000 || (!isWrite && lo >= 0x8000 && hi <= 0xFFFF);
+}
+
+//! \brief Worst case number of cycles for an instruction
+static uint8_t MaxCycles(struct decoded_instruction *decoded) {
+        uint8_t (*address)(struct cpu *) = instructionMap[decoded->opcode].address;
+
+        if (address == REL) {
+                return decoded->cycles + 2; // Taken, to another page
+        } else if (address == ABX || address == ABY || address == IZY) {
+                return decoded->cycles + 1; // Crossed a page
+        }
+        return decoded->cycles;
+}
+
+//! \brief Find the block starting at pc, building it if needed
+//!
+//! \param[in,out] cpu
+//! \return the block's first instruction, or NULL if pc isn't cached memory
+static struct decoded_instruction *FindBlock(struct cpu *cpu) {
+        uint16_t pc = cpu->pc;
+        uint8_t page = pc >> 8;
+        uint8_t *mem = cpu->codePages[page];
+        if (page < 0x80 || NULL == mem) {
+                return NULL;
+        }
+
+        uint8_t slot = page & 0x7F;
+        if (cpu->decodedPages[slot] != mem) {
+                memset(&cpu->decodeCache[slot << 8], 0, 256 * sizeof(struct decoded_instruction));
+                cpu->decodedPages[slot] = mem;
+        }
+
+        struct decoded_instruction *block = &cpu->decodeCache[pc & 0x7FFF];
+        if (0 != block->blockCount) {
+                return block;
+        }
+
+        uint8_t count = 0;
+        uint16_t cycles = 0;
+        for (uint32_t addr = pc; addr <= (pc | 0x00FF) && count < 0xFF; ) {
+                struct decoded_instruction *entry = &cpu->decodeCache[addr & 0x7FFF];
+                if (0 == entry->length) {
+                        struct decoded_instruction decoded;
+                        FusedDecode(cpu, addr, &decoded);
+                        if ((addr & 0x00FF) + decoded.length > 0x0100) {
+                                break;
+                        }
+                        *entry = decoded;
+                }
+
+                if (0 != count && !IsBlockSafe(entry)) {
+                        break;
+                }
+
+                count++;
+                cycles += MaxCycles(entry);
+                addr += entry->length;
+
+                if (IsControlFlow(&instructionMap[entry->opcode])) {
+                        break;
+                }
+        }
+
+        if (0 == count) {
+                return NULL;
+        }
+
+        block->blockCount = count;
+        block->blockCycles = cycles;
+        return block;
+}
+
+//! \brief Run the whole block at pc, if it fits in the budget
+//!
+//! Must be called at an instruction boundary.
+//!
+//! \param[in,out] cpu
+//! \param[in] cycleBudget
+//! \return cycles run, or 0 if nothing was run
+static uint32_t RunBlock(struct cpu *cpu, uint32_t cycleBudget) {
+        struct decoded_instruction *block = FindBlock(cpu);
+        if (NULL == block || block->blockCycles > cycleBudget) {
+                return 0;
+        }
+
+        uint16_t pc = cpu->pc;
+        uint8_t page = pc >> 8;
+        uint8_t *mem = cpu->codePages[page];
+
+        uint8_t count = block->blockCount;
+        uint32_t elapsed = 0;
+
+        // Every instruction in the block was cached by FindBlock, and control
+        // only leaves the page at the end of the block.
+        struct decoded_instruction *entry = block;
+        for (uint8_t i = 0; i < count; i++) {
+#if defined(__x86_64__)
+                if (CPU_CORE_JIT == cpu->core && i == NativeStart(cpu, block, pc)) {
+                        return elapsed + RunNative(cpu, block, count - i);
+                }
+#endif
+
+                FusedExecute(cpu, entry);
+                cpu->instructionCount++;
+                cpu->decodeStats.hits++;
+
+                // As in CpuRun, a yield leaves the rest of the instruction in
+                // flight.
+                if (0 == i && cpu->isYieldRequested) {
+                        cpu->tickCount++;
+                        cpu->cycles--;
+                        return 1;
+                }
+
+                elapsed += cpu->cycles;
+                cpu->tickCount += cpu->cycles;
+                cpu->cycles = 0;
+
+                // Only the first instruction may have written to the
+                // cartridge; which may have rewritten this block or switched
+                // it out entirely.
+                if (0 == i && (0 == block->blockCount || cpu->codePages[page] != mem)) {
+                        break;
+                }
+
+                entry = &cpu->decodeCache[cpu->pc & 0x7FFF];
+        }
+
+        return elapsed;
+}
+
+
+//-- Native Blocks -------------------------------------------------------------
+
+
+// The jit core compiles blocks to x86-64 code the first time they're run, then
+// runs that instead of going through FusedExecute.  Blocks are compiled with
+// everything FindBlock knows about them: the operands, the address of every
+// instruction, and which memory each one can touch.  So zero page and RAM
+// accesses become single moves, and the pc is only written once, at the end.
+//
+// The registers live in struct cpu as they do for the interpreters, so native
+// code can fall back on FusedExecute for the few instructions it doesn't
+// compile itself.  An unsafe first instruction is always left to the
+// interpreter, as it may yield or rewrite the block.  Native code doesn't count
+// cycles per instruction: it returns the block's total, with the extra cycles
+// of page crossings and taken branches added up in a register.
+//
+// Elsewhere, the jit core interprets blocks just like the block core.
+
+#if defined(__x86_64__)
+
+#define NATIVE_NONE UINT32_MAX //!< native for blocks with nothing to compile
+
+enum x86_register {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15,
+        NO_INDEX = -1,
+};
+
+// Native code keeps the cpu in rbx, internal RAM in r12 and the block's extra
+// cycles in r14; all saved across calls.
+#define REG_CPU RBX
+#define REG_RAM R12
+#define REG_EXTRA R14
+
+//! \brief Native code being written into nativeCode
+struct emitter {
+        uint8_t *code;
+        uint32_t at; //!< Past size if the code didn't fit
+        uint32_t size;
+};
+
+static void Emit8(struct emitter *e, uint8_t byte) {
+        if (e->at < e->size) {
+                e->code[e->at] = byte;
+        }
+        e->at++;
+}
+
+static void Emit16(struct emitter *e, uint16_t value) {
+        Emit8(e, value & 0xFF);
+        Emit8(e, value >> 8);
+}
+
+static void Emit32(struct emitter *e, uint32_t value) {
+        Emit16(e, value & 0xFFFF);
+        Emit16(e, value >> 16);
+}
+
+static void Emit64(struct emitter *e, uint64_t value) {
+        Emit32(e, value & 0xFFFFFFFF);
+        Emit32(e, value >> 32);
+}
+
+//! \brief Emit an opcode of one byte, or two starting with 0x0F
+static void EmitOpcode(struct emitter *e, uint16_t opcode) {
+        if (opcode > 0xFF) {
+                Emit8(e, opcode >> 8);
+        }
+        Emit8(e, opcode & 0xFF);
+}
+
+//! \brief Emit an instruction with a memory operand, [base + index + disp]
+//!
+//! Only al, cl, dl and bl are used as byte registers, so no instruction needs a
+//! REX prefix just to reach a byte register.
+//!
+//! \param[in,out] e
+//! \param[in] isWide whether the operands are 64 bits
+//! \param[in] opcode
+//! \param[in] reg register operand, or opcode extension
+//! \param[in] base
+//! \param[in] index register, or NO_INDEX
+//! \param[in] disp
+static void EmitMem(struct emitter *e, bool isWide, uint16_t opcode, int reg, int base, int index, int32_t disp) {
+        uint8_t rex = 0x40 | (isWide << 3) | ((reg & 8) >> 1) | (base >> 3);
+        if (NO_INDEX != index) {
+                rex |= (index & 8) >> 2;
+        }
+        if (0x40 != rex) {
+                Emit8(e, rex);
+        }
+        EmitOpcode(e, opcode);
+
+        uint8_t mod = 0x80;
+        if (0 == disp && RBP != (base & 7)) {
+                mod = 0x00;
+        } else if (disp >= -128 && disp <= 127) {
+                mod = 0x40;
+        }
+
+        if (NO_INDEX != index || RSP == (base & 7)) {
+                Emit8(e, mod | ((reg & 7) << 3) | 0x04);
+                Emit8(e, (((NO_INDEX != index) ? index & 7 : 0x04) << 3) | (base & 7));
+        } else {
+                Emit8(e, mod | ((reg & 7) << 3) | (base & 7));
+        }
+
+        if (0x40 == mod) {
+                Emit8(e, (uint8_t)disp);
+        } else if (0x80 == mod) {
+                Emit32(e, (uint32_t)disp);
+        }
+}
+
+//! \brief Emit an instruction with two register operands
+static void EmitReg(struct emitter *e, bool isWide, uint16_t opcode, int reg, int rm) {
+        uint8_t rex = 0x40 | (isWide << 3) | ((reg & 8) >> 1) | (rm >> 3);
+        if (0x40 != rex) {
+                Emit8(e, rex);
+        }
+        EmitOpcode(e, opcode);
+        Emit8(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+enum x86_alu { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+
+//! \brief Emit a 32 bit arithmetic instruction with an immediate operand
+static void EmitAluImm(struct emitter *e, enum x86_alu alu, int rm, int32_t imm) {
+        if (imm >= -128 && imm <= 127) {
+                EmitReg(e, false, 0x83, alu, rm);
+                Emit8(e, (uint8_t)imm);
+        } else {
+                EmitReg(e, false, 0x81, alu, rm);
+                Emit32(e, (uint32_t)imm);
+        }
+}
+
+//! \brief Emit a 32 bit arithmetic instruction on two registers, rm op= reg
+static void EmitAlu(struct emitter *e, enum x86_alu alu, int rm, int reg) {
+        EmitReg(e, false, (alu << 3) | 0x01, reg, rm);
+}
+
+static void EmitShift(struct emitter *e, bool isLeft, int rm, uint8_t count) {
+        EmitReg(e, false, 0xC1, isLeft ? 4 : 5, rm);
+        Emit8(e, count);
+}
+
+static void EmitMovImm(struct emitter *e, int reg, uint32_t imm) {
+        if (reg >= R8) {
+                Emit8(e, 0x41);
+        }
+        Emit8(e, 0xB8 | (reg & 7));
+        Emit32(e, imm);
+}
+
+//! \brief Emit movzx reg, byte [cpu + offset]
+static void EmitLoadField(struct emitter *e, int reg, size_t offset) {
+        EmitMem(e, false, 0x0FB6, reg, REG_CPU, NO_INDEX, (int32_t)offset);
+}
+
+//! \brief Emit mov byte [cpu + offset], reg
+static void EmitStoreField(struct emitter *e, int reg, size_t offset) {
+        EmitMem(e, false, 0x88, reg, REG_CPU, NO_INDEX, (int32_t)offset);
+}
+
+//! \brief Emit mov byte [cpu + offset], imm
+static void EmitStoreFieldImm(struct emitter *e, size_t offset, uint8_t imm) {
+        EmitMem(e, false, 0xC6, 0, REG_CPU, NO_INDEX, (int32_t)offset);
+        Emit8(e, imm);
+}
+
+//! \brief Emit an arithmetic instruction on byte [cpu + offset] with an immediate
+static void EmitFieldAluImm(struct emitter *e, enum x86_alu alu, size_t offset, uint8_t imm) {
+        EmitMem(e, false, 0x80, alu, REG_CPU, NO_INDEX, (int32_t)offset);
+        Emit8(e, imm);
+}
+
+//! \brief Emit movzx reg, byte [ram + index + disp]
+static void EmitLoadRam(struct emitter *e, int reg, int index, int32_t disp) {
+        EmitMem(e, false, 0x0FB6, reg, REG_RAM, index, disp);
+}
+
+//! \brief Emit mov byte [ram + index + disp], reg
+static void EmitStoreRam(struct emitter *e, int reg, int index, int32_t disp) {
+        EmitMem(e, false, 0x88, reg, REG_RAM, index, disp);
+}
+
+//! \brief Emit the pc being set to a constant
+static void EmitSetPc(struct emitter *e, uint16_t pc) {
+        Emit8(e, 0x66);
+        EmitMem(e, false, 0xC7, 0, REG_CPU, NO_INDEX, offsetof(struct cpu, pc));
+        Emit16(e, pc);
+}
+
+//! \brief Emit FusedSetZN for the low byte of reg
+static void EmitSetZN(struct emitter *e, int reg) {
+        EmitStoreField(e, reg, offsetof(struct cpu, flagN));
+        EmitStoreField(e, reg, offsetof(struct cpu, flagZ));
+}
+
+//! \brief Emit a call to a function taking the cpu and esi, which must be set
+static void EmitCall(struct emitter *e, uintptr_t function) {
+        EmitReg(e, true, 0x89, REG_CPU, RDI);
+        Emit8(e, 0x48);
+        Emit8(e, 0xB8);
+        Emit64(e, function);
+        Emit8(e, 0xFF);
+        Emit8(e, 0xD0);
+}
+
+//! \brief Emit a conditional jump forward, to be patched by EmitLabel
+//!
+//! \return where to patch
+static uint32_t EmitJumpIf(struct emitter *e, uint8_t condition) {
+        Emit8(e, 0x0F);
+        Emit8(e, 0x80 | condition);
+        Emit32(e, 0);
+        return e->at - 4;
+}
+
+//! \brief Point a jump emitted by EmitJumpIf here
+static void EmitLabel(struct emitter *e, uint32_t patch) {
+        uint32_t at = e->at;
+        e->at = patch;
+        Emit32(e, at - (patch + 4));
+        e->at = at;
+}
+
+enum x86_condition { IF_EQUAL = 0x4, IF_NOT_EQUAL = 0x5, IF_ABOVE_OR_EQUAL = 0x3 };
+
+//! \brief Read memory outside RAM for native code
+static uint32_t NativeRead(struct cpu *cpu, uint32_t addr) {
+        return BusRead(cpu->bus, (uint16_t)addr, false);
+}
+
+//! \brief Run an instruction native code doesn't compile, as FusedExecute
+//!
+//! pc must already be the instruction's address.
+//!
+//! \param[in,out] cpu
+//! \param[in] instruction the opcode in the low byte, then the operand
+//! \return the extra cycles the instruction took
+static uint32_t NativeInterpret(struct cpu *cpu, uint32_t instruction) {
+        struct decoded_instruction decoded = {0};
+        decoded.opcode = instruction & 0xFF;
+        decoded.operand = instruction >> 8;
+        decoded.length = InstructionLength(decoded.opcode);
+        decoded.cycles = instructionMap[decoded.opcode].cycles;
+
+        FusedExecute(cpu, &decoded);
+
+        uint32_t extra = cpu->cycles - decoded.cycles;
+        cpu->cycles = 0;
+        return extra;
+}
+
+//! \brief Which register an instruction reads or writes
+static size_t RegisterOf(uint8_t opcode) {
+        switch (opcode & 0x03) {
+                case 0x00: return offsetof(struct cpu, y);
+                case 0x02: return offsetof(struct cpu, x);
+                default: return offsetof(struct cpu, a);
+        }
+}
+
+//! \brief Emit the effective address of a RAM access into ecx, as an offset
+//! into RAM
+//!
+//! \param[in,out] e
+//! \param[in] address addressing mode, from instructionMap
+//! \param[in] operand
+//! \param[in] indexOffset offset of x or y in struct cpu, for indexed modes
+static void EmitRamAddress(struct emitter *e, uint8_t (*address)(struct cpu *), uint16_t operand, size_t indexOffset) {
+        if (address == ZP0) {
+                EmitMovImm(e, RCX, operand & 0x00FF);
+        } else if (address == ZPX || address == ZPY) {
+                EmitLoadField(e, RCX, indexOffset);
+                EmitAluImm(e, ALU_ADD, RCX, operand & 0x00FF);
+                EmitReg(e, false, 0x0FB6, RCX, RCX); // movzx ecx, cl
+        } else if (address == ABS) {
+                EmitMovImm(e, RCX, operand & 0x07FF);
+        } else {
+                EmitLoadField(e, RCX, indexOffset);
+                EmitAluImm(e, ALU_ADD, RCX, operand);
+                EmitAluImm(e, ALU_AND, RCX, 0x07FF);
+        }
+}
+
+//! \brief Emit a read of an instruction's operand into eax
+//!
+//! The extra cycle for crossing a page is only counted if the instruction
+//! would count it; see FusedExecute.
+static void EmitOperand(struct emitter *e, struct decoded_instruction *entry, bool isExtraCounted) {
+        uint8_t (*address)(struct cpu *) = instructionMap[entry->opcode].address;
+        uint16_t operand = entry->operand;
+
+        // ZPY and ABY only go with LDX, STX and the accumulator.
+        size_t indexOffset = (address == ZPY || address == ABY) ? offsetof(struct cpu, y) : offsetof(struct cpu, x);
+
+        if (address == IMM) {
+                EmitMovImm(e, RAX, operand & 0x00FF);
+                return;
+        }
+
+        if (address == ABX || address == ABY) {
+                if (isExtraCounted && 0 != (operand & 0x00FF)) {
+                        EmitLoadField(e, RDX, indexOffset);
+                        EmitAluImm(e, ALU_ADD, RDX, operand & 0x00FF);
+                        EmitShift(e, false, RDX, 8);
+                        EmitAlu(e, ALU_ADD, REG_EXTRA, RDX);
+                }
+
+                // FindBlock only lets these read all RAM or all prg memory.
+                if (operand >= 0x2000) {
+                        EmitLoadField(e, RSI, indexOffset);
+                        EmitAluImm(e, ALU_ADD, RSI, operand);
+                        EmitCall(e, (uintptr_t)NativeRead);
+                        return;
+                }
+        } else if (address == ABS && operand >= 0x2000) {
+                EmitMovImm(e, RSI, operand);
+                EmitCall(e, (uintptr_t)NativeRead);
+                return;
+        }
+
+        EmitRamAddress(e, address, operand, indexOffset);
+        EmitLoadRam(e, RAX, RCX, 0);
+}
+
+//! \brief Emit the branch ending a block
+static void EmitBranch(struct emitter *e, uint8_t opcode, uint16_t next, uint16_t operand) {
+        uint16_t target = next + (uint16_t)(int8_t)operand;
+
+        size_t flag = offsetof(struct cpu, flagC);
+        switch (opcode) {
+                case 0x10: case 0x30: flag = offsetof(struct cpu, flagN); break;
+                case 0x50: case 0x70: flag = offsetof(struct cpu, flagV); break;
+                case 0xD0: case 0xF0: flag = offsetof(struct cpu, flagZ); break;
+        }
+
+        // Each test sets ZF when the branch would be taken by BPL, BVC, BCC
+        // and BEQ; the others branch on the opposite.
+        if (0x10 == opcode || 0x30 == opcode) {
+                EmitMem(e, false, 0xF6, 0, REG_CPU, NO_INDEX, (int32_t)flag); // test byte, 0x80
+                Emit8(e, 0x80);
+        } else {
+                EmitFieldAluImm(e, ALU_CMP, flag, 0x00);
+        }
+        bool isTakenIfZero = 0x10 == opcode || 0x50 == opcode || 0x90 == opcode || 0xF0 == opcode;
+
+        EmitSetPc(e, next);
+        uint32_t notTaken = EmitJumpIf(e, isTakenIfZero ? IF_NOT_EQUAL : IF_EQUAL);
+        EmitSetPc(e, target);
+        EmitAluImm(e, ALU_ADD, REG_EXTRA, ((target & 0xFF00) != (next & 0xFF00)) ? 2 : 1);
+        EmitLabel(e, notTaken);
+}
+
+//! \brief Emit ADC of eax, as FusedAdc
+static void EmitAdc(struct emitter *e) {
+        EmitLoadField(e, RCX, offsetof(struct cpu, a));
+        EmitLoadField(e, RDX, offsetof(struct cpu, flagC));
+        EmitAlu(e, ALU_ADD, RDX, RCX);
+        EmitAlu(e, ALU_ADD, RDX, RAX); // edx = a + fetched + c
+
+        // (a ^ result) & (fetched ^ result) is the same as FusedAdc's
+        // ~(a ^ fetched) & (a ^ result), in bit 7.
+        EmitAlu(e, ALU_XOR, RCX, RDX);
+        EmitAlu(e, ALU_XOR, RAX, RDX);
+        EmitAlu(e, ALU_AND, RAX, RCX);
+        EmitAluImm(e, ALU_AND, RAX, 0x80);
+        EmitStoreField(e, RAX, offsetof(struct cpu, flagV));
+
+        EmitReg(e, false, 0x89, RDX, RAX); // mov eax, edx
+        EmitShift(e, false, RAX, 8);
+        EmitStoreField(e, RAX, offsetof(struct cpu, flagC));
+
+        EmitStoreField(e, RDX, offsetof(struct cpu, a));
+        EmitSetZN(e, RDX);
+}
+
+//! \brief Emit a shift or rotate of eax into dl, as FusedAsl and the like
+//!
+//! Leaves ecx alone, as it may hold the address being shifted.
+static void EmitShiftOp(struct emitter *e, uint8_t group) {
+        EmitReg(e, false, 0x89, RAX, RDX); // mov edx, eax
+        switch (group) {
+                case 0x00: // ASL
+                        EmitShift(e, true, RDX, 1);
+                        EmitShift(e, false, RAX, 7);
+                        break;
+                case 0x20: // ROL
+                        EmitShift(e, true, RDX, 1);
+                        EmitLoadField(e, RSI, offsetof(struct cpu, flagC));
+                        EmitAlu(e, ALU_OR, RDX, RSI);
+                        EmitShift(e, false, RAX, 7);
+                        break;
+                case 0x40: // LSR
+                        EmitShift(e, false, RDX, 1);
+                        EmitAluImm(e, ALU_AND, RAX, 0x01);
+                        break;
+                case 0x60: // ROR
+                        EmitShift(e, false, RDX, 1);
+                        EmitLoadField(e, RSI, offsetof(struct cpu, flagC));
+                        EmitShift(e, true, RSI, 7);
+                        EmitAlu(e, ALU_OR, RDX, RSI);
+                        EmitAluImm(e, ALU_AND, RAX, 0x01);
+                        break;
+        }
+        EmitStoreField(e, RAX, offsetof(struct cpu, flagC));
+        EmitSetZN(e, RDX);
+}
+
+//! \brief Emit one instruction of a block
+//!
+//! \param[in,out] e
+//! \param[in] entry
+//! \param[in] pc address of the instruction
+//! \return whether the instruction sets pc itself
+static bool EmitInstruction(struct emitter *e, struct decoded_instruction *entry, uint16_t pc) {
+        struct instruction *instruction = &instructionMap[entry->opcode];
+        uint8_t (*op)(struct cpu *) = instruction->operate;
+        uint8_t (*address)(struct cpu *) = instruction->address;
+        uint8_t opcode = entry->opcode;
+        uint16_t operand = entry->operand;
+        uint16_t next = pc + entry->length;
+        size_t indexOffset = (address == ZPY || address == ABY) ? offsetof(struct cpu, y) : offsetof(struct cpu, x);
+
+        if (op == LDA || op == LDX || op == LDY) {
+                EmitOperand(e, entry, true);
+                EmitStoreField(e, RAX, RegisterOf(opcode));
+                EmitSetZN(e, RAX);
+        } else if (op == STA || op == STX || op == STY) {
+                EmitRamAddress(e, address, operand, indexOffset);
+                EmitLoadField(e, RAX, RegisterOf(opcode));
+                EmitStoreRam(e, RAX, RCX, 0);
+        } else if (op == AND || op == ORA || op == EOR) {
+                EmitOperand(e, entry, true);
+                EmitLoadField(e, RDX, offsetof(struct cpu, a));
+                EmitAlu(e, (op == AND) ? ALU_AND : (op == ORA) ? ALU_OR : ALU_XOR, RDX, RAX);
+                EmitStoreField(e, RDX, offsetof(struct cpu, a));
+                EmitSetZN(e, RDX);
+        } else if ((op == ADC || op == SBC) && address != IMP) {
+                EmitOperand(e, entry, true);
+                if (op == SBC) {
+                        EmitAluImm(e, ALU_XOR, RAX, 0xFF);
+                }
+                EmitAdc(e);
+        } else if (op == CMP || op == CPX || op == CPY) {
+                EmitOperand(e, entry, true);
+                EmitLoadField(e, RCX, (op == CMP) ? offsetof(struct cpu, a) : (op == CPX) ? offsetof(struct cpu, x) : offsetof(struct cpu, y));
+                EmitAlu(e, ALU_CMP, RCX, RAX);
+                EmitReg(e, false, 0x0F90 | IF_ABOVE_OR_EQUAL, 0, RDX); // setae dl
+                EmitStoreField(e, RDX, offsetof(struct cpu, flagC));
+                EmitAlu(e, ALU_SUB, RCX, RAX);
+                EmitSetZN(e, RCX);
+        } else if (op == BIT) {
+                EmitOperand(e, entry, false);
+                EmitStoreField(e, RAX, offsetof(struct cpu, flagN));
+                EmitLoadField(e, RDX, offsetof(struct cpu, a));
+                EmitAlu(e, ALU_AND, RDX, RAX);
+                EmitStoreField(e, RDX, offsetof(struct cpu, flagZ));
+                EmitAluImm(e, ALU_AND, RAX, V);
+                EmitStoreField(e, RAX, offsetof(struct cpu, flagV));
+        } else if (op == ASL || op == LSR || op == ROL || op == ROR) {
+                if (address == IMP) {
+                        EmitLoadField(e, RAX, offsetof(struct cpu, a));
+                        EmitShiftOp(e, opcode & 0xE0);
+                        EmitStoreField(e, RDX, offsetof(struct cpu, a));
+                } else {
+                        EmitRamAddress(e, address, operand, indexOffset);
+                        EmitLoadRam(e, RAX, RCX, 0);
+                        EmitShiftOp(e, opcode & 0xE0);
+                        EmitStoreRam(e, RDX, RCX, 0);
+                }
+        } else if (op == INC || op == DEC) {
+                EmitRamAddress(e, address, operand, indexOffset);
+                EmitLoadRam(e, RAX, RCX, 0);
+                EmitAluImm(e, (op == INC) ? ALU_ADD : ALU_SUB, RAX, 1);
+                EmitStoreRam(e, RAX, RCX, 0);
+                EmitSetZN(e, RAX);
+        } else if (op == INX || op == INY || op == DEX || op == DEY) {
+                size_t reg = (op == INX || op == DEX) ? offsetof(struct cpu, x) : offsetof(struct cpu, y);
+                EmitLoadField(e, RAX, reg);
+                EmitAluImm(e, (op == INX || op == INY) ? ALU_ADD : ALU_SUB, RAX, 1);
+                EmitStoreField(e, RAX, reg);
+                EmitSetZN(e, RAX);
+        } else if (op == TAX || op == TAY || op == TXA || op == TYA || op == TSX || op == TXS) {
+                size_t from = offsetof(struct cpu, a);
+                size_t to = offsetof(struct cpu, a);
+                if (op == TAX) to = offsetof(struct cpu, x);
+                if (op == TAY) to = offsetof(struct cpu, y);
+                if (op == TXA) from = offsetof(struct cpu, x);
+                if (op == TYA) from = offsetof(struct cpu, y);
+                if (op == TSX) { from = offsetof(struct cpu, sp); to = offsetof(struct cpu, x); }
+                if (op == TXS) { from = offsetof(struct cpu, x); to = offsetof(struct cpu, sp); }
+                EmitLoadField(e, RAX, from);
+                EmitStoreField(e, RAX, to);
+                if (op != TXS) {
+                        EmitSetZN(e, RAX);
+                }
+        } else if (op == CLC || op == SEC) {
+                EmitStoreFieldImm(e, offsetof(struct cpu, flagC), (op == SEC) ? 1 : 0);
+        } else if (op == CLV) {
+                EmitStoreFieldImm(e, offsetof(struct cpu, flagV), 0);
+        } else if (op == CLI || op == CLD) {
+                EmitFieldAluImm(e, ALU_AND, offsetof(struct cpu, status), (uint8_t)~((op == CLI) ? I : D));
+        } else if (op == SEI || op == SED) {
+                EmitFieldAluImm(e, ALU_OR, offsetof(struct cpu, status), (op == SEI) ? I : D);
+        } else if (op == PHA) {
+                EmitLoadField(e, RCX, offsetof(struct cpu, sp));
+                EmitLoadField(e, RAX, offsetof(struct cpu, a));
+                EmitStoreRam(e, RAX, RCX, 0x0100);
+                EmitFieldAluImm(e, ALU_SUB, offsetof(struct cpu, sp), 1);
+        } else if (op == PLA) {
+                EmitFieldAluImm(e, ALU_ADD, offsetof(struct cpu, sp), 1);
+                EmitLoadField(e, RCX, offsetof(struct cpu, sp));
+                EmitLoadRam(e, RAX, RCX, 0x0100);
+                EmitStoreField(e, RAX, offsetof(struct cpu, a));
+                EmitSetZN(e, RAX);
+        } else if (op == JMP && address == ABS) {
+                EmitSetPc(e, operand);
+                return true;
+        } else if (op == JSR) {
+                // Pushes the address of its own last byte.
+                uint16_t ret = next - 1;
+                EmitLoadField(e, RCX, offsetof(struct cpu, sp));
+                EmitMem(e, false, 0xC6, 0, REG_RAM, RCX, 0x0100);
+                Emit8(e, ret >> 8);
+                EmitAluImm(e, ALU_SUB, RCX, 1);
+                EmitReg(e, false, 0x0FB6, RCX, RCX); // movzx ecx, cl
+                EmitMem(e, false, 0xC6, 0, REG_RAM, RCX, 0x0100);
+                Emit8(e, ret & 0xFF);
+                EmitAluImm(e, ALU_SUB, RCX, 1);
+                EmitStoreField(e, RCX, offsetof(struct cpu, sp));
+                EmitSetPc(e, operand);
+                return true;
+        } else if (op == RTS) {
+                EmitLoadField(e, RCX, offsetof(struct cpu, sp));
+                EmitAluImm(e, ALU_ADD, RCX, 1);
+                EmitReg(e, false, 0x0FB6, RCX, RCX);
+                EmitLoadRam(e, RAX, RCX, 0x0100);
+                EmitAluImm(e, ALU_ADD, RCX, 1);
+                EmitReg(e, false, 0x0FB6, RCX, RCX);
+                EmitLoadRam(e, RDX, RCX, 0x0100);
+                EmitStoreField(e, RCX, offsetof(struct cpu, sp));
+                EmitShift(e, true, RDX, 8);
+                EmitAlu(e, ALU_OR, RAX, RDX);
+                EmitAluImm(e, ALU_ADD, RAX, 1);
+                Emit8(e, 0x66);
+                EmitMem(e, false, 0x89, RAX, REG_CPU, NO_INDEX, offsetof(struct cpu, pc));
+                return true;
+        } else if (address == REL) {
+                EmitBranch(e, opcode, next, operand);
+                return true;
+        } else if (op == NOP || op == XXX) {
+                // Nothing but cycles.
+        } else {
+                // BRK, RTI, PHP, PLP and SBC {IMP}.
+                EmitSetPc(e, pc);
+                EmitMovImm(e, RSI, opcode | ((uint32_t)operand << 8));
+                EmitCall(e, (uintptr_t)NativeInterpret);
+                EmitAlu(e, ALU_ADD, REG_EXTRA, RAX);
+                return true;
+        }
+
+        return false;
+}
+
+//! \brief Emit a whole block as a function, uint32_t run(struct cpu *)
+//!
+//! \param[in,out] e
+//! \param[in] cpu
+//! \param[in] block
+//! \param[in] pc address of the block
+//! \param[in] start index of the first instruction to compile
+static void EmitBlock(struct emitter *e, struct cpu *cpu, struct decoded_instruction *block, uint16_t pc, uint8_t start) {
+        // Three pushes leave the stack aligned for calls.
+        Emit8(e, 0x53); // push rbx
+        Emit8(e, 0x41); Emit8(e, 0x54); // push r12
+        Emit8(e, 0x41); Emit8(e, 0x56); // push r14
+        EmitReg(e, true, 0x89, RDI, REG_CPU);
+        EmitMem(e, true, 0x8B, REG_RAM, REG_CPU, NO_INDEX, offsetof(struct cpu, ram));
+        EmitAlu(e, ALU_XOR, REG_EXTRA, REG_EXTRA);
+
+        uint32_t cycles = 0;
+        uint8_t opcode = 0;
+        bool isPcSet = false;
+        for (uint8_t i = 0; i < block->blockCount; i++) {
+                struct decoded_instruction *entry = &cpu->decodeCache[pc & 0x7FFF];
+                if (i >= start) {
+                        isPcSet = EmitInstruction(e, entry, pc);
+                        cycles += entry->cycles;
+                        opcode = entry->opcode;
+                }
+                pc += entry->length;
+        }
+
+        if (!isPcSet) {
+                EmitSetPc(e, pc);
+        }
+        EmitStoreFieldImm(e, offsetof(struct cpu, opcode), opcode);
+        EmitFieldAluImm(e, ALU_OR, offsetof(struct cpu, status), U);
+
+        EmitReg(e, false, 0x89, REG_EXTRA, RAX);
+        EmitAluImm(e, ALU_ADD, RAX, cycles);
+        Emit8(e, 0x41); Emit8(e, 0x5E); // pop r14
+        Emit8(e, 0x41); Emit8(e, 0x5C); // pop r12
+        Emit8(e, 0x5B); // pop rbx
+        Emit8(e, 0xC3); // ret
+}
+
+//! \brief Forget all native code, to make room for more
+static void FlushNative(struct cpu *cpu) {
+        for (int i = 0; i < 0x8000; i++) {
+                cpu->decodeCache[i].native = 0;
+        }
+        cpu->nativeUsed = 0;
+}
+
+//! \brief Change the protection of nativeCode
+//!
+//! If it can't be changed, all native code is dropped and the jit core goes
+//! back to interpreting blocks.
+//!
+//! \param[in,out] cpu
+//! \param[in] protection for mprotect
+//! \return false if nativeCode is gone
+static bool ProtectNative(struct cpu *cpu, int protection) {
+        if (0 == mprotect(cpu->nativeCode, NATIVE_CODE_SIZE, protection)) {
+                return true;
+        }
+
+        FlushNative(cpu);
+        munmap(cpu->nativeCode, NATIVE_CODE_SIZE);
+        cpu->nativeCode = NULL;
+        cpu->isNativeUnavailable = true;
+        return false;
+}
+
+//! \brief Compile a block found by FindBlock to native code
+//!
+//! \param[in,out] cpu
+//! \param[in,out] block
+//! \param[in] pc address of the block
+static void CompileBlock(struct cpu *cpu, struct decoded_instruction *block, uint16_t pc) {
+        block->native = NATIVE_NONE;
+        block->nativeStart = block->blockCount;
+
+        // The first instruction is left to the interpreter if it may touch
+        // anything but RAM and prg memory.
+        uint8_t start = IsBlockSafe(block) ? 0 : 1;
+        if (start >= block->blockCount || cpu->isNativeUnavailable) {
+                return;
+        }
+
+        // nativeCode is never writable and executable at once; it's only
+        // writable while a block is compiled.
+        if (NULL == cpu->nativeCode) {
+                void *code = mmap(NULL, NATIVE_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (MAP_FAILED == code) {
+                        cpu->isNativeUnavailable = true;
+                        return;
+                }
+                cpu->nativeCode = (uint8_t *)code;
+        } else if (!ProtectNative(cpu, PROT_READ | PROT_WRITE)) {
+                return;
+        }
+
+        struct emitter e = { cpu->nativeCode, cpu->nativeUsed, NATIVE_CODE_SIZE };
+        EmitBlock(&e, cpu, block, pc, start);
+        if (e.at > e.size) {
+                FlushNative(cpu);
+                e.at = 0;
+                EmitBlock(&e, cpu, block, pc, start);
+        }
+
+        if (!ProtectNative(cpu, PROT_READ | PROT_EXEC)) {
+                return;
+        }
+
+        block->native = cpu->nativeUsed + 1;
+        block->nativeStart = start;
+        cpu->nativeUsed = e.at;
+}
+
+//! \brief Index of the first instruction of a block in its native code,
+//! compiling the block if it hasn't been yet
+//!
+//! \return the index, or the block's length if none of it is native code
+static uint8_t NativeStart(struct cpu *cpu, struct decoded_instruction *block, uint16_t pc) {
+        if (0 == block->native) {
+                CompileBlock(cpu, block, pc);
+        }
+        return block->nativeStart;
+}
+
+//! \brief Run the rest of a block as native code
+//!
+//! \param[in,out] cpu
+//! \param[in] block compiled with CompileBlock
+//! \param[in] count instructions left in the block
+//! \return cycles run
+static uint32_t RunNative(struct cpu *cpu, struct decoded_instruction *block, uint8_t count) {
+        uint8_t *code = cpu->nativeCode + block->native - 1;
+
+        // ISO C has no conversion from object to function pointers.
+        uint32_t (*run)(struct cpu *);
+        memcpy(&run, &code, sizeof(run));
+
+        uint32_t cycles = run(cpu);
+        cpu->tickCount += cycles;
+        cpu->instructionCount += count;
+        cpu->decodeStats.hits += count;
+        return cycles;
+}
+
+#endif // defined(__x86_64__)
+
+
+//-- Translated Blocks ---------------------------------------------------------
+
+
+void CpuSetTranslation(struct cpu *cpu, const struct cpu_translated_block *blocks) {
+        cpu->translation = blocks;
+        cpu->ram = BusGetRam(cpu->bus);
+}
+
+//! \brief Run the translated block at pc, if there is one and it fits
+//!
+//! Must be called at an instruction boundary.
+//!
+//! \param[in,out] cpu
+//! \param[in] cycleBudget
+//! \return cycles run, or 0 if nothing was run
+static uint32_t RunTranslated(struct cpu *cpu, uint32_t cycleBudget) {
+        if (cpu->pc < 0x8000) {
+                return 0;
+        }
+
+        const struct cpu_translated_block *block = &cpu->translation[cpu->pc & 0x7FFF];
+        if (NULL == block->run || block->maxCycles > cycleBudget) {
+                return 0;
+        }
+
+        struct cpu_state state;
+        CpuGetState(cpu, &state);
+
+        uint32_t cycles = block->run(&state, cpu->ram);
+
+        cpu->a = state.a;
+        cpu->x = state.x;
+        cpu->y = state.y;
+        cpu->sp = state.sp;
+        cpu->pc = state.pc;
+        UnpackStatus(cpu, state.status);
+
+        cpu->instructionCount += block->count;
+        cpu->decodeStats.translated += block->count;
+        cpu->tickCount += cycles;
+
+        return cycles;
+}
+
+void CpuGetOpcodeInfo(uint8_t opcode, struct cpu_opcode_info *info) {
+        struct instruction *instruction = &instructionMap[opcode];
+        uint8_t (*address)(struct cpu *) = instruction->address;
+
+        info->name = instruction->name;
+        info->length = InstructionLength(opcode);
+        info->cycles = instruction->cycles;
+
+        if (address == IMM) {
+                info->mode = CPU_MODE_IMM;
+        } else if (address == ZP0) {
+                info->mode = CPU_MODE_ZP0;
+        } else if (address == ZPX) {
+                info->mode = CPU_MODE_ZPX;
+        } else if (address == ZPY) {
+                info->mode = CPU_MODE_ZPY;
+        } else if (address == REL) {
+                info->mode = CPU_MODE_REL;
+        } else if (address == ABS) {
+                info->mode = CPU_MODE_ABS;
+        } else if (address == ABX) {
+                info->mode = CPU_MODE_ABX;
+        } else if (address == ABY) {
+                info->mode = CPU_MODE_ABY;
+        } else if (address == IND) {
+                info->mode = CPU_MODE_IND;
+        } else if (address == IZX) {
+                info->mode = CPU_MODE_IZX;
+        } else if (address == IZY) {
+                info->mode = CPU_MODE_IZY;
+        } else {
+                info->mode = CPU_MODE_IMP;
+        }
+}
+
+
+//-- Idle Loops ----------------------------------------------------------------
+
+
+// Games often wait for vertical blank or the nmi in a loop that does nothing
+// but poll one memory location: `JMP *`, or a load such as `LDA $2002`
+// followed by a branch back to it.  While the polled value can't change and
+// reading it has no side effects, every iteration leaves the cpu exactly as
+// it found it, so CpuRun can skip whole iterations just by counting their
+// cycles.  The bus knows how long the value will hold; see BusTicksUntilChange.
+
+//! \brief Read code from memory the decode cache could cache it from
+static bool PeekCode(struct cpu *cpu, uint16_t addr, uint8_t *data) {
+        uint8_t *page = cpu->codePages[addr >> 8];
+        if (NULL == page) {
+                return false;
+        }
+        *data = page[addr & 0x00FF];
+        return true;
+}
+
+//! \brief Whether an opcode is LDA, LDX, LDY or BIT from a fixed address
+static bool IsPollingLoad(uint8_t opcode) {
+        switch (opcode) {
+                case 0xA5: case 0xAD: // LDA
+                case 0xA6: case 0xAE: // LDX
+                case 0xA4: case 0xAC: // LDY
+                case 0x24: case 0x2C: // BIT
+                        return true;
+                default:
+                        return false;
+        }
+}
+
+//! \brief Do what a polling load does with the data it reads
+static void ApplyPollingLoad(struct cpu *cpu, uint8_t opcode, uint8_t data) {
+        switch (opcode) {
+                case 0xA5: case 0xAD: cpu->a = data; FusedSetZN(cpu, data); break;
+                case 0xA6: case 0xAE: cpu->x = data; FusedSetZN(cpu, data); break;
+                case 0xA4: case 0xAC: cpu->y = data; FusedSetZN(cpu, data); break;
+                case 0x24: case 0x2C: FusedBit(cpu, data); break;
+        }
+}
+
+//! \brief Skip whole iterations of the idle loop at pc, if there is one
+//!
+//! Must be called at an instruction boundary.
+//!
+//! \param[in,out] cpu
+//! \param[in] cycleBudget
+//! \return cycles skipped, or 0 if nothing was skipped
+static uint32_t SkipIdleLoop(struct cpu *cpu, uint32_t cycleBudget) {
+        uint16_t pc = cpu->pc;
+        uint8_t opcode;
+        uint8_t lo;
+        uint8_t hi = 0x00;
+        if (!PeekCode(cpu, pc, &opcode) || !PeekCode(cpu, pc + 1, &lo)) {
+                return 0;
+        }
+
+        uint32_t cycles = 0; // Per iteration
+        uint32_t instructions = 0; // Per iteration
+        uint32_t ticks = UINT32_MAX;
+
+        if (0x4C == opcode) {
+                // JMP *
+                if (!PeekCode(cpu, pc + 2, &hi) || ((uint16_t)hi << 8 | lo) != pc) {
+                        return 0;
+                }
+                cycles = instructionMap[opcode].cycles;
+                instructions = 1;
+        } else if (IsPollingLoad(opcode)) {
+                uint8_t length = InstructionLength(opcode);
+                if (3 == length && !PeekCode(cpu, pc + 2, &hi)) {
+                        return 0;
+                }
+                uint16_t addr = (uint16_t)hi << 8 | lo;
+
+                uint16_t next = pc + length;
+                uint8_t branch;
+                uint8_t rel;
+                if (!PeekCode(cpu, next, &branch) || !PeekCode(cpu, next + 1, &rel) || (branch & 0x1F) != 0x10) {
+                        return 0;
+                }
+                uint16_t after = next + 2;
+                if ((uint16_t)(after + (int8_t)rel) != pc) {
+                        return 0;
+                }
+
+                uint8_t data;
+                ticks = BusTicksUntilChange(cpu->bus, addr, &data);
+                if (0 == ticks) {
+                        return 0;
+                }
+
+                // Loading data must leave the cpu in the loop.
+                bool isBit = 0x24 == opcode || 0x2C == opcode;
+                uint8_t flagZ = isBit ? cpu->a & data : data;
+                uint8_t flagV = isBit ? data & V : cpu->flagV;
+                bool isTaken = false;
+                switch (branch) {
+                        case 0x10: isTaken = 0 == (data & N); break;
+                        case 0x30: isTaken = 0 != (data & N); break;
+                        case 0x50: isTaken = 0 == flagV; break;
+                        case 0x70: isTaken = 0 != flagV; break;
+                        case 0x90: isTaken = 0 == cpu->flagC; break;
+                        case 0xB0: isTaken = 0 != cpu->flagC; break;
+                        case 0xD0: isTaken = 0 != flagZ; break;
+                        case 0xF0: isTaken = 0 == flagZ; break;
+                }
+                cycles = instructionMap[opcode].cycles + instructionMap[branch].cycles + 1;
+                if ((pc & 0xFF00) != (after & 0xFF00)) {
+                        cycles++;
+                }
+                if (!isTaken || cycleBudget < cycles) {
+                        return 0;
+                }
+
+                // Every skipped iteration reads the same data.
+                ApplyPollingLoad(cpu, opcode, data);
+                instructions = 2;
+        } else {
+                return 0;
+        }
+
+        // The load of the k-th skipped iteration reads 3 * k * cycles ticks
+        // after the current cpu cycle.
+        uint32_t iterations = cycleBudget / cycles;
+        if (UINT32_MAX != ticks && (ticks - 1) / (3 * cycles) + 1 < iterations) {
+                iterations = (ticks - 1) / (3 * cycles) + 1;
+        }
+
+        uint32_t skipped = iterations * cycles;
+        cpu->tickCount += skipped;
+        cpu->instructionCount += (uint64_t)iterations * instructions;
+        cpu->idleCyclesSkipped += skipped;
+
+        return skipped;
+}
+
+
 //-- Debug Structures ----------------------------------------------------------
 
 
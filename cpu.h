@@ -4,7 +4,7 @@
 
   File: cpu.h
   Created: 2019-10-16
-  Updated: 2019-11-27
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -15,6 +15,7 @@
  ******************************************************************************/
 //! \file cpu.h
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifndef CPU_VERSION
 #define CPU_VERSION "0.1.0"
@@ -22,6 +23,81 @@
 struct cpu;
 struct bus;
 
+//! \brief Interpreter cores available to CpuTick
+enum cpu_core {
+        CPU_CORE_FUSED, //!< One switch case per opcode; addressing and operation fused
+        CPU_CORE_TABLE, //!< Reference core; dispatches through instructionMap
+        CPU_CORE_BLOCK, //!< Fused core, running whole basic blocks of prg code at a time in CpuRun
+        CPU_CORE_JIT, //!< Block core, compiling blocks to x86-64 code where available
+};
+
+//! \brief Snapshot of programmer-visible cpu state
+struct cpu_state {
+        uint8_t a;
+        uint8_t x;
+        uint8_t y;
+        uint8_t sp;
+        uint16_t pc;
+        uint8_t status;
+        uint8_t cycles; //!< Cycles remaining for the current instruction
+};
+
+//! \brief Pairs of instructions the fused core runs as one superinstruction
+enum cpu_pair {
+        CPU_PAIR_NONE,
+        CPU_PAIR_DEX_BNE,
+        CPU_PAIR_DEY_BNE,
+        CPU_PAIR_LDA_STA, //!< LDA immediate, zero page or absolute; then STA zero page or absolute
+        CPU_PAIR_INC_BRANCH, //!< INC zero page; then BPL, BMI, BNE or BEQ
+        CPU_PAIR_CMP_BRANCH, //!< CMP immediate or zero page; then a branch on N, Z or C
+        CPU_PAIR_COUNT,
+};
+
+//! \brief Counters for the fused core's decoded instruction cache
+struct cpu_decode_stats {
+        uint64_t hits; //!< Instructions run straight from the cache
+        uint64_t misses; //!< Instructions decoded and added to the cache
+        uint64_t uncached; //!< Instructions decoded from memory the cache can't track, such as RAM
+        uint64_t translated; //!< Instructions run from a translation; see CpuSetTranslation
+        uint64_t pairs[CPU_PAIR_COUNT]; //!< Superinstructions run by CpuRun, indexed by enum cpu_pair
+};
+
+//! \brief Basic block of prg code translated to C ahead of time
+//!
+//! Translated blocks may only access internal RAM and prg memory, so that
+//! nothing else can observe the cpu mid-block.
+struct cpu_translated_block {
+        //! Run the whole block, leaving pc at the next instruction
+        //! \return cpu cycles taken by the block
+        uint32_t (*run)(struct cpu_state *state, uint8_t *ram);
+        uint16_t count; //!< Instructions in the block
+        uint16_t maxCycles; //!< Most cycles the block can take
+};
+
+//! \brief Addressing modes, as decoded by the cpu cores
+enum cpu_address_mode {
+        CPU_MODE_IMP,
+        CPU_MODE_IMM,
+        CPU_MODE_ZP0,
+        CPU_MODE_ZPX,
+        CPU_MODE_ZPY,
+        CPU_MODE_REL,
+        CPU_MODE_ABS,
+        CPU_MODE_ABX,
+        CPU_MODE_ABY,
+        CPU_MODE_IND,
+        CPU_MODE_IZX,
+        CPU_MODE_IZY,
+};
+
+//! \brief How the cpu cores decode an opcode
+struct cpu_opcode_info {
+        const char *name; //!< Mnemonic, or "???" for illegal opcodes
+        enum cpu_address_mode mode;
+        uint8_t length; //!< Bytes including the opcode
+        uint8_t cycles; //!< Base cycle count
+};
+
 struct cpu *
 CpuInit();
 
@@ -40,9 +116,138 @@ CpuTick(struct cpu *cpu);
 int
 CpuIsComplete(struct cpu *cpu);
 
+//! \brief Run whole instructions for up to cycleBudget cpu cycles
+//!
+//! The result is the same as calling CpuTick cycleBudget times, but the cpu
+//! only does work at instruction boundaries.  The instruction which crosses the
+//! end of the budget is started, and its remaining cycles are left for the next
+//! call to CpuRun or CpuTick.
+//!
+//! Returns early if CpuYield is called while an instruction is executing.
+//!
+//! \param[in,out] cpu
+//! \param[in] cycleBudget maximum number of cpu cycles to run
+//! \return number of cpu cycles actually run
+uint32_t
+CpuRun(struct cpu *cpu, uint32_t cycleBudget);
+
+//! \brief Finish the instruction in flight, then run one basic block
+//!
+//! Runs a single instruction if there's no block at pc.  Meant for comparing
+//! the block core against the others; CpuRun uses blocks itself when the block
+//! core is selected.
+//!
+//! \param[in,out] cpu
+//! \return number of cpu cycles run, leaving the cpu at an instruction boundary
+uint32_t
+CpuRunBlock(struct cpu *cpu);
+
+//! \brief Make CpuRun return once the current instruction has been issued
+//!
+//! \param[in,out] cpu
+void
+CpuYield(struct cpu *cpu);
+
+//! \brief Number of cpu cycles elapsed, including those inside CpuRun
+//!
+//! \param[in] cpu
+//! \return cycle count
+uint32_t
+CpuTickCount(struct cpu *cpu);
+
 void
 CpuNmi(struct cpu *cpu);
 
+//! \brief Select the interpreter core used by subsequent calls to CpuTick
+//!
+//! The switch takes effect at the next instruction boundary.
+//!
+//! \param[in,out] cpu
+//! \param[in] core
+void
+CpuSetCore(struct cpu *cpu, enum cpu_core core);
+
+enum cpu_core
+CpuGetCore(struct cpu *cpu);
+
+//! \brief Number of instructions started since CpuInit
+//!
+//! \param[in] cpu
+//! \return instruction count
+uint64_t
+CpuInstructionCount(struct cpu *cpu);
+
+//! \brief Copy the programmer-visible cpu state into state
+//!
+//! \param[in] cpu
+//! \param[out] state
+void
+CpuGetState(struct cpu *cpu, struct cpu_state *state);
+
+//! \brief Copy the fused core's decode cache counters into stats
+//!
+//! \param[in] cpu
+//! \param[out] stats
+void
+CpuGetDecodeStats(struct cpu *cpu, struct cpu_decode_stats *stats);
+
+//! \brief Name of a superinstruction, such as "DEX/BNE"
+//!
+//! \param[in] pair
+//! \return static string
+const char *
+CpuPairName(enum cpu_pair pair);
+
+//! \brief Let CpuRun skip iterations of loops which only poll memory
+//!
+//! Loops like `JMP *` or `LDA $2002; BPL` are skipped ahead a whole number of
+//! iterations for as long as the bus can tell the polled value won't change,
+//! with the same result as running them.  Enabled by default.
+//!
+//! \param[in,out] cpu
+//! \param[in] isEnabled
+void
+CpuSetIdleSkip(struct cpu *cpu, bool isEnabled);
+
+//! \brief Number of cpu cycles CpuRun has skipped in idle loops
+//!
+//! \param[in] cpu
+//! \return cycle count
+uint64_t
+CpuIdleCyclesSkipped(struct cpu *cpu);
+
+//! \brief Forget any decoded instructions overlapping a write to code memory
+//!
+//! The cache notices pages being remapped by itself, but memory that's written
+//! in place must be invalidated explicitly.  Every mirror of the written page
+//! is invalidated, assuming the write lands in the same memory a read of addr
+//! would.
+//!
+//! \param[in,out] cpu
+//! \param[in] addr cpu address that was written
+void
+CpuInvalidateDecodeCache(struct cpu *cpu, uint16_t addr);
+
+//! \brief Run translated blocks of prg code from CpuRun wherever possible
+//!
+//! Blocks are looked up by pc and only run when they fit in the remaining
+//! budget; any other instruction is run by the selected core.  The translation
+//! is dropped as soon as anything writes to prg memory.  Must be called after
+//! CpuConnectBus.
+//!
+//! \param[in,out] cpu
+//! \param[in] blocks one entry per address from $8000, with run set to NULL
+//! where there's no block; or NULL to stop using the translation
+void
+CpuSetTranslation(struct cpu *cpu, const struct cpu_translated_block *blocks);
+
+//! \brief Describe how an opcode is decoded
+//!
+//! \param[in] opcode
+//! \param[out] info
+void
+CpuGetOpcodeInfo(uint8_t opcode, struct cpu_opcode_info *info);
+
 //-- Debug ---------------------------------------------------------------------
 
 char **
@@ -4,7 +4,7 @@
 
   File: main.c
   Created: 2019-10-31
-  Updated: 2019-12-06
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -16,7 +16,7 @@
 //! \file main.c
 #include <time.h> // struct timespec, clock_gettime
 #include <stdlib.h> // strtoul, exit
-#include <string.h> // strlen
+#include <string.h> // strlen, strcmp, strncmp
 #include <stdio.h> // printf
 
 #include "bus.h"
@@ -26,6 +26,7 @@
 #include "graphics.h"
 #include "input.h"
 #include "ppu.h"
+#include "timeline.h"
 #include "util.h"
 
 static const int FONT_HEADER_SCALE = 20;
@@ -36,6 +37,7 @@ static const int NES_SCREEN_HEIGHT = 240 * 3;
 static const int WIDTH = NES_SCREEN_WIDTH + 250;
 static const int HEIGHT = NES_SCREEN_HEIGHT;
 static const int SWATCH_SIZE = 5;
+static const uint32_t TIMELINE_CAPACITY = 1 << 20; // Accesses to the ppu recorded
 
 static struct cpu *cpu = NULL;
 static struct ppu *ppu = NULL;
@@ -44,6 +46,8 @@ static struct input *input = NULL;
 static struct graphics *graphics = NULL;
 static struct cart *cart = NULL;
 static char *font_buffer = NULL;
+static struct timeline *timeline = NULL;
+static char *timelineFile = NULL; // Where to save the timeline on exit
 
 void Deinit(int code) {
         if (NULL != font_buffer)
@@ -52,6 +56,8 @@ void Deinit(int code) {
                 GraphicsDeinit(graphics);
         if (NULL != input)
                 InputDeinit(input);
+        if (NULL != bus)
+                BusSetPpuThread(bus, false); // Before the ppu goes
         if (NULL != ppu)
                 PpuDeinit(ppu);
         if (NULL != bus)
@@ -60,6 +66,11 @@ void Deinit(int code) {
                 CpuDeinit(cpu);
         if (NULL != cart)
                 CartDeinit(cart);
+        if (NULL != timeline) {
+                if (NULL != timelineFile && !TimelineSave(timeline, timelineFile))
+                        fprintf(stderr, "Couldn't save timeline: %s\n", timelineFile);
+                TimelineDeinit(timeline);
+        }
 
         exit(code);
 }
@@ -172,6 +183,87 @@ void DrawDisassembly(struct disassembly *disassembly, int x, int y, int numLines
 int main(int argc, char **argv) {
         Init();
 
+        int frameSkip = 1; // Frames emulated for each one shown
+
+        for (int i = 1; i < argc; i++) {
+                if (0 == strcmp(argv[i], "--no-idle-skip")) {
+                        CpuSetIdleSkip(cpu, false);
+                        continue;
+                }
+
+                if (0 == strcmp(argv[i], "--dot-renderer")) {
+                        PpuSetScanlineRenderer(ppu, false);
+                        continue;
+                }
+
+                if (0 == strcmp(argv[i], "--no-sprite-limit")) {
+                        PpuSetSpriteLimit(ppu, false);
+                        continue;
+                }
+
+                if (0 == strncmp(argv[i], "--frame-skip=", 13)) {
+                        frameSkip = (int)strtoul(argv[i] + 13, NULL, 10);
+                        if (frameSkip < 1) {
+                                fprintf(stderr, "Frame skip must be at least 1\n");
+                                Deinit(1);
+                        }
+                        continue;
+                }
+
+                if (0 == strncmp(argv[i], "--timeline=", 11)) {
+                        timelineFile = argv[i] + 11;
+                        continue;
+                }
+
+                if (0 == strcmp(argv[i], "--ppu-thread")) {
+                        if (!BusSetPpuThread(bus, true)) {
+                                fprintf(stderr, "Couldn't start the ppu's thread\n");
+                                Deinit(1);
+                        }
+                        continue;
+                }
+
+                if (0 == strcmp(argv[i], "--indexed")) {
+                        PpuSetIndexedOutput(ppu, true);
+                        continue;
+                }
+
+                if (0 == strncmp(argv[i], "--palette=", 10)) {
+                        if (!PpuLoadPalette(ppu, argv[i] + 10)) {
+                                fprintf(stderr, "Couldn't load palette: %s\n", argv[i] + 10);
+                                Deinit(1);
+                        }
+                        continue;
+                }
+
+                if (0 != strncmp(argv[i], "--cpu=", 6)) {
+                        continue;
+                }
+
+                char *name = argv[i] + 6;
+                if (0 == strcmp(name, "table")) {
+                        CpuSetCore(cpu, CPU_CORE_TABLE);
+                } else if (0 == strcmp(name, "fused")) {
+                        CpuSetCore(cpu, CPU_CORE_FUSED);
+                } else if (0 == strcmp(name, "block")) {
+                        CpuSetCore(cpu, CPU_CORE_BLOCK);
+                } else if (0 == strcmp(name, "jit")) {
+                        CpuSetCore(cpu, CPU_CORE_JIT);
+                } else {
+                        fprintf(stderr, "Unknown cpu core: %s\n", name);
+                        Deinit(1);
+                }
+        }
+
+        if (NULL != timelineFile) {
+                timeline = TimelineInit(TIMELINE_CAPACITY);
+                if (NULL == timeline) {
+                        fprintf(stderr, "Couldn't allocate timeline\n");
+                        Deinit(1);
+                }
+                PpuSetTimeline(ppu, timeline);
+        }
+
         CpuConnectBus(cpu, bus);
         BusAttachCart(bus, cart);
 
@@ -186,8 +278,11 @@ int main(int argc, char **argv) {
 
         double residualTime = 0.0;
         int isEmulating = 1;
+        int isReferenceClock = 0; // Tick the whole system once per ppu dot
         int isRunning = 1;
         int selectedPalette = 0;
+        int isNameTableViewShown = 0;
+        int isWriteOverlayShown = 0;
         while (isRunning) {
                 clock_gettime(CLOCK_REALTIME, &frameEnd);
                 double elapsedTime = S_AS_MS(frameEnd.tv_sec - frameStart.tv_sec);
@@ -212,6 +307,27 @@ int main(int argc, char **argv) {
 
                 if (InputGetKey(input, KEY_SPACE).pressed) isEmulating = !isEmulating;
                 if (InputGetKey(input, KEY_R).pressed) BusReset(bus);
+                if (InputGetKey(input, KEY_T).pressed) isReferenceClock = !isReferenceClock;
+                if (InputGetKey(input, KEY_N).pressed) isNameTableViewShown = !isNameTableViewShown;
+                if (InputGetKey(input, KEY_W).pressed) {
+                        isWriteOverlayShown = !isWriteOverlayShown;
+
+                        // The overlay records a timeline while it's shown,
+                        // unless --timeline is recording one anyway.
+                        if (NULL == timelineFile) {
+                                if (isWriteOverlayShown) {
+                                        timeline = TimelineInit(TIMELINE_CAPACITY);
+                                        if (NULL == timeline) {
+                                                fprintf(stderr, "Couldn't allocate timeline\n");
+                                                isWriteOverlayShown = false;
+                                        }
+                                } else {
+                                        TimelineDeinit(timeline);
+                                        timeline = NULL;
+                                }
+                                PpuSetTimeline(ppu, timeline);
+                        }
+                }
                 if (InputGetKey(input, KEY_P).pressed) {
                         ++selectedPalette;
                         selectedPalette &= 0x07;
@@ -222,8 +338,17 @@ int main(int argc, char **argv) {
                                 residualTime -= elapsedTime;
                         } else {
                                 residualTime += (1.0 / 60.0) - elapsedTime;
-                                do { BusTick(bus); } while (!PpuIsFrameComplete(ppu));
-                                PpuResetFrameCompletion(ppu);
+
+                                // Only the last of the frames is shown.
+                                for (int frame = 1; frame <= frameSkip; frame++) {
+                                        PpuSetOutput(ppu, frame == frameSkip);
+                                        if (isReferenceClock) {
+                                                do { BusTick(bus); } while (!PpuIsFrameComplete(ppu));
+                                        } else {
+                                                BusRunFrame(bus);
+                                        }
+                                        PpuResetFrameCompletion(ppu);
+                                }
                         }
                 } else {
                         // Emulate code step-by-step.
@@ -258,12 +383,12 @@ int main(int argc, char **argv) {
                 DrawDisassembly(disassembly, NES_SCREEN_WIDTH + 10, HEIGHT - 160 - (FONT_HEADER_SCALE + 5), 20);
 
                 // Iterate through each palette.
+                const uint32_t *colors = PpuGetPaletteColors(ppu);
                 for (int p = 0; p < 8; p++)
                         for (int s = 0; s < 4; s++) {
-                                struct color *color = PpuGetColorFromPaletteRam(ppu, p, s);
                                 int x = NES_SCREEN_WIDTH + 1 + (p * 5 * (SWATCH_SIZE + 1)) + (s * (SWATCH_SIZE + 1));
                                 int y = NES_SCREEN_HEIGHT - 590;
-                                GraphicsDrawFilledRect(graphics, x, y, SWATCH_SIZE, SWATCH_SIZE, color->rgba);
+                                GraphicsDrawFilledRect(graphics, x, y, SWATCH_SIZE, SWATCH_SIZE, colors[(p << 2) + s]);
                         }
 
                 // Draw selection reticule around selected palette.
@@ -275,6 +400,25 @@ int main(int argc, char **argv) {
 
                 GraphicsDrawSprite(graphics, 0, 0, PpuScreen(ppu), 3);
 
+                // Mark the lines of the last frame that had ppu writes while
+                // they were drawn.
+                if (isWriteOverlayShown) {
+                        bool lines[240];
+                        if (PpuFrameCount(ppu) > 0) {
+                                TimelineFindMidScanlineWrites(timeline, PpuFrameCount(ppu) - 1, lines);
+                                for (int line = 0; line < 240; line++) {
+                                        if (lines[line]) {
+                                                GraphicsDrawFilledRect(graphics, 0, line * 3, 12, 3, ColorRed.rgba);
+                                        }
+                                }
+                        }
+                }
+
+                // Draw the nametables over the screen.
+                if (isNameTableViewShown) {
+                        GraphicsDrawSprite(graphics, 0, 0, PpuGetNameTables(ppu), 1);
+                }
+
                 GraphicsEnd(graphics);
         }
 
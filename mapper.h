@@ -4,7 +4,7 @@
 
   File: mapper.h
   Created: 2019-11-04
-  Updated: 2019-11-27
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -15,7 +15,7 @@
  ******************************************************************************/
 //! \file mapper.h
 //! This file describes the `mapper` interface.
-//! There are seven function pointers defined that must be provided by any
+//! There are eight function pointers defined that must be provided by any
 //! concrete implementation of this interface.
 #include <stdint.h>
 
@@ -38,11 +38,25 @@ typedef void (*mapper_reset_fn)(void *interface);
 typedef bool (*map_cpu_read_fn)(void *interface, uint16_t addr, uint32_t *mappedAddr);
 
 //! \brief CPU write intercept
+//!
+//! Writes to mapper registers should return false; they're passed on to the
+//! register write intercept instead.
+//!
 //! \param[in,out] interface the mapper
 //! \param[in] addr 16-bit address to read
 //! \param[out] mappedAddr the translated address
 typedef bool (*map_cpu_write_fn)(void *interface, uint16_t addr, uint32_t *mappedAddr);
 
+//! \brief CPU write to a mapper register
+//!
+//! Called with each write to cartridge space the cpu write intercept didn't map.
+//!
+//! \param[in,out] interface the mapper
+//! \param[in] addr 16-bit address written
+//! \param[in] data
+//! \return true if the write switched banks or changed mirroring
+typedef bool (*map_cpu_register_fn)(void *interface, uint16_t addr, uint8_t data);
+
 //! \brief PPU read intercept
 //! \param[in,out] interface the mapper
 //! \param[in] addr 16-bit address to read
@@ -4,7 +4,7 @@
 
   File: mapper000.c
   Created: 2019-11-04
-  Updated: 2019-12-02
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -75,6 +75,10 @@ bool Mapper000_MapCpuWrite(void *interface, uint16_t addr, uint32_t *mappedAddr)
         return false;
 }
 
+bool Mapper000_WriteRegister(void *interface, uint16_t addr, uint8_t data) {
+        return false;
+}
+
 bool Mapper000_MapPpuRead(void *interface, uint16_t addr, uint32_t *mappedAddr) {
         if (addr >= 0x0000 && addr <= 0x1FFF) {
                 *mappedAddr = addr;
@@ -4,7 +4,7 @@
 
   File: mapper000.h
   Created: 2019-11-04
-  Updated: 2019-11-27
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -72,6 +72,17 @@ Mapper000_MapCpuRead(void *mapper, uint16_t addr, uint32_t *mappedAddr);
 bool
 Mapper000_MapCpuWrite(void *mapper, uint16_t addr, uint32_t *mappedAddr);
 
+//! \brief Write to a mapper register
+//!
+//! Mapper000 has no registers, so banks and mirroring never change.
+//!
+//! \param[in,out] mapper
+//! \param[in] addr Address written
+//! \param[in] data
+//! \return false
+bool
+Mapper000_WriteRegister(void *mapper, uint16_t addr, uint8_t data);
+
 //! \brief Map ppu read address to expanded address
 //!
 //! \see Mapper000_MapPpuWrite
@@ -0,0 +1,214 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: pipeline.c
+  Created: 2019-12-17
+  Updated: 2019-12-17
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file pipeline.c
+#include <stdlib.h> // calloc, free
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h> // sched_yield
+
+#include "pipeline.h"
+#include "ppu.h"
+
+#define QUEUE_SIZE 4096 //!< Commands in flight; a power of two
+#define IDLE_SPINS 64 //!< Times the ppu's thread looks for work before sleeping
+
+enum command_kind {
+        COMMAND_START,
+        COMMAND_WRITE,
+        COMMAND_RECORD_OAM_DMA,
+        COMMAND_WRITE_OAM,
+        COMMAND_SYNC,
+        COMMAND_STOP,
+};
+
+struct command {
+        uint64_t ticks; //!< Ticks the ppu runs before the command
+        uint16_t addr;
+        uint8_t data;
+        uint8_t kind; //!< enum command_kind
+};
+
+struct pipeline {
+        struct ppu *ppu;
+        uint64_t ticks; //!< Ticks the ppu has run; only the ppu's thread uses it
+        struct command queue[QUEUE_SIZE];
+
+        // The cpu's thread only advances head, and the ppu's thread only
+        // advances tail, once a command is done.
+        _Atomic uint32_t head;
+        _Atomic uint32_t tail;
+
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t wake;
+        atomic_bool isSleeping;
+};
+
+//! \brief Tick the ppu until it has run the given number of ticks
+static void CatchUp(struct pipeline *pipeline, uint64_t until) {
+        while (pipeline->ticks < until) {
+                // As in the bus, nothing touches the ppu before until.
+                if (until - pipeline->ticks >= 256) {
+                        uint32_t ticks = PpuTickScanline(pipeline->ppu);
+                        if (ticks > 0) {
+                                pipeline->ticks += ticks;
+                                continue;
+                        }
+                }
+
+                // The bus predicts nmis itself.
+                PpuTick(pipeline->ppu);
+                PpuSetNmi(pipeline->ppu, false);
+                pipeline->ticks++;
+        }
+}
+
+//! \brief Wait for the cpu's thread to push a command
+//!
+//! \return the index of the command
+static uint32_t Wait(struct pipeline *pipeline, uint32_t tail) {
+        for (int spins = 0; tail == atomic_load_explicit(&pipeline->head, memory_order_acquire); spins++) {
+                if (spins < IDLE_SPINS) {
+                        sched_yield();
+                        continue;
+                }
+
+                // Push checks isSleeping after advancing head, so one of the
+                // two sees the other.
+                pthread_mutex_lock(&pipeline->mutex);
+                atomic_store(&pipeline->isSleeping, true);
+                while (tail == atomic_load(&pipeline->head)) {
+                        pthread_cond_wait(&pipeline->wake, &pipeline->mutex);
+                }
+                atomic_store(&pipeline->isSleeping, false);
+                pthread_mutex_unlock(&pipeline->mutex);
+        }
+        return tail;
+}
+
+static void *Run(void *data) {
+        struct pipeline *pipeline = (struct pipeline *)data;
+
+        for (uint32_t tail = 0;; tail++) {
+                struct command command = pipeline->queue[Wait(pipeline, tail) & (QUEUE_SIZE - 1)];
+
+                if (COMMAND_START == command.kind) {
+                        pipeline->ticks = command.ticks;
+                } else {
+                        CatchUp(pipeline, command.ticks);
+                }
+
+                switch (command.kind) {
+                        case COMMAND_WRITE:
+                                PpuWriteViaCpu(pipeline->ppu, command.addr, command.data);
+                                break;
+
+                        case COMMAND_RECORD_OAM_DMA:
+                                PpuRecordOamDma(pipeline->ppu, command.data);
+                                break;
+
+                        case COMMAND_WRITE_OAM:
+                                PpuWriteOamViaDma(pipeline->ppu, command.addr, command.data);
+                                break;
+                }
+
+                atomic_store_explicit(&pipeline->tail, tail + 1, memory_order_release);
+
+                if (COMMAND_STOP == command.kind) {
+                        return NULL;
+                }
+        }
+}
+
+//! \brief Queue a command for the ppu's thread, waiting for room if need be
+static void Push(struct pipeline *pipeline, enum command_kind kind, uint64_t ticks, uint16_t addr, uint8_t data) {
+        uint32_t head = atomic_load_explicit(&pipeline->head, memory_order_relaxed);
+        while (head - atomic_load_explicit(&pipeline->tail, memory_order_acquire) >= QUEUE_SIZE) {
+                sched_yield();
+        }
+
+        struct command command = { ticks, addr, data, kind };
+        pipeline->queue[head & (QUEUE_SIZE - 1)] = command;
+        atomic_store(&pipeline->head, head + 1);
+
+        if (atomic_load(&pipeline->isSleeping)) {
+                pthread_mutex_lock(&pipeline->mutex);
+                pthread_cond_signal(&pipeline->wake);
+                pthread_mutex_unlock(&pipeline->mutex);
+        }
+}
+
+struct pipeline *PipelineInit(struct ppu *ppu) {
+        struct pipeline *pipeline = (struct pipeline *)calloc(1, sizeof(struct pipeline));
+        if (NULL == pipeline) {
+                return NULL;
+        }
+
+        pipeline->ppu = ppu;
+        atomic_init(&pipeline->head, 0);
+        atomic_init(&pipeline->tail, 0);
+        atomic_init(&pipeline->isSleeping, false);
+        pthread_mutex_init(&pipeline->mutex, NULL);
+        pthread_cond_init(&pipeline->wake, NULL);
+
+        if (0 != pthread_create(&pipeline->thread, NULL, Run, pipeline)) {
+                pthread_cond_destroy(&pipeline->wake);
+                pthread_mutex_destroy(&pipeline->mutex);
+                free(pipeline);
+                return NULL;
+        }
+
+        return pipeline;
+}
+
+void PipelineDeinit(struct pipeline *pipeline) {
+        if (NULL == pipeline) {
+                return;
+        }
+
+        // Stopping doesn't tick the ppu any further.
+        Push(pipeline, COMMAND_STOP, 0, 0, 0);
+        pthread_join(pipeline->thread, NULL);
+
+        pthread_cond_destroy(&pipeline->wake);
+        pthread_mutex_destroy(&pipeline->mutex);
+        free(pipeline);
+}
+
+void PipelineStart(struct pipeline *pipeline, uint64_t ticks) {
+        Push(pipeline, COMMAND_START, ticks, 0, 0);
+}
+
+void PipelineWrite(struct pipeline *pipeline, uint64_t ticks, uint16_t addr, uint8_t data) {
+        Push(pipeline, COMMAND_WRITE, ticks, addr, data);
+}
+
+void PipelineRecordOamDma(struct pipeline *pipeline, uint64_t ticks, uint8_t page) {
+        Push(pipeline, COMMAND_RECORD_OAM_DMA, ticks, 0, page);
+}
+
+void PipelineWriteOam(struct pipeline *pipeline, uint64_t ticks, uint8_t addr, uint8_t data) {
+        Push(pipeline, COMMAND_WRITE_OAM, ticks, addr, data);
+}
+
+void PipelineSync(struct pipeline *pipeline, uint64_t ticks) {
+        Push(pipeline, COMMAND_SYNC, ticks, 0, 0);
+
+        uint32_t head = atomic_load_explicit(&pipeline->head, memory_order_relaxed);
+        while (head != atomic_load_explicit(&pipeline->tail, memory_order_acquire)) {
+                sched_yield();
+        }
+}
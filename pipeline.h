@@ -0,0 +1,82 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: pipeline.h
+  Created: 2019-12-17
+  Updated: 2019-12-17
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file pipeline.h
+//! Runs the ppu on its own thread, behind the cpu.
+//!
+//! The cpu's thread pushes its writes to the ppu, each stamped with how many
+//! ticks the ppu must have run before it, into a lock-free queue with a single
+//! producer and a single consumer.  The ppu's thread ticks the ppu up to each
+//! write in turn, then makes it.  The cpu's thread only waits for the ppu when
+//! it needs something from it; see PipelineSync.  See BusSetPpuThread.
+#ifndef PIPELINE_VERSION
+#define PIPELINE_VERSION "0.1.0"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct pipeline;
+struct ppu;
+
+//! \brief Start a thread to run the ppu
+//!
+//! The thread waits for PipelineStart before touching the ppu.
+//!
+//! \param[in] ppu
+//! \return the pipeline, or NULL if the thread couldn't be started
+struct pipeline *
+PipelineInit(struct ppu *ppu);
+
+//! \brief Stop the thread, once it has made every write pushed
+void
+PipelineDeinit(struct pipeline *pipeline);
+
+//! \brief Tell the thread how many ticks the ppu has run
+//!
+//! Only call this while the thread is idle: before any other push, or after
+//! PipelineSync.  The ppu belongs to the thread until the next PipelineSync.
+//!
+//! \param[in,out] pipeline
+//! \param[in] ticks
+void
+PipelineStart(struct pipeline *pipeline, uint64_t ticks);
+
+//! \brief Push a write to a ppu register, as PpuWriteViaCpu
+//!
+//! \param[in,out] pipeline
+//! \param[in] ticks the ppu runs before the write
+//! \param[in] addr register, 0 to 7
+//! \param[in] data
+void
+PipelineWrite(struct pipeline *pipeline, uint64_t ticks, uint16_t addr, uint8_t data);
+
+//! \brief Push a write to $4014, as PpuRecordOamDma
+void
+PipelineRecordOamDma(struct pipeline *pipeline, uint64_t ticks, uint8_t page);
+
+//! \brief Push a byte of OAM DMA, as PpuWriteOamViaDma
+void
+PipelineWriteOam(struct pipeline *pipeline, uint64_t ticks, uint8_t addr, uint8_t data);
+
+//! \brief Wait for the ppu to run to the given tick and make every write pushed
+//!
+//! The ppu belongs to the caller until the next push.
+//!
+//! \param[in,out] pipeline
+//! \param[in] ticks
+void
+PipelineSync(struct pipeline *pipeline, uint64_t ticks);
+
+#endif // PIPELINE_VERSION
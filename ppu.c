@@ -4,7 +4,7 @@
 
   File: ppu.c
   Created: 2019-11-03
-  Updated: 2019-12-07
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -22,14 +22,27 @@
 #include "ppu.h"
 #include "cart.h"
 #include "color.h"
+#include "compose.h"
 #include "sprite.h"
+#include "timeline.h"
 #include "util.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 //! CHR_ROM starts at 0x1000 == 4096 == 4K
 static const int CHR_ROM = 0x1000;
 static const int NAME_TABLE_SIZE = 1024;
 static const int PATTERN_TABLE_SIZE = 4096;
 
+// Scanlines run from -1 through 261 and cycles from 0 through 341.  The tick
+// that begins on scanline 0, cycle 0 renders cycle 1 instead, so one dot per
+// frame is skipped.
+static const int32_t DOTS_PER_FRAME = 263 * 342 - 1;
+
+#define SPRITE_LINE_EXTRA 0x80 //!< spriteLine pixel is from a sprite past the eighth
+
 union loopy_register {
         struct {
                 uint16_t coarseX : 5;
@@ -46,18 +59,52 @@ struct ppu {
         struct cart *cart;
 
         bool isFrameComplete;
+        uint32_t frameCount; //!< Frames completed
+        struct timeline *timeline; //!< See PpuSetTimeline
         int16_t scanline; //!< Which row on the screen we are computing.
         int16_t cycle; //!< Which column on the screen we are computing.
 
         uint8_t **nameTables; //[2][1024];
+        uint8_t *nameTableMap[4]; //!< Memory of each nametable; see PpuUpdateMirroring
         uint8_t **patternTables; //[2][4096];
         uint8_t *paletteTables; //[32];
 
-        struct color *palette; //[0x40];
+        struct color *palette; //[COLOR_EMPHASIS_COUNT][COLOR_PALETTE_SIZE]
+
+        // Palette memory resolved to colors through palette and mask, rebuilt
+        // by PaletteColors when dirty.
+        uint32_t paletteColors[32];
+        uint32_t paletteIndices[32]; //!< Palette memory as indices into palette
+        bool isPaletteDirty;
+        uint32_t paletteGeneration; //!< Counts rebuilds of paletteColors
         struct sprite *screen;
-        struct sprite **nameTableSprites;
+        uint16_t *indexedScreen; //!< See PpuSetIndexedOutput
+        bool isIndexedOutputEnabled;
+        bool isOutputEnabled; //!< See PpuSetOutput
+        struct sprite *nameTableView; //!< See PpuGetNameTables
         struct sprite **patternTableSprites;
 
+        // What each pattern table view was last drawn from; see
+        // PpuGetPatternTable.
+        bool isPatternTileDirty[2][256];
+        const uint8_t *patternTableBanks[2][4]; //!< Decoded chr of each 1 KB
+
+        // What the nametable view was last drawn from.
+        bool isNameTableCellDirty[4][960];
+        uint8_t *nameTableViewMap[4];
+        const uint8_t *nameTableViewBanks[4];
+        uint32_t nameTableViewGeneration;
+        uint8_t nameTableViewPattern; //!< control.patternBackground drawn with
+        bool isNameTableViewStale; //!< Every cell needs redrawing
+        bool isNameTableTileDirty[256]; //!< Background tiles written since the view was drawn
+        bool isAnyNameTableTileDirty;
+        union loopy_register viewScroll; //!< vramAddr at the start of the frame
+        uint8_t viewFineX;
+        union loopy_register viewRectScroll; //!< viewScroll last outlined
+        uint8_t viewRectFineX;
+        uint32_t patternTableGeneration[2]; //!< paletteGeneration drawn with
+        uint8_t patternTablePalette[2];
+
         union {
                 struct {
                         uint8_t grayscale : 1;
@@ -105,11 +152,25 @@ struct ppu {
         } oam[64];
         uint8_t oamAddr;
 
+        // OAM again, one array per field, for evaluating all the sprites at
+        // once; see PpuWriteOam.
+        uint8_t oamY[64];
+        uint8_t oamId[64];
+        uint8_t oamAttribute[64];
+        uint8_t oamX[64];
+
         uint8_t spriteCount;
         struct oam_entry scanlineSprites[8];
         uint8_t spriteShifterPatternLo[8]; // Low bitplanes of sprites
         uint8_t spriteShifterPatternHi[8]; // High bitplanes of sprites
 
+        //! The sprites fetched for the next scanline, rasterized as
+        //! ComposeLine takes them; see RasterizeSprites.
+        uint8_t spriteLine[256];
+        bool isSpriteLimitEnabled;
+        uint8_t extraSpriteCount; //!< Sprites past the 8th, without the limit
+        struct oam_entry extraSprites[56];
+
         union loopy_register vramAddr;
         union loopy_register tramAddr;
 
@@ -132,6 +193,8 @@ struct ppu {
 
         bool isSpriteZeroHitPossible;
         bool isSpriteZeroBeingRendered;
+
+        bool isScanlineRendererEnabled; //!< See PpuTickScanline
 };
 
 struct ppu *PpuInit() {
@@ -146,7 +209,13 @@ struct ppu *PpuInit() {
                 return NULL;
         }
 
-        uint8_t *nameTables = (uint8_t *)malloc(2 * NAME_TABLE_SIZE);
+        ppu->indexedScreen = (uint16_t *)calloc(256 * 240, sizeof(uint16_t));
+        if (NULL == ppu->indexedScreen) {
+                PpuDeinit(ppu);
+                return NULL;
+        }
+
+        uint8_t *nameTables = (uint8_t *)calloc(2, NAME_TABLE_SIZE);
         if (NULL == nameTables) {
                 PpuDeinit(ppu);
                 return NULL;
@@ -159,8 +228,9 @@ struct ppu *PpuInit() {
         }
         ppu->nameTables[0] = &nameTables[0];
         ppu->nameTables[1] = &nameTables[NAME_TABLE_SIZE];
+        PpuUpdateMirroring(ppu);
 
-        uint8_t *patternTables = (uint8_t *)malloc(2 * PATTERN_TABLE_SIZE);
+        uint8_t *patternTables = (uint8_t *)calloc(2, PATTERN_TABLE_SIZE);
         if (NULL == patternTables) {
                 PpuDeinit(ppu);
                 return NULL;
@@ -180,26 +250,13 @@ struct ppu *PpuInit() {
                 return NULL;
         }
 
-        ppu->nameTableSprites = (struct sprite **)calloc(2, sizeof(struct sprite *));
-        if (NULL == ppu->nameTableSprites) {
-                PpuDeinit(ppu);
-                return NULL;
-        }
-        ppu->nameTableSprites[0] = SpriteInit(256, 240);
-        if (NULL == ppu->nameTableSprites[0]) {
-                free(ppu->nameTableSprites);
-                ppu->nameTableSprites = NULL;
-                PpuDeinit(ppu);
-                return NULL;
-        }
-        ppu->nameTableSprites[1] = SpriteInit(256, 240);
-        if (NULL == ppu->nameTableSprites[1]) {
-                SpriteDeinit(ppu->nameTableSprites[0]);
-                free(ppu->nameTableSprites);
-                ppu->nameTableSprites = NULL;
+        // All four nametables, two by two.
+        ppu->nameTableView = SpriteInit(512, 480);
+        if (NULL == ppu->nameTableView) {
                 PpuDeinit(ppu);
                 return NULL;
         }
+        ppu->isNameTableViewStale = true;
 
         ppu->patternTableSprites = (struct sprite **)calloc(2, sizeof(struct sprite *));
         if (NULL == ppu->patternTableSprites) {
@@ -242,12 +299,15 @@ struct ppu *PpuInit() {
         ppu->isSpriteZeroHitPossible = false;
         ppu->isSpriteZeroBeingRendered = false;
 
-        ppu->palette = (struct color *)calloc(0x40, sizeof(struct color));
+        ppu->palette = (struct color *)calloc(COLOR_EMPHASIS_COUNT * COLOR_PALETTE_SIZE, sizeof(struct color));
         if (NULL == ppu->palette) {
                 PpuDeinit(ppu);
                 return NULL;
         }
 
+        ppu->isPaletteDirty = true;
+        memset(ppu->isPatternTileDirty, true, sizeof(ppu->isPatternTileDirty));
+
         ppu->palette[0x00] = ColorInitInts(84, 84, 84, 255);
 	ppu->palette[0x01] = ColorInitInts(0, 30, 116, 255);
 	ppu->palette[0x02] = ColorInitInts(8, 16, 144, 255);
@@ -316,6 +376,12 @@ struct ppu *PpuInit() {
 	ppu->palette[0x3E] = ColorInitInts(0, 0, 0, 255);
 	ppu->palette[0x3F] = ColorInitInts(0, 0, 0, 255);
 
+        ColorEmphasizePalette(ppu->palette);
+
+        ppu->isScanlineRendererEnabled = true;
+        ppu->isSpriteLimitEnabled = true;
+        ppu->isOutputEnabled = true;
+
         return ppu;
 }
 
@@ -334,10 +400,8 @@ void PpuDeinit(struct ppu *ppu) {
                 free(ppu->nameTables);
         }
 
-        if (NULL != ppu->nameTableSprites) {
-                SpriteDeinit(ppu->nameTableSprites[0]);
-                SpriteDeinit(ppu->nameTableSprites[1]);
-                free(ppu->nameTableSprites);
+        if (NULL != ppu->nameTableView) {
+                SpriteDeinit(ppu->nameTableView);
         }
 
         if (NULL != ppu->patternTableSprites) {
@@ -350,6 +414,10 @@ void PpuDeinit(struct ppu *ppu) {
                 SpriteDeinit(ppu->screen);
         }
 
+        if (NULL != ppu->indexedScreen) {
+                free(ppu->indexedScreen);
+        }
+
         if (NULL != ppu->paletteTables) {
                 free(ppu->paletteTables);
         }
@@ -363,6 +431,38 @@ void PpuDeinit(struct ppu *ppu) {
 
 void PpuAttachCart(struct ppu *ppu, struct cart *cart) {
         ppu->cart = cart;
+        PpuUpdateMirroring(ppu);
+}
+
+void PpuUpdateMirroring(struct ppu *ppu) {
+        uint8_t **map = ppu->nameTableMap;
+        uint8_t *lo = ppu->nameTables[0];
+        uint8_t *hi = ppu->nameTables[1];
+
+        enum mirror mirror = (NULL == ppu->cart) ? MIRROR_HORIZONTAL : CartMirroring(ppu->cart);
+        switch (mirror) {
+                case MIRROR_VERTICAL:
+                        map[0] = lo; map[1] = hi; map[2] = lo; map[3] = hi;
+                        break;
+
+                case MIRROR_ONESCREEN_LO:
+                        map[0] = lo; map[1] = lo; map[2] = lo; map[3] = lo;
+                        break;
+
+                case MIRROR_ONESCREEN_HI:
+                        map[0] = hi; map[1] = hi; map[2] = hi; map[3] = hi;
+                        break;
+
+                case MIRROR_FOUR_SCREEN: {
+                        uint8_t *cartRam = CartNameTableRam(ppu->cart);
+                        map[0] = lo; map[1] = hi; map[2] = cartRam; map[3] = &cartRam[NAME_TABLE_SIZE];
+                } break;
+
+                case MIRROR_HORIZONTAL:
+                default:
+                        map[0] = lo; map[1] = lo; map[2] = hi; map[3] = hi;
+                        break;
+        }
 }
 
 void IncrementScrollX(struct ppu *ppu) {
@@ -430,7 +530,7 @@ void LoadBackgroundShifters(struct ppu *ppu) {
         ppu->bgShifterAttribHi = (ppu->bgShifterAttribHi & 0xFF00) | ((ppu->bgNextTileAttrib & 0x02) ? 0xFF : 0x00);
 }
 
-void UpdateShifters(struct ppu *ppu) {
+void UpdateBackgroundShifters(struct ppu *ppu) {
         if (ppu->mask.renderBackground) {
                 // Every cycle the shifters storing pattern and attribute
                 // information shift their contents by 1 bit. This is because
@@ -446,7 +546,9 @@ void UpdateShifters(struct ppu *ppu) {
                 ppu->bgShifterAttribLo <<= 1;
                 ppu->bgShifterAttribHi <<= 1;
         }
+}
 
+void UpdateSpriteShifters(struct ppu *ppu) {
         // Only update sprite shifters when they are visible on screen.
         if (ppu->mask.renderSprites && ppu->cycle >= 1 && ppu->cycle < 258) {
                 for (int i = 0; i < ppu->spriteCount; i++) {
@@ -460,6 +562,543 @@ void UpdateShifters(struct ppu *ppu) {
         }
 }
 
+void UpdateShifters(struct ppu *ppu) {
+        UpdateBackgroundShifters(ppu);
+        UpdateSpriteShifters(ppu);
+}
+
+//! \brief Get palette memory as colors, resolving it first if it's changed
+//!
+//! Indexed as palette memory, by (palette << 2) + pixel.
+//!
+//! \param[in,out] ppu
+//! \return 32 rgba colors
+static const uint32_t *PaletteColors(struct ppu *ppu) {
+        if (ppu->isPaletteDirty) {
+                // The emphasis bits pick which variant of the palette to use.
+                uint16_t variant = (ppu->mask.reg >> 5) * COLOR_PALETTE_SIZE;
+
+                uint32_t colors[32];
+                for (int i = 0; i < 32; i++) {
+                        // "& 0x3F" Stops read past the bounds of the palette.
+                        ppu->paletteIndices[i] = variant + (PpuRead(ppu, 0x3F00 + i) & 0x3F);
+                        colors[i] = ppu->palette[ppu->paletteIndices[i]].rgba;
+                }
+                ppu->isPaletteDirty = false;
+
+                // The debug views only redraw when the colors really change.
+                if (0 != memcmp(colors, ppu->paletteColors, sizeof(colors))) {
+                        memcpy(ppu->paletteColors, colors, sizeof(colors));
+                        ppu->paletteGeneration++;
+                }
+        }
+        return ppu->paletteColors;
+}
+
+//! \brief Get what the ppu writes out for each entry in palette memory
+//!
+//! \param[in,out] ppu
+//! \return 32 colors, or indices when writing indexed output
+static const uint32_t *OutputColors(struct ppu *ppu) {
+        PaletteColors(ppu);
+        return ppu->isIndexedOutputEnabled ? ppu->paletteIndices : ppu->paletteColors;
+}
+
+//! \brief Fetch the background tile data for the current cycle
+//!
+//! Each tile takes eight cycles to fetch, reading its id, attribute and the
+//! two bit planes of its pattern, then moving on to the next tile.
+//!
+//! \param[in,out] ppu
+static void FetchBackgroundTile(struct ppu *ppu) {
+        switch ((ppu->cycle - 1) % 8) {
+                case 0:
+                        LoadBackgroundShifters(ppu);
+
+                        // Fetch the next background tile ID.
+                        // 0x2000: nametable address space.
+                        // 0x0FFF: Mask to 12 bits
+                        ppu->bgNextTileId = PpuRead(ppu, 0x2000 | (ppu->vramAddr.reg & 0x0FFF));
+                        // Explanation:
+                        // The bottom 12 bits of the loopy
+                        // register provide an index into the 4
+                        // nametables, regardless of nametable
+                        // mirroring configuration.
+                        // nametable_y(1) nametable_x(1)
+                        // coarse_y(5) coarse_x(5)
+                        //
+                        // Consider a single nametable is a
+                        // 32x32 array, and we have four of them:
+                        //   0                1
+                        // 0 +----------------+----------------+
+                        //   |                |                |
+                        //   |                |                |
+                        //   |    (32x32)     |    (32x32)     |
+                        //   |                |                |
+                        //   |                |                |
+                        // 1 +----------------+----------------+
+                        //   |                |                |
+                        //   |                |                |
+                        //   |    (32x32)     |    (32x32)     |
+                        //   |                |                |
+                        //   |                |                |
+                        //   +----------------+----------------+
+                        //
+                        // This means there are 4096 potential
+                        // locations in this array, which
+                        // just so happens to be 2^12!
+                        break;
+
+                case 2: {
+                        // Fetch the next background tile
+                        // attribute.
+
+                        // Recall that each nametable has two
+                        // rows of cells that are not tile
+                        // information, instead they represent
+                        // the attribute information that
+                        // indicates which palettes are applied
+                        // to which area on the screen.
+                        // Importantly (and frustratingly) there
+                        // is not a 1 to 1 correspondance
+                        // between background tile and
+                        // palette. Two rows of tile data holds
+                        // 64 attributes. Therfore we can assume
+                        // that the attributes affect 8x8 zones
+                        // on the screen for that
+                        // nametable. Given a working resolution
+                        // of 256x240, we can further assume
+                        // that each zone is 32x32 pixels in
+                        // screen space, or 4x4 tiles. Four
+                        // system palettes are allocated to
+                        // background rendering, so a palette
+                        // can be specified using just 2
+                        // bits. The attribute byte therefore
+                        // can specify 4 distinct palettes.
+                        // Therefore we can even further assume
+                        // that a single palette is applied to a
+                        // 2x2 tile combination of the 4x4 tile
+                        // zone. The very fact that background
+                        // tiles "share" a palette locally is
+                        // the reason why in some games you see
+                        // distortion in the colours at screen
+                        // edges.
+
+                        // As before when choosing the tile ID,
+                        // we can use the bottom 12 bits of the
+                        // loopy register, but we need to make
+                        // the implementation "coarser" because
+                        // instead of a specific tile, we want
+                        // the attribute byte for a group of 4x4
+                        // tiles, or in other words, we divide
+                        // our 32x32 address by 4 to give us an
+                        // equivalent 8x8 address, and we offset
+                        // this address into the attribute
+                        // section of the target nametable.
+
+                        // Reconstruct the 12 bit loopy address
+                        // into an offset into the attribute
+                        // memory
+
+                        // "(vram_addr.coarse_x >> 2)"        : integer divide coarse x by 4,
+                        //                                      from 5 bits to 3 bits
+                        // "((vram_addr.coarse_y >> 2) << 3)" : integer divide coarse y by 4,
+                        //                                      from 5 bits to 3 bits,
+                        //                                      shift to make room for coarse x
+
+                        // Result so far: YX00 00yy yxxx
+
+                        // All attribute memory begins at 0x03C0
+                        // within a nametable, so OR with result
+                        // to select target nametable, and
+                        // attribute byte offset.
+                        uint16_t addr =
+                                0x23C0 |
+                                (ppu->vramAddr.nametableY << 11) |
+                                (ppu->vramAddr.nametableX << 10) |
+                                ((ppu->vramAddr.coarseY >> 2) << 3) |
+                                (ppu->vramAddr.coarseX >> 2);
+
+                        ppu->bgNextTileAttrib = PpuRead(ppu, addr);
+
+                        // The attribute byte is assembled thus:
+                        // BR(76) BL(54) TR(32) TL(10)
+                        //
+                        // +----+----+			    +----+----+
+                        // | TL | TR |			    | ID | ID |
+                        // +----+----+ where TL =   +----+----+
+                        // | BL | BR |			    | ID | ID |
+                        // +----+----+			    +----+----+
+                        //
+                        // Since we know we can access a tile
+                        // directly from the 12 bit address, we
+                        // can analyse the bottom bits of the
+                        // coarse coordinates to provide us with
+                        // the correct offset into the 8-bit
+                        // word, to yield the 2 bits we are
+                        // actually interested in which
+                        // specifies the palette for the 2x2
+                        // group of tiles. We know if "coarse y
+                        // % 4" < 2 we are in the top half else
+                        // bottom half.  Likewise if "coarse x %
+                        // 4" < 2 we are in the left half else
+                        // right half.  Ultimately we want the
+                        // bottom two bits of our attribute word
+                        // to be the palette selected. So shift
+                        // as required.
+                        if (ppu->vramAddr.coarseY & 0x02)
+                                ppu->bgNextTileAttrib >>= 4;
+
+                        if (ppu->vramAddr.coarseX & 0x02)
+                                ppu->bgNextTileAttrib >>= 2;
+
+                        ppu->bgNextTileAttrib &= 0x03;
+                        break;
+                }
+
+                case 4:
+                        // Fetch the next background tile LSB
+                        // bit plane from the pattern memory The
+                        // Tile ID has been read from the
+                        // nametable. We will use this id to
+                        // index into the pattern memory to find
+                        // the correct sprite (assuming the
+                        // sprites lie on 8x8 pixel boundaries
+                        // in that memory, which they do even
+                        // though 8x16 sprites exist, as
+                        // background tiles are always 8x8).
+                        //
+                        // Since the sprites are effectively 1
+                        // bit deep, but 8 pixels wide, we can
+                        // represent a whole sprite row as a
+                        // single byte, so offsetting into the
+                        // pattern memory is easy. In total
+                        // there is 8KB so we need a 13 bit
+                        // address.
+
+                        // "(control.pattern_background << 12)"  : the pattern memory selector
+                        //                                         from control register, either 0K
+                        //                                         or 4K offset
+                        // "((uint16_t)bg_next_tile_id << 4)"    : the tile id multiplied by 16, as
+                        //                                         2 lots of 8 rows of 8 bit pixels
+                        // "(vram_addr.fine_y)"                  : Offset into which row based on
+                        //                                         vertical scroll offset
+                        // "+ 0"                                 : Mental clarity for plane offset
+
+                        // Note: No PPU address bus offset
+                        // required as it starts at 0x0000
+                        ppu->bgNextTileLsb =
+                                PpuRead(ppu,
+                                        (ppu->control.patternBackground << 12) +
+                                        ((uint16_t)ppu->bgNextTileId << 4) +
+                                        (ppu->vramAddr.fineY) + 0);
+                        break;
+
+                case 6:
+                        // Fetch the next background tile MSB
+                        // bit plane from the pattern memory
+                        // This is the same as above, but has a
+                        // +8 offset to select the next bit
+                        // plane
+                        ppu->bgNextTileMsb =
+                                PpuRead(ppu,
+                                        (ppu->control.patternBackground << 12) +
+                                        ((uint16_t)ppu->bgNextTileId << 4) +
+                                        (ppu->vramAddr.fineY) + 8);
+                        break;
+
+                case 7:
+                        IncrementScrollX(ppu);
+                        break;
+        }
+}
+
+//! \brief Find the background pixel for the current cycle from the shifters
+//!
+//! \param[in] ppu
+//! \param[out] bgPixel
+//! \param[out] bgPalette
+static void BackgroundPixel(struct ppu *ppu, uint8_t *bgPixel, uint8_t *bgPalette) {
+        *bgPixel = 0x00;
+        *bgPalette = 0x00;
+
+        if (ppu->mask.renderBackground) {
+                uint16_t bitMux = 0x8000 >> ppu->fineX;
+
+                uint8_t p0Pixel = (ppu->bgShifterPatternLo & bitMux) > 0;
+                uint8_t p1Pixel = (ppu->bgShifterPatternHi & bitMux) > 0;
+
+                *bgPixel = (p1Pixel << 1) | p0Pixel;
+
+                uint8_t bgPal0 = (ppu->bgShifterAttribLo & bitMux) > 0;
+                uint8_t bgPal1 = (ppu->bgShifterAttribHi & bitMux) > 0;
+
+                *bgPalette = (bgPal1 << 1) | bgPal0;
+        }
+}
+
+//! \brief Find the address of the low bit plane of a sprite's row on this scanline
+//!
+//! \param[in] ppu
+//! \param[in] sprite
+//! \return address of the row; the high bit plane follows 8 bytes later
+static uint16_t SpritePatternAddr(struct ppu *ppu, struct oam_entry *sprite) {
+        uint16_t spritePatternAddrLo;
+
+        // 8x8 Sprite Mode
+        if (!ppu->control.spriteSize) {
+                // Sprite is NOT flipped vertically.
+                if (!(sprite->attribute & 0x80)) {
+                        spritePatternAddrLo =
+                                (ppu->control.patternSprite << 12) // 0K or 4K on PPU Bus.
+                                | (sprite->id << 4)
+                                | (ppu->scanline - sprite->y);
+                }
+                // Sprite IS flipped vertically.
+                else {
+                        spritePatternAddrLo =
+                                (ppu->control.patternSprite << 12) // 0K or 4K on PPU Bus.
+                                | (sprite->id << 4)
+                                | (7 - (ppu->scanline - sprite->y));
+                }
+        }
+        // 8x16 Sprite Mode
+        else {
+                // Sprite is NOT flipped vertically.
+                if (!(sprite->attribute & 0x80)) {
+                        // Read the top half of the tile.
+                        if (ppu->scanline - sprite->y < 8) {
+                                spritePatternAddrLo =
+                                        ((sprite->id & 0x01) << 12)
+                                        | ((sprite->id & 0xFE) << 4)
+                                        | ((ppu->scanline - sprite->y) & 0x07);
+                        }
+                        // Read the bottom half of the tile.
+                        else {
+                                spritePatternAddrLo =
+                                        ((sprite->id & 0x01) << 12)
+                                        | (((sprite->id & 0xFE) + 1)<< 4)
+                                        | ((ppu->scanline - sprite->y) & 0x07);
+                        }
+                }
+                // Sprite IS flipped vertically.
+                else {
+                        // Read the top half of the tile.
+                        if (ppu->scanline - sprite->y < 8) {
+                                spritePatternAddrLo =
+                                        ((sprite->id & 0x01) << 12)
+                                        | ((sprite->id & 0xFE) << 4)
+                                        | ((7 - (ppu->scanline - sprite->y)) & 0x07);
+                        }
+                        // Read the bottom half of the tile.
+                        else {
+                                spritePatternAddrLo =
+                                        ((sprite->id & 0x01) << 12)
+                                        | (((sprite->id & 0xFE) + 1)<< 4)
+                                        | ((7 - (ppu->scanline - sprite->y)) & 0x07);
+                        }
+                }
+        }
+
+        return spritePatternAddrLo;
+}
+
+//! \brief Draw a fetched sprite row into spriteLine
+//!
+//! Only pixels no earlier sprite has drawn are drawn.
+//!
+//! \param[in,out] ppu
+//! \param[in] sprite
+//! \param[in] lo low bit plane, already flipped horizontally if need be
+//! \param[in] hi high bit plane
+//! \param[in] flags COMPOSE_SPRITE_ZERO or SPRITE_LINE_EXTRA, if either applies
+static void RasterizeSprite(struct ppu *ppu, struct oam_entry *sprite, uint8_t lo, uint8_t hi, uint8_t flags) {
+        uint8_t palette = (sprite->attribute & 0x03) + 0x04;
+        flags |= (palette << 2);
+        if (0 == (sprite->attribute & 0x20)) {
+                flags |= COMPOSE_SPRITE_FRONT;
+        }
+
+        for (int col = 0; col < 8 && sprite->x + col < 256; col++) {
+                uint8_t *entry = &ppu->spriteLine[sprite->x + col];
+                uint8_t pixel = (((hi >> (7 - col)) & 0x01) << 1) | ((lo >> (7 - col)) & 0x01);
+                if (0 != pixel && 0 == (*entry & 0x03)) {
+                        *entry = flags | pixel;
+                }
+        }
+}
+
+//! \brief Draw the sprites just fetched for the next scanline into spriteLine
+//!
+//! Sprites are drawn in the same priority order ForegroundPixel picks them,
+//! followed by any sprites past the eighth when the sprite limit is disabled.
+//! The sprite shifters must just have been loaded.
+//!
+//! \param[in,out] ppu
+static void RasterizeSprites(struct ppu *ppu) {
+        memset(ppu->spriteLine, 0x00, sizeof(ppu->spriteLine));
+
+        for (int i = 0; i < ppu->spriteCount; i++) {
+                RasterizeSprite(ppu, &ppu->scanlineSprites[i],
+                                ppu->spriteShifterPatternLo[i], ppu->spriteShifterPatternHi[i],
+                                (0 == i) ? COMPOSE_SPRITE_ZERO : 0x00);
+        }
+
+        for (int i = 0; i < ppu->extraSpriteCount; i++) {
+                struct oam_entry *sprite = &ppu->extraSprites[i];
+                uint16_t addr = SpritePatternAddr(ppu, sprite);
+                uint8_t lo = PpuRead(ppu, addr);
+                uint8_t hi = PpuRead(ppu, addr + 8);
+                if (sprite->attribute & 0x40) {
+                        lo = MirrorByte(lo);
+                        hi = MirrorByte(hi);
+                }
+                RasterizeSprite(ppu, sprite, lo, hi, SPRITE_LINE_EXTRA);
+        }
+}
+
+//! \brief Find the frontmost opaque sprite pixel for the current cycle
+//!
+//! Also notes whether it belongs to sprite zero.
+//!
+//! \param[in,out] ppu
+//! \param[out] fgPixel
+//! \param[out] fgPalette
+//! \param[out] fgPriority whether the sprite is drawn in front of the
+//! background
+static void ForegroundPixel(struct ppu *ppu, uint8_t *fgPixel, uint8_t *fgPalette, uint8_t *fgPriority) {
+        *fgPixel = 0x00;
+        *fgPalette = 0x00;
+        *fgPriority = 0x00;
+
+        if (ppu->mask.renderSprites) {
+                ppu->isSpriteZeroBeingRendered = false;
+
+                for (int i = 0; i < ppu->spriteCount; i++) {
+                        if (ppu->scanlineSprites[i].x == 0) {
+                                uint8_t fgPixelLo = (ppu->spriteShifterPatternLo[i] & 0x80) > 0;
+                                uint8_t fgPixelHi = (ppu->spriteShifterPatternHi[i] & 0x80) > 0;
+                                *fgPixel = (fgPixelHi << 1) | fgPixelLo;
+
+                                *fgPalette = (ppu->scanlineSprites[i].attribute & 0x03) + 0x04;
+                                *fgPriority = (ppu->scanlineSprites[i].attribute & 0x20) == 0;
+
+                                if (*fgPixel != 0) {
+                                        if (i == 0) { // Is this sprite zero?
+                                                ppu->isSpriteZeroBeingRendered = true;
+                                        }
+
+                                        break;
+                                }
+                        }
+                }
+
+                // Sprites past the eighth only show through where none of
+                // the first eight are opaque; see RasterizeSprites.
+                if (0 == *fgPixel && 0 != ppu->extraSpriteCount && ppu->cycle >= 1 && ppu->cycle < 257) {
+                        uint8_t entry = ppu->spriteLine[ppu->cycle - 1];
+                        if (entry & SPRITE_LINE_EXTRA) {
+                                *fgPixel = entry & 0x03;
+                                *fgPalette = (entry >> 2) & 0x07;
+                                *fgPriority = (entry & COMPOSE_SPRITE_FRONT) != 0;
+                        }
+                }
+        }
+}
+
+//! \brief Composite a background pixel with the sprites for the current cycle
+//!
+//! Also detects sprite zero hits.
+//!
+//! \param[in,out] ppu
+//! \param[in] bgPixel
+//! \param[in] bgPalette
+//! \param[out] palette
+//! \param[out] pixel index into the palette
+static void ComposePixel(struct ppu *ppu, uint8_t bgPixel, uint8_t bgPalette, uint8_t *palette, uint8_t *pixel) {
+        uint8_t fgPixel = 0x00;
+        uint8_t fgPalette = 0x00;
+        uint8_t fgPriority = 0x00;
+        ForegroundPixel(ppu, &fgPixel, &fgPalette, &fgPriority);
+
+        // Bg is transparent AND fg is transparent.
+        if (bgPixel == 0 && fgPixel == 0) {
+                *pixel = 0x00;
+                *palette = 0x00;
+        }
+        // Bg is transparent, fg is visible.
+        else if (bgPixel == 0 && fgPixel > 0) {
+                *pixel = fgPixel;
+                *palette = fgPalette;
+        }
+        // Bg is visible, fg is tranparent.
+        else if (bgPixel > 0 && fgPixel == 0) {
+                *pixel = bgPixel;
+                *palette = bgPalette;
+        }
+        // Bg is visible AND fg is visible.
+        else if (bgPixel > 0 && fgPixel > 0) {
+                if (fgPriority) {
+                        *pixel = fgPixel;
+                        *palette = fgPalette;
+                } else {
+                        *pixel = bgPixel;
+                        *palette = bgPalette;
+                }
+
+                if (ppu->isSpriteZeroHitPossible && ppu->isSpriteZeroBeingRendered) {
+                        if (ppu->mask.renderBackground & ppu->mask.renderSprites) {
+                                if (~(ppu->mask.renderBackgroundLeft | ppu->mask.renderSpritesLeft)) {
+                                        if (ppu->cycle >= 9 && ppu->cycle < 258) {
+                                                ppu->status.spriteZeroHit = 1;
+                                        }
+                                } else {
+                                        if (ppu->cycle >= 1 && ppu->cycle < 258) {
+                                                ppu->status.spriteZeroHit = 1;
+                                        }
+                                }
+                        }
+                }
+        }
+
+}
+
+//! \brief Find every sprite in OAM on the given scanline
+//!
+//! \param[in] ppu
+//! \param[in] scanline
+//! \param[in] height 8 or 16
+//! \return a bit for each sprite, sprite zero in the lowest bit
+static uint64_t OamHits(struct ppu *ppu, uint8_t scanline, uint8_t height) {
+        uint64_t hits = 0;
+
+#ifdef __SSE2__
+        // A sprite is on the scanline if y <= scanline < y + height; both
+        // comparisons done unsigned, 16 sprites at a time.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i line = _mm_set1_epi8((char)scanline);
+        const __m128i lastRow = _mm_set1_epi8((char)(height - 1));
+
+        for (int i = 0; i < 64; i += 16) {
+                __m128i y = _mm_loadu_si128((const __m128i *)&ppu->oamY[i]);
+                __m128i isAbove = _mm_cmpeq_epi8(_mm_min_epu8(y, line), y);
+                __m128i row = _mm_subs_epu8(line, y);
+                __m128i isWithin = _mm_cmpeq_epi8(_mm_subs_epu8(row, lastRow), zero);
+                uint64_t mask = (uint16_t)_mm_movemask_epi8(_mm_and_si128(isAbove, isWithin));
+                hits |= mask << i;
+        }
+#else
+        for (int i = 0; i < 64; i++) {
+                int16_t diff = (int16_t)scanline - (int16_t)ppu->oamY[i];
+                if (diff >= 0 && diff < height) {
+                        hits |= (uint64_t)1 << i;
+                }
+        }
+#endif
+
+        return hits;
+}
+
 //! \brief advance the renderer one pixel across the screen
 //!
 //! Advance the pixel right one pixel on the current row, or to the start of the
@@ -489,207 +1128,7 @@ void PpuTick(struct ppu *ppu) {
 
                 if ((ppu->cycle >= 2 && ppu->cycle < 258) || (ppu->cycle >= 321 && ppu->cycle < 338)) {
                         UpdateShifters(ppu);
-
-                        switch ((ppu->cycle - 1) % 8) {
-                                case 0:
-                                        LoadBackgroundShifters(ppu);
-
-                                        // Fetch the next background tile ID.
-                                        // 0x2000: nametable address space.
-                                        // 0x0FFF: Mask to 12 bits
-                                        ppu->bgNextTileId = PpuRead(ppu, 0x2000 | (ppu->vramAddr.reg & 0x0FFF));
-                                        // Explanation:
-                                        // The bottom 12 bits of the loopy
-                                        // register provide an index into the 4
-                                        // nametables, regardless of nametable
-                                        // mirroring configuration.
-                                        // nametable_y(1) nametable_x(1)
-                                        // coarse_y(5) coarse_x(5)
-                                        //
-                                        // Consider a single nametable is a
-                                        // 32x32 array, and we have four of them:
-                                        //   0                1
-                                        // 0 +----------------+----------------+
-                                        //   |                |                |
-                                        //   |                |                |
-                                        //   |    (32x32)     |    (32x32)     |
-                                        //   |                |                |
-                                        //   |                |                |
-                                        // 1 +----------------+----------------+
-                                        //   |                |                |
-                                        //   |                |                |
-                                        //   |    (32x32)     |    (32x32)     |
-                                        //   |                |                |
-                                        //   |                |                |
-                                        //   +----------------+----------------+
-                                        //
-                                        // This means there are 4096 potential
-                                        // locations in this array, which
-                                        // just so happens to be 2^12!
-                                        break;
-
-                                case 2: {
-                                        // Fetch the next background tile
-                                        // attribute.
-
-                                        // Recall that each nametable has two
-                                        // rows of cells that are not tile
-                                        // information, instead they represent
-                                        // the attribute information that
-                                        // indicates which palettes are applied
-                                        // to which area on the screen.
-                                        // Importantly (and frustratingly) there
-                                        // is not a 1 to 1 correspondance
-                                        // between background tile and
-                                        // palette. Two rows of tile data holds
-                                        // 64 attributes. Therfore we can assume
-                                        // that the attributes affect 8x8 zones
-                                        // on the screen for that
-                                        // nametable. Given a working resolution
-                                        // of 256x240, we can further assume
-                                        // that each zone is 32x32 pixels in
-                                        // screen space, or 4x4 tiles. Four
-                                        // system palettes are allocated to
-                                        // background rendering, so a palette
-                                        // can be specified using just 2
-                                        // bits. The attribute byte therefore
-                                        // can specify 4 distinct palettes.
-                                        // Therefore we can even further assume
-                                        // that a single palette is applied to a
-                                        // 2x2 tile combination of the 4x4 tile
-                                        // zone. The very fact that background
-                                        // tiles "share" a palette locally is
-                                        // the reason why in some games you see
-                                        // distortion in the colours at screen
-                                        // edges.
-
-                                        // As before when choosing the tile ID,
-                                        // we can use the bottom 12 bits of the
-                                        // loopy register, but we need to make
-                                        // the implementation "coarser" because
-                                        // instead of a specific tile, we want
-                                        // the attribute byte for a group of 4x4
-                                        // tiles, or in other words, we divide
-                                        // our 32x32 address by 4 to give us an
-                                        // equivalent 8x8 address, and we offset
-                                        // this address into the attribute
-                                        // section of the target nametable.
-
-                                        // Reconstruct the 12 bit loopy address
-                                        // into an offset into the attribute
-                                        // memory
-
-                                        // "(vram_addr.coarse_x >> 2)"        : integer divide coarse x by 4,
-                                        //                                      from 5 bits to 3 bits
-                                        // "((vram_addr.coarse_y >> 2) << 3)" : integer divide coarse y by 4,
-                                        //                                      from 5 bits to 3 bits,
-                                        //                                      shift to make room for coarse x
-
-                                        // Result so far: YX00 00yy yxxx
-
-                                        // All attribute memory begins at 0x03C0
-                                        // within a nametable, so OR with result
-                                        // to select target nametable, and
-                                        // attribute byte offset.
-                                        uint16_t addr =
-                                                0x23C0 |
-                                                (ppu->vramAddr.nametableY << 11) |
-                                                (ppu->vramAddr.nametableX << 10) |
-                                                ((ppu->vramAddr.coarseY >> 2) << 3) |
-                                                (ppu->vramAddr.coarseX >> 2);
-
-                                        ppu->bgNextTileAttrib = PpuRead(ppu, addr);
-
-                                        // The attribute byte is assembled thus:
-                                        // BR(76) BL(54) TR(32) TL(10)
-                                        //
-                                        // +----+----+			    +----+----+
-                                        // | TL | TR |			    | ID | ID |
-                                        // +----+----+ where TL =   +----+----+
-                                        // | BL | BR |			    | ID | ID |
-                                        // +----+----+			    +----+----+
-                                        //
-                                        // Since we know we can access a tile
-                                        // directly from the 12 bit address, we
-                                        // can analyse the bottom bits of the
-                                        // coarse coordinates to provide us with
-                                        // the correct offset into the 8-bit
-                                        // word, to yield the 2 bits we are
-                                        // actually interested in which
-                                        // specifies the palette for the 2x2
-                                        // group of tiles. We know if "coarse y
-                                        // % 4" < 2 we are in the top half else
-                                        // bottom half.  Likewise if "coarse x %
-                                        // 4" < 2 we are in the left half else
-                                        // right half.  Ultimately we want the
-                                        // bottom two bits of our attribute word
-                                        // to be the palette selected. So shift
-                                        // as required.
-                                        if (ppu->vramAddr.coarseY & 0x02)
-                                                ppu->bgNextTileAttrib >>= 4;
-
-                                        if (ppu->vramAddr.coarseX & 0x02)
-                                                ppu->bgNextTileAttrib >>= 2;
-
-                                        ppu->bgNextTileAttrib &= 0x03;
-                                        break;
-                                }
-
-                                case 4:
-                                        // Fetch the next background tile LSB
-                                        // bit plane from the pattern memory The
-                                        // Tile ID has been read from the
-                                        // nametable. We will use this id to
-                                        // index into the pattern memory to find
-                                        // the correct sprite (assuming the
-                                        // sprites lie on 8x8 pixel boundaries
-                                        // in that memory, which they do even
-                                        // though 8x16 sprites exist, as
-                                        // background tiles are always 8x8).
-                                        //
-                                        // Since the sprites are effectively 1
-                                        // bit deep, but 8 pixels wide, we can
-                                        // represent a whole sprite row as a
-                                        // single byte, so offsetting into the
-                                        // pattern memory is easy. In total
-                                        // there is 8KB so we need a 13 bit
-                                        // address.
-
-                                        // "(control.pattern_background << 12)"  : the pattern memory selector
-                                        //                                         from control register, either 0K
-                                        //                                         or 4K offset
-                                        // "((uint16_t)bg_next_tile_id << 4)"    : the tile id multiplied by 16, as
-                                        //                                         2 lots of 8 rows of 8 bit pixels
-                                        // "(vram_addr.fine_y)"                  : Offset into which row based on
-                                        //                                         vertical scroll offset
-                                        // "+ 0"                                 : Mental clarity for plane offset
-
-                                        // Note: No PPU address bus offset
-                                        // required as it starts at 0x0000
-                                        ppu->bgNextTileLsb =
-                                                PpuRead(ppu,
-                                                        (ppu->control.patternBackground << 12) +
-                                                        ((uint16_t)ppu->bgNextTileId << 4) +
-                                                        (ppu->vramAddr.fineY) + 0);
-                                        break;
-
-                                case 6:
-                                        // Fetch the next background tile MSB
-                                        // bit plane from the pattern memory
-                                        // This is the same as above, but has a
-                                        // +8 offset to select the next bit
-                                        // plane
-                                        ppu->bgNextTileMsb =
-                                                PpuRead(ppu,
-                                                        (ppu->control.patternBackground << 12) +
-                                                        ((uint16_t)ppu->bgNextTileId << 4) +
-                                                        (ppu->vramAddr.fineY) + 8);
-                                        break;
-
-                                case 7:
-                                        IncrementScrollX(ppu);
-                                        break;
-                        }
+                        FetchBackgroundTile(ppu);
                 }
 
                 if (256 == ppu->cycle) {
@@ -709,6 +1148,13 @@ void PpuTick(struct ppu *ppu) {
                 // End of vblank period, so reset the Y address.
                 if (-1 == ppu->scanline && ppu->cycle >= 280 && ppu->cycle < 305) {
                         TransferAddressY(ppu);
+
+                        // The scroll the frame starts from, for the
+                        // nametable view.
+                        if (304 == ppu->cycle) {
+                                ppu->viewScroll = ppu->vramAddr;
+                                ppu->viewFineX = ppu->fineX;
+                        }
                 }
 
                 //-- Foreground Rendering --------------------------------------
@@ -716,23 +1162,34 @@ void PpuTick(struct ppu *ppu) {
                 if (ppu->cycle == 257 && ppu->scanline >= 0) {
                         memset(ppu->scanlineSprites, 0xFF, 8 * sizeof(struct oam_entry));
                         ppu->spriteCount = 0;
+                        ppu->extraSpriteCount = 0;
 
-                        ppu->isSpriteZeroHitPossible = false;
-                        uint8_t oamEntry = 0;
-                        while (oamEntry < 64 && ppu->spriteCount < 9) {
-                                int16_t diff = ((int16_t)ppu->scanline - (int16_t)ppu->oam[oamEntry].y);
-                                if (diff >= 0 && diff < (ppu->control.spriteSize ? 16 : 8)) {
-                                        if (ppu->spriteCount < 8) {
-                                                if (oamEntry == 0) {
-                                                        ppu->isSpriteZeroHitPossible = true;
-                                                }
-                                                memcpy(&ppu->scanlineSprites[ppu->spriteCount], &ppu->oam[oamEntry], sizeof(struct oam_entry));
-                                                ppu->spriteCount++;
+                        uint64_t hits = OamHits(ppu, (uint8_t)ppu->scanline, ppu->control.spriteSize ? 16 : 8);
+
+                        // Sprite zero can only ever be the first hit.
+                        ppu->isSpriteZeroHitPossible = hits & 0x01;
+
+                        while (0 != hits) {
+                                int oamEntry = __builtin_ctzll(hits);
+                                hits &= hits - 1;
+
+                                struct oam_entry sprite = {
+                                        ppu->oamY[oamEntry], ppu->oamId[oamEntry],
+                                        ppu->oamAttribute[oamEntry], ppu->oamX[oamEntry],
+                                };
+
+                                if (ppu->spriteCount < 8) {
+                                        ppu->scanlineSprites[ppu->spriteCount++] = sprite;
+                                } else {
+                                        // Stays set until the pre-render
+                                        // line.
+                                        ppu->status.spriteOverflow = 1;
+                                        if (ppu->isSpriteLimitEnabled) {
+                                                break;
                                         }
+                                        ppu->extraSprites[ppu->extraSpriteCount++] = sprite;
                                 }
-                                oamEntry++;
                         }
-                        ppu->status.spriteOverflow = (ppu->spriteCount > 8);
                 }
 
                 if (ppu->cycle == 340) {
@@ -740,61 +1197,7 @@ void PpuTick(struct ppu *ppu) {
                                 uint8_t spritePatternBitsLo, spritePatternBitsHi;
                                 uint16_t spritePatternAddrLo, spritePatternAddrHi;
 
-                                // 8x8 Sprite Mode
-                                if (!ppu->control.spriteSize) {
-                                        // Sprite is NOT flipped vertically.
-                                        if (!(ppu->scanlineSprites[i].attribute & 0x80)) {
-                                                spritePatternAddrLo =
-                                                        (ppu->control.patternSprite << 12) // 0K or 4K on PPU Bus.
-                                                        | (ppu->scanlineSprites[i].id << 4)
-                                                        | (ppu->scanline - ppu->scanlineSprites[i].y);
-                                        }
-                                        // Sprite IS flipped vertically.
-                                        else {
-                                                spritePatternAddrLo =
-                                                        (ppu->control.patternSprite << 12) // 0K or 4K on PPU Bus.
-                                                        | (ppu->scanlineSprites[i].id << 4)
-                                                        | (7 - (ppu->scanline - ppu->scanlineSprites[i].y));
-                                        }
-                                }
-                                // 8x16 Sprite Mode
-                                else {
-                                        // Sprite is NOT flipped vertically.
-                                        if (!(ppu->scanlineSprites[i].attribute & 0x80)) {
-                                                // Read the top half of the tile.
-                                                if (ppu->scanline - ppu->scanlineSprites[i].y < 8) {
-                                                        spritePatternAddrLo =
-                                                                ((ppu->scanlineSprites[i].id & 0x01) << 12)
-                                                                | ((ppu->scanlineSprites[i].id & 0xFE) << 4)
-                                                                | ((ppu->scanline - ppu->scanlineSprites[i].y) & 0x07);
-                                                }
-                                                // Read the bottom half of the tile.
-                                                else {
-                                                        spritePatternAddrLo =
-                                                                ((ppu->scanlineSprites[i].id & 0x01) << 12)
-                                                                | (((ppu->scanlineSprites[i].id & 0xFE) + 1)<< 4)
-                                                                | ((ppu->scanline - ppu->scanlineSprites[i].y) & 0x07);
-                                                }
-                                        }
-                                        // Sprite IS flipped vertically.
-                                        else {
-                                                // Read the top half of the tile.
-                                                if (ppu->scanline - ppu->scanlineSprites[i].y < 8) {
-                                                        spritePatternAddrLo =
-                                                                ((ppu->scanlineSprites[i].id & 0x01) << 12)
-                                                                | ((ppu->scanlineSprites[i].id & 0xFE) << 4)
-                                                                | ((7 - (ppu->scanline - ppu->scanlineSprites[i].y)) & 0x07);
-                                                }
-                                                // Read the bottom half of the tile.
-                                                else {
-                                                        spritePatternAddrLo =
-                                                                ((ppu->scanlineSprites[i].id & 0x01) << 12)
-                                                                | (((ppu->scanlineSprites[i].id & 0xFE) + 1)<< 4)
-                                                                | ((7 - (ppu->scanline - ppu->scanlineSprites[i].y)) & 0x07);
-                                                }
-                                        }
-                                }
-
+                                spritePatternAddrLo = SpritePatternAddr(ppu, &ppu->scanlineSprites[i]);
                                 spritePatternAddrHi = spritePatternAddrLo + 8;
                                 spritePatternBitsLo = PpuRead(ppu, spritePatternAddrLo);
                                 spritePatternBitsHi = PpuRead(ppu, spritePatternAddrHi);
@@ -808,6 +1211,8 @@ void PpuTick(struct ppu *ppu) {
                                 ppu->spriteShifterPatternLo[i] = spritePatternBitsLo;
                                 ppu->spriteShifterPatternHi[i] = spritePatternBitsHi;
                         }
+
+                        RasterizeSprites(ppu);
                 }
         }
 
@@ -823,107 +1228,281 @@ void PpuTick(struct ppu *ppu) {
                 }
         }
 
-        uint8_t bgPixel = 0x00;
-        uint8_t bgPalette = 0x00;
+        // Without output, pixels only matter for sprite zero hits.
+        if (ppu->isOutputEnabled || ppu->isSpriteZeroHitPossible) {
+                uint8_t bgPixel = 0x00;
+                uint8_t bgPalette = 0x00;
+                BackgroundPixel(ppu, &bgPixel, &bgPalette);
+
+                uint8_t palette = 0x00;
+                uint8_t pixel = 0x00;
+                ComposePixel(ppu, bgPixel, bgPalette, &palette, &pixel);
+
+                uint32_t color = OutputColors(ppu)[(palette << 2) + pixel];
+                if (!ppu->isOutputEnabled) {
+                        // Composed only for the sprite zero hit.
+                } else if (!ppu->isIndexedOutputEnabled) {
+                        SpriteSetPixel(ppu->screen, ppu->cycle - 1, ppu->scanline, color);
+                } else if (ppu->cycle >= 1 && ppu->cycle <= 256 && ppu->scanline >= 0 && ppu->scanline < 240) {
+                        ppu->indexedScreen[ppu->scanline * 256 + ppu->cycle - 1] = (uint16_t)color;
+                }
+        }
 
-        if (ppu->mask.renderBackground) {
-                uint16_t bitMux = 0x8000 >> ppu->fineX;
+        ppu->cycle++;
 
-                uint8_t p0Pixel = (ppu->bgShifterPatternLo & bitMux) > 0;
-                uint8_t p1Pixel = (ppu->bgShifterPatternHi & bitMux) > 0;
+        if (341 < ppu->cycle) {
+                ppu->cycle = 0;
+                ppu->scanline++;
 
-                bgPixel = (p1Pixel << 1) | p0Pixel;
+                if (261 < ppu->scanline) {
+                        ppu->scanline = -1;
+                        ppu->isFrameComplete = true;
+                        ppu->frameCount++;
+                }
+        }
+}
 
-                uint8_t bgPal0 = (ppu->bgShifterAttribLo & bitMux) > 0;
-                uint8_t bgPal1 = (ppu->bgShifterAttribHi & bitMux) > 0;
+//! \brief Decode the two bit planes of a row of a pattern
+//!
+//! \param[in] lsb
+//! \param[in] msb
+//! \param[in] isFlipped whether to flip the row horizontally
+//! \param[out] scratch space to decode the row into
+//! \return scratch, holding 8 pixel indices from left to right
+static const uint8_t *DecodePatternRow(uint8_t lsb, uint8_t msb, bool isFlipped, uint8_t *scratch) {
+        for (int col = 0; col < 8; col++) {
+                int bit = isFlipped ? col : 7 - col;
+                scratch[col] = (((msb >> bit) & 0x01) << 1) | ((lsb >> bit) & 0x01);
+        }
+        return scratch;
+}
 
-                bgPalette = (bgPal1 << 1) | bgPal0;
+//! \brief Find the pixels of a row of a pattern, already decoded
+//!
+//! \param[in] ppu
+//! \param[in] addr address of either bit plane of the row
+//! \param[in] isFlipped whether to flip the row horizontally
+//! \param[out] scratch space to decode the row into, if the cart doesn't
+//! intercept it
+//! \return 8 pixel indices from left to right
+static const uint8_t *PatternRow(struct ppu *ppu, uint16_t addr, bool isFlipped, uint8_t *scratch) {
+        const uint8_t *row = CartPpuTileRow(ppu->cart, addr, isFlipped);
+        if (NULL != row) {
+                return row;
         }
 
-        uint8_t fgPixel = 0x00;
-        uint8_t fgPalette = 0x00;
-        uint8_t fgPriority = 0x00;
+        return DecodePatternRow(PpuRead(ppu, addr & ~0x0008), PpuRead(ppu, addr | 0x0008), isFlipped, scratch);
+}
 
-        if (ppu->mask.renderSprites) {
-                ppu->isSpriteZeroBeingRendered = false;
+//! \brief Render the background of the visible part of the current scanline
+//!
+//! Makes the same fetches FetchBackgroundTile makes over cycles 1 to 256, but a
+//! tile at a time, copying whole rows of pixels out of the tile cache rather
+//! than shifting them out of the shifters a pixel at a time.  The shifters are
+//! left as they would be after cycle 256.
+//!
+//! \param[in,out] ppu
+//! \param[out] line 256 pixels, each the palette shifted left 2 bits or'd with
+//! the pixel
+static void RenderBackgroundLine(struct ppu *ppu, uint8_t *line) {
+        // The first two tiles were fetched on the previous scanline and are
+        // still in the shifters, then 32 more are fetched. The last isn't
+        // drawn until the next scanline; with fine x, part of the one before
+        // may not be drawn either.
+        uint8_t tiles[33 * 8];
+        for (int i = 0; i < 16; i++) {
+                uint16_t bitMux = 0x8000 >> i;
+                uint8_t pixel = (((ppu->bgShifterPatternHi & bitMux) > 0) << 1) | ((ppu->bgShifterPatternLo & bitMux) > 0);
+                uint8_t palette = (((ppu->bgShifterAttribHi & bitMux) > 0) << 1) | ((ppu->bgShifterAttribLo & bitMux) > 0);
+                tiles[i] = (palette << 2) | pixel;
+        }
 
-                for (int i = 0; i < ppu->spriteCount; i++) {
-                        if (ppu->scanlineSprites[i].x == 0) {
-                                uint8_t fgPixelLo = (ppu->spriteShifterPatternLo[i] & 0x80) > 0;
-                                uint8_t fgPixelHi = (ppu->spriteShifterPatternHi[i] & 0x80) > 0;
-                                fgPixel = (fgPixelHi << 1) | fgPixelLo;
+        uint8_t lsb[2] = {0};
+        uint8_t msb[2] = {0};
+        uint8_t attrib[2] = {0};
 
-                                fgPalette = (ppu->scanlineSprites[i].attribute & 0x03) + 0x04;
-                                fgPriority = (ppu->scanlineSprites[i].attribute & 0x20) == 0;
+        for (int tile = 2; tile < 34; tile++) {
+                // The id of the first was fetched at the end of the previous
+                // scanline; see FetchBackgroundTile.
+                if (tile > 2) {
+                        ppu->bgNextTileId = PpuRead(ppu, 0x2000 | (ppu->vramAddr.reg & 0x0FFF));
+                }
 
-                                if (fgPixel != 0) {
-                                        if (i == 0) { // Is this sprite zero?
-                                                ppu->isSpriteZeroBeingRendered = true;
-                                        }
+                uint16_t addr =
+                        0x23C0 |
+                        (ppu->vramAddr.nametableY << 11) |
+                        (ppu->vramAddr.nametableX << 10) |
+                        ((ppu->vramAddr.coarseY >> 2) << 3) |
+                        (ppu->vramAddr.coarseX >> 2);
+                ppu->bgNextTileAttrib = PpuRead(ppu, addr);
+                if (ppu->vramAddr.coarseY & 0x02)
+                        ppu->bgNextTileAttrib >>= 4;
+                if (ppu->vramAddr.coarseX & 0x02)
+                        ppu->bgNextTileAttrib >>= 2;
+                ppu->bgNextTileAttrib &= 0x03;
+
+                uint16_t patternAddr =
+                        (ppu->control.patternBackground << 12) +
+                        ((uint16_t)ppu->bgNextTileId << 4) +
+                        (ppu->vramAddr.fineY);
+
+                IncrementScrollX(ppu);
+
+                // Only the bit planes of the last three tiles outlive the
+                // scanline: two in the shifters, and the last in bgNextTileLsb
+                // and bgNextTileMsb for cycle 257 to load.  Every other row
+                // comes straight out of the tile cache.
+                uint8_t scratch[8];
+                const uint8_t *row = NULL;
+                if (tile >= 31) {
+                        ppu->bgNextTileLsb = PpuRead(ppu, patternAddr + 0);
+                        ppu->bgNextTileMsb = PpuRead(ppu, patternAddr + 8);
+                        row = DecodePatternRow(ppu->bgNextTileLsb, ppu->bgNextTileMsb, false, scratch);
+                } else if (ppu->mask.renderBackground) {
+                        row = PatternRow(ppu, patternAddr, false, scratch);
+                }
 
-                                        break;
-                                }
+                if (tile < 33 && ppu->mask.renderBackground) {
+                        for (int col = 0; col < 8; col++) {
+                                tiles[tile * 8 + col] = (ppu->bgNextTileAttrib << 2) | row[col];
                         }
                 }
+
+                // The last two tiles drawn are left in the shifters.
+                if (tile == 31 || tile == 32) {
+                        lsb[tile - 31] = ppu->bgNextTileLsb;
+                        msb[tile - 31] = ppu->bgNextTileMsb;
+                        attrib[tile - 31] = ppu->bgNextTileAttrib;
+                }
         }
 
-        uint8_t pixel = 0x00;
-        uint8_t palette = 0x00;
+        if (ppu->mask.renderBackground) {
+                memcpy(line, &tiles[ppu->fineX], 256);
+
+                // Loaded on cycle 241 and shifted 8 times, then loaded on
+                // cycle 249 and shifted 7 times.
+                ppu->bgShifterPatternLo = (uint16_t)(((lsb[0] << 8) | lsb[1]) << 7);
+                ppu->bgShifterPatternHi = (uint16_t)(((msb[0] << 8) | msb[1]) << 7);
+                ppu->bgShifterAttribLo = (uint16_t)((((attrib[0] & 0x01) ? 0xFF00 : 0x0000) | ((attrib[1] & 0x01) ? 0x00FF : 0x0000)) << 7);
+                ppu->bgShifterAttribHi = (uint16_t)((((attrib[0] & 0x02) ? 0xFF00 : 0x0000) | ((attrib[1] & 0x02) ? 0x00FF : 0x0000)) << 7);
+        } else {
+                memset(line, 0x00, 256);
+
+                // The shifters are only shifted while rendering the background,
+                // but are still loaded.
+                ppu->bgShifterPatternLo = (ppu->bgShifterPatternLo & 0xFF00) | lsb[1];
+                ppu->bgShifterPatternHi = (ppu->bgShifterPatternHi & 0xFF00) | msb[1];
+                ppu->bgShifterAttribLo = (ppu->bgShifterAttribLo & 0xFF00) | ((attrib[1] & 0x01) ? 0xFF : 0x00);
+                ppu->bgShifterAttribHi = (ppu->bgShifterAttribHi & 0xFF00) | ((attrib[1] & 0x02) ? 0xFF : 0x00);
+        }
+}
 
-        // Bg is transparent AND fg is transparent.
-        if (bgPixel == 0 && fgPixel == 0) {
-                pixel = 0x00;
-                palette = 0x00;
+//! \brief Update the sprite shifters as cycles 2 to 256 would
+//!
+//! \param[in,out] ppu
+static void SkipSpriteShifters(struct ppu *ppu) {
+        // 255 updates: each sprite's x counts down to zero, then it's shifted
+        // out a pixel at a time.
+        for (int i = 0; i < ppu->spriteCount; i++) {
+                int shifts = 255 - ppu->scanlineSprites[i].x;
+                ppu->scanlineSprites[i].x = 0;
+                ppu->spriteShifterPatternLo[i] = (shifts < 8) ? (uint8_t)(ppu->spriteShifterPatternLo[i] << shifts) : 0x00;
+                ppu->spriteShifterPatternHi[i] = (shifts < 8) ? (uint8_t)(ppu->spriteShifterPatternHi[i] << shifts) : 0x00;
         }
-        // Bg is transparent, fg is visible.
-        else if (bgPixel == 0 && fgPixel > 0) {
-                pixel = fgPixel;
-                palette = fgPalette;
+
+        ppu->isSpriteZeroBeingRendered = ppu->spriteLine[255] & COMPOSE_SPRITE_ZERO;
+}
+
+//! \brief Whether ComposeLine would detect a sprite zero hit, without composing
+//!
+//! \param[in] bg background pixels
+//! \param[in] fg sprite pixels
+//! \param[in] hitStart see ComposeLine
+//! \return true if sprite zero hits
+static bool IsSpriteZeroHit(const uint8_t *bg, const uint8_t *fg, int hitStart) {
+        for (int x = hitStart; x < COMPOSE_LINE_WIDTH; x++) {
+                if ((bg[x] & 0x03) && (fg[x] & 0x03) && (fg[x] & COMPOSE_SPRITE_ZERO)) {
+                        return true;
+                }
         }
-        // Bg is visible, fg is tranparent.
-        else if (bgPixel > 0 && fgPixel == 0) {
-                pixel = bgPixel;
-                palette = bgPalette;
+        return false;
+}
+
+uint32_t PpuTickScanline(struct ppu *ppu) {
+        if (!ppu->isScanlineRendererEnabled || ppu->scanline < 0 || ppu->scanline >= 240)
+                return 0;
+
+        // PpuTick renders the skipped dot at the start of the first scanline
+        // along with the next one.
+        if (1 != ppu->cycle && !(0 == ppu->scanline && 0 == ppu->cycle))
+                return 0;
+
+        // Nothing can write palette memory until the scanline is done.
+        const uint32_t *colors = OutputColors(ppu);
+
+        uint8_t background[COMPOSE_LINE_WIDTH];
+        RenderBackgroundLine(ppu, background);
+        IncrementScrollY(ppu);
+
+        // The sprites were rasterized when they were fetched; only their
+        // shifters need bringing up to date.
+        static const uint8_t noSprites[COMPOSE_LINE_WIDTH] = {0};
+        const uint8_t *foreground = noSprites;
+        if (ppu->mask.renderSprites) {
+                foreground = ppu->spriteLine;
+                SkipSpriteShifters(ppu);
         }
-        // Bg is visible AND fg is visible.
-        else if (bgPixel > 0 && fgPixel > 0) {
-                if (fgPriority) {
-                        pixel = fgPixel;
-                        palette = fgPalette;
-                } else {
-                        pixel = bgPixel;
-                        palette = bgPalette;
+
+        // Sprite zero hits are detected on the same cycles as in
+        // ComposePixel.
+        int hitStart = COMPOSE_LINE_WIDTH;
+        if (ppu->isSpriteZeroHitPossible && (ppu->mask.renderBackground & ppu->mask.renderSprites)) {
+                hitStart = (~(ppu->mask.renderBackgroundLeft | ppu->mask.renderSpritesLeft)) ? 8 : 0;
+        }
+
+        if (!ppu->isOutputEnabled) {
+                if (IsSpriteZeroHit(background, foreground, hitStart)) {
+                        ppu->status.spriteZeroHit = 1;
                 }
+                ppu->cycle = 257;
+                return 256;
+        }
 
-                if (ppu->isSpriteZeroHitPossible && ppu->isSpriteZeroBeingRendered) {
-                        if (ppu->mask.renderBackground & ppu->mask.renderSprites) {
-                                if (~(ppu->mask.renderBackgroundLeft | ppu->mask.renderSpritesLeft)) {
-                                        if (ppu->cycle >= 9 && ppu->cycle < 258) {
-                                                ppu->status.spriteZeroHit = 1;
-                                        }
-                                } else {
-                                        if (ppu->cycle >= 1 && ppu->cycle < 258) {
-                                                ppu->status.spriteZeroHit = 1;
-                                        }
-                                }
-                        }
+        uint32_t indices[COMPOSE_LINE_WIDTH];
+        uint32_t *row = ppu->isIndexedOutputEnabled ? indices : &ppu->screen->pixels[ppu->scanline * ppu->screen->width];
+        if (ComposeLine(row, background, foreground, colors, hitStart)) {
+                ppu->status.spriteZeroHit = 1;
+        }
+
+        if (ppu->isIndexedOutputEnabled) {
+                uint16_t *indexedRow = &ppu->indexedScreen[ppu->scanline * 256];
+                for (int x = 0; x < COMPOSE_LINE_WIDTH; x++) {
+                        indexedRow[x] = (uint16_t)indices[x];
                 }
         }
 
-        struct color *color = PpuGetColorFromPaletteRam(ppu, palette, pixel);
-        SpriteSetPixel(ppu->screen, ppu->cycle - 1, ppu->scanline, color->rgba);
+        ppu->cycle = 257;
+        return 256;
+}
 
-        ppu->cycle++;
+void PpuSetScanlineRenderer(struct ppu *ppu, bool isEnabled) {
+        ppu->isScanlineRendererEnabled = isEnabled;
+}
 
-        if (341 < ppu->cycle) {
-                ppu->cycle = 0;
-                ppu->scanline++;
+void PpuSetSpriteLimit(struct ppu *ppu, bool isEnabled) {
+        ppu->isSpriteLimitEnabled = isEnabled;
+}
 
-                if (261 < ppu->scanline) {
-                        ppu->scanline = -1;
-                        ppu->isFrameComplete = true;
-                }
-        }
+void PpuSetOutput(struct ppu *ppu, bool isEnabled) {
+        ppu->isOutputEnabled = isEnabled;
+}
+
+void PpuSetIndexedOutput(struct ppu *ppu, bool isEnabled) {
+        ppu->isIndexedOutputEnabled = isEnabled;
+}
+
+const uint16_t *PpuIndexedScreen(struct ppu *ppu) {
+        return ppu->indexedScreen;
 }
 
 uint8_t PpuRead(struct ppu *ppu, uint16_t addr) {
@@ -938,33 +1517,7 @@ uint8_t PpuRead(struct ppu *ppu, uint16_t addr) {
         } else if (addr >= 0x2000 && addr <= 0x3EFF) {
                 addr &= 0x0FFF;
 
-                switch (CartMirroring(ppu->cart)) {
-                        case MIRROR_VERTICAL: {
-                                if (addr >= 0x0000 && addr <= 0x03FF)
-                                        data = ppu->nameTables[0][addr & 0x03FF];
-                                if (addr >= 0x0400 && addr <= 0x07FF)
-                                        data = ppu->nameTables[1][addr & 0x03FF];
-                                if (addr >= 0x0800 && addr <= 0x0BFF)
-                                        data = ppu->nameTables[0][addr & 0x03FF];
-                                if (addr >= 0x0C00 && addr <= 0x0FFF)
-                                        data = ppu->nameTables[1][addr & 0x03FF];
-                        } break;
-
-                        case MIRROR_HORIZONTAL: {
-                                if (addr >= 0x0000 && addr <= 0x03FF)
-                                        data = ppu->nameTables[0][addr & 0x03FF];
-                                if (addr >= 0x0400 && addr <= 0x07FF)
-                                        data = ppu->nameTables[0][addr & 0x03FF];
-                                if (addr >= 0x0800 && addr <= 0x0BFF)
-                                        data = ppu->nameTables[1][addr & 0x03FF];
-                                if (addr >= 0x0C00 && addr <= 0x0FFF)
-                                        data = ppu->nameTables[1][addr & 0x03FF];
-                        } break;
-
-                        default: {
-
-                        } break;
-                }
+                data = ppu->nameTableMap[addr >> 10][addr & 0x03FF];
         } else if (addr >= 0x3F00 && addr <= 0x3FFF) { // Palette Memory.
                 addr &= 0x001F; // Mask the bottom 5 bits.
 
@@ -979,10 +1532,90 @@ uint8_t PpuRead(struct ppu *ppu, uint16_t addr) {
         return data;
 }
 
+//! \brief Mark the cells of the nametable view a nametable write changes
+//!
+//! \param[in,out] ppu
+//! \param[in] nameTable which of the four nametables, 0 to 3
+//! \param[in] offset of the byte written within the nametable
+static void DirtyNameTableCells(struct ppu *ppu, int nameTable, uint16_t offset) {
+        bool *cells = ppu->isNameTableCellDirty[nameTable];
+
+        if (offset < 960) {
+                cells[offset] = true;
+                return;
+        }
+
+        // An attribute byte colors a 4x4 block of cells.
+        int blockX = (offset - 960) % 8;
+        int blockY = (offset - 960) / 8;
+        for (int cellY = blockY * 4; cellY < blockY * 4 + 4 && cellY < 30; cellY++) {
+                for (int cellX = blockX * 4; cellX < blockX * 4 + 4; cellX++) {
+                        cells[cellY * 32 + cellX] = true;
+                }
+        }
+}
+
+//! \brief Outline the screen within the nametable view, or undo an outline
+//!
+//! The screen is 256x240 at the scroll position, wrapping around the view.
+//!
+//! \param[in,out] ppu
+//! \param[in] scroll as vramAddr
+//! \param[in] fineX
+//! \param[in] isDrawn whether to draw the outline, or mark the cells under
+//! it dirty so they're drawn over it
+static void OutlineScroll(struct ppu *ppu, union loopy_register scroll, uint8_t fineX, bool isDrawn) {
+        struct sprite *view = ppu->nameTableView;
+        int left = scroll.nametableX * 256 + scroll.coarseX * 8 + fineX;
+        int top = scroll.nametableY * 240 + scroll.coarseY * 8 + scroll.fineY;
+
+        for (int i = 0; i < 2 * 256 + 2 * 240; i++) {
+                int x;
+                int y;
+                if (i < 512) {
+                        // Top and bottom edges.
+                        x = left + (i % 256);
+                        y = top + ((i < 256) ? 0 : 239);
+                } else {
+                        // Left and right edges.
+                        x = left + ((i < 512 + 240) ? 0 : 255);
+                        y = top + ((i - 512) % 240);
+                }
+                x %= 512;
+                y %= 480;
+
+                if (isDrawn) {
+                        view->pixels[y * view->width + x] = ColorRed.rgba;
+                } else {
+                        ppu->isNameTableCellDirty[(y / 240) * 2 + x / 256][((y % 240) / 8) * 32 + (x % 256) / 8] = true;
+                }
+        }
+}
+
 void PpuWrite(struct ppu *ppu, uint16_t addr, uint8_t data) {
         addr &= 0x3FFF; // 0x3FFFF is PPU base memory.
 
+        // The nametable view redraws the cells showing whatever changed.
+        if (addr >= 0x2000 && addr < 0x3F00) {
+                uint8_t *nameTable = ppu->nameTableMap[(addr >> 10) & 0x03];
+                for (int i = 0; i < 4; i++) {
+                        if (ppu->nameTableMap[i] == nameTable) {
+                                DirtyNameTableCells(ppu, i, addr & 0x03FF);
+                        }
+                }
+        }
+
         if (CartPpuWrite(ppu->cart, addr, data)) {
+                // Chr RAM: the pattern table views redraw the tile, and the
+                // nametable view the cells showing it, if it's drawn from this
+                // table.
+                if (addr < 0x2000) {
+                        ppu->isPatternTileDirty[addr >> 12][(addr >> 4) & 0xFF] = true;
+                        if ((addr >> 12) == ppu->control.patternBackground) {
+                                ppu->isNameTableTileDirty[(addr >> 4) & 0xFF] = true;
+                                ppu->isAnyNameTableTileDirty = true;
+                        }
+                }
         } else if (addr >= 0x0000 && addr <= 0x1FFF) { // Pattern Memory.
                 // Pattern memory is _usually_ a ROM, but we support writes here
                 // as well.
@@ -993,33 +1626,7 @@ void PpuWrite(struct ppu *ppu, uint16_t addr, uint8_t data) {
         } else if (addr >= 0x2000 && addr <= 0x3EFF) {
                 addr &= 0x0FFF;
 
-                switch (CartMirroring(ppu->cart)) {
-                        case MIRROR_VERTICAL: {
-                                if (addr >= 0x0000 && addr <= 0x03FF)
-                                        ppu->nameTables[0][addr & 0x03FF] = data;
-                                if (addr >= 0x0400 && addr <= 0x07FF)
-                                        ppu->nameTables[1][addr & 0x03FF] = data;
-                                if (addr >= 0x0800 && addr <= 0x0BFF)
-                                        ppu->nameTables[0][addr & 0x03FF] = data;
-                                if (addr >= 0x0C00 && addr <= 0x0FFF)
-                                        ppu->nameTables[1][addr & 0x03FF] = data;
-                        } break;
-
-                        case MIRROR_HORIZONTAL: {
-                                if (addr >= 0x0000 && addr <= 0x03FF)
-                                        ppu->nameTables[0][addr & 0x03FF] = data;
-                                if (addr >= 0x0400 && addr <= 0x07FF)
-                                        ppu->nameTables[0][addr & 0x03FF] = data;
-                                if (addr >= 0x0800 && addr <= 0x0BFF)
-                                        ppu->nameTables[1][addr & 0x03FF] = data;
-                                if (addr >= 0x0C00 && addr <= 0x0FFF)
-                                        ppu->nameTables[1][addr & 0x03FF] = data;
-                        } break;
-
-                        default: {
-
-                        } break;
-                }
+                ppu->nameTableMap[addr >> 10][addr & 0x03FF] = data;
         } else if (addr >= 0x3F00 && addr <= 0x3FFF) { // Palette Memory.
                 addr &= 0x001F; // Mask the bottom 5 bits.
 
@@ -1028,11 +1635,60 @@ void PpuWrite(struct ppu *ppu, uint16_t addr, uint8_t data) {
                 if (addr == 0x0014) addr = 0x0004;
                 if (addr == 0x0018) addr = 0x0008;
                 if (addr == 0x001C) addr = 0x000C;
-                ppu->paletteTables[addr] = data;
+                if (ppu->paletteTables[addr] != data) {
+                        ppu->paletteTables[addr] = data;
+                        ppu->isPaletteDirty = true;
+                }
+        }
+}
+
+//! \brief Record a cpu access in the timeline, where the ppu is now
+static void RecordAccess(struct ppu *ppu, enum timeline_kind kind, uint16_t addr, uint8_t data) {
+        struct timeline_entry entry = {
+                ppu->frameCount, ppu->scanline, (uint16_t)ppu->cycle, addr, data, kind,
+        };
+        TimelineRecord(ppu->timeline, entry);
+}
+
+void PpuSetTimeline(struct ppu *ppu, struct timeline *timeline) {
+        ppu->timeline = timeline;
+}
+
+struct timeline *PpuGetTimeline(struct ppu *ppu) {
+        return ppu->timeline;
+}
+
+void PpuRecordOamDma(struct ppu *ppu, uint8_t page) {
+        if (NULL != ppu->timeline) {
+                RecordAccess(ppu, TIMELINE_WRITE, 0x4014, page);
+        }
+}
+
+void PpuWriteOamViaDma(struct ppu *ppu, uint8_t addr, uint8_t data) {
+        if (NULL != ppu->timeline) {
+                RecordAccess(ppu, TIMELINE_OAM_DMA, addr, data);
         }
+
+        PpuWriteOam(ppu, addr, data);
+}
+
+uint32_t PpuFrameCount(struct ppu *ppu) {
+        return ppu->frameCount;
+}
+
+int16_t PpuScanline(struct ppu *ppu) {
+        return ppu->scanline;
+}
+
+int16_t PpuCycle(struct ppu *ppu) {
+        return ppu->cycle;
 }
 
 void PpuWriteViaCpu(struct ppu *ppu, uint16_t addr, uint8_t data) {
+        if (NULL != ppu->timeline) {
+                RecordAccess(ppu, TIMELINE_WRITE, 0x2000 | addr, data);
+        }
+
         switch(addr) {
                 case 0x0000: // Control
                         ppu->control.reg = data;
@@ -1041,6 +1697,10 @@ void PpuWriteViaCpu(struct ppu *ppu, uint16_t addr, uint8_t data) {
                 break;
 
                 case 0x0001: // Mask
+                        // Grayscale and the emphasis bits change every color.
+                        if ((ppu->mask.reg ^ data) & 0xE1) {
+                                ppu->isPaletteDirty = true;
+                        }
                         ppu->mask.reg = data;
                 break;
 
@@ -1052,7 +1712,7 @@ void PpuWriteViaCpu(struct ppu *ppu, uint16_t addr, uint8_t data) {
                 break;
 
                 case 0x0004: // OAM Data
-                        PpuGetOam(ppu)[ppu->oamAddr] = data;
+                        PpuWriteOam(ppu, ppu->oamAddr, data);
                 break;
 
                 case 0x0005: // Scroll
@@ -1175,68 +1835,76 @@ uint8_t PpuReadViaCpu(struct ppu *ppu, uint16_t addr, bool readOnly) {
                                 ppu->vramAddr.reg += (ppu->control.incrementMode ? 32 : 1);
                                 break;
                 }
+
+                // Only these reads change the ppu.
+                if (NULL != ppu->timeline && (0x0002 == addr || 0x0007 == addr)) {
+                        RecordAccess(ppu, TIMELINE_READ, 0x2000 | addr, data);
+                }
         }
         return data;
 }
 
 
-struct color *PpuGetColorFromPaletteRam(struct ppu *ppu, uint8_t palette, uint8_t pixel) {
-        // Multiply the palette by 4 to get the physical offset.
-        uint16_t palette_id = palette << 2;
+bool PpuLoadPalette(struct ppu *ppu, const char *filename) {
+        if (!ColorLoadPalette(ppu->palette, filename)) {
+                return false;
+        }
+        ppu->isPaletteDirty = true;
+        return true;
+}
 
-        uint16_t addr = 0x3F00 + // Base address of palette memory.
-                palette_id + // Which palette to read.
-                pixel; // Offset of the specific color for this palette.
+const uint32_t *PpuGetPaletteColors(struct ppu *ppu) {
+        return PaletteColors(ppu);
+}
 
-        // "& 0x3F" Stops read past the bounds of ppu->palette.
-        return &ppu->palette[PpuRead(ppu, addr) & 0x3F];
+struct color PpuGetColorFromPaletteRam(struct ppu *ppu, uint8_t palette, uint8_t pixel) {
+        // Multiply the palette by 4 to get the physical offset.
+        return ColorInitInt(PaletteColors(ppu)[((palette << 2) + pixel) & 0x1F]);
 }
 
 struct sprite *PpuGetPatternTable(struct ppu *ppu, uint8_t i, uint8_t palette) {
+        const uint32_t *colors = PaletteColors(ppu);
+        struct sprite *view = ppu->patternTableSprites[i];
+
+        // Every tile changes color with the palette.
+        bool isRedrawn = ppu->patternTableGeneration[i] != ppu->paletteGeneration || ppu->patternTablePalette[i] != palette;
+        ppu->patternTableGeneration[i] = ppu->paletteGeneration;
+        ppu->patternTablePalette[i] = palette;
+
+        // Mappers switching chr banks change the decoded rows a bank maps to.
+        for (int bank = 0; bank < 4; bank++) {
+                const uint8_t *rows = CartPpuTileRow(ppu->cart, i * CHR_ROM + bank * 0x0400, false);
+                if (rows != ppu->patternTableBanks[i][bank]) {
+                        ppu->patternTableBanks[i][bank] = rows;
+                        memset(&ppu->isPatternTileDirty[i][bank * 64], true, 64);
+                }
+        }
+
         // Loop through all 16x16 tiles
-        for (uint16_t tileY = 0; tileY < 16; tileY++) {
-                for (uint16_t tileX = 0; tileX < 16; tileX++) {
-                        // Convert the 2D tile coordinate into a 1D offset into pattern table memory.
-                        uint16_t byteOffset = tileY * 256 + tileX * 16;
-
-                        // Loop through 8 rows of 8 pixels per tile.
-                        for (uint16_t row = 0; row < 8; row++) {
-                                // Each pixel is 2 bits, stored in two separate bit planes.
-                                // Each bit plane is 64 bits, which means the LSb
-                                // and MSb are always 64 bits (8 bytes) apart.
-                                uint8_t tileLsb = PpuRead(ppu, i * CHR_ROM + byteOffset + row + 0x0000);
-                                uint8_t tileMsb = PpuRead(ppu, i * CHR_ROM + byteOffset + row + 0x0008);
-
-                                // We read 8 bits worth of data, now we iterate
-                                // through each column of the current row.
-                                for (uint16_t col = 0; col < 8; col++) {
-                                        uint8_t pixel = ((tileLsb & 0x01) << 1) | (tileMsb & 0x01);
-
-                                        // Shift each byte right one bit so the
-                                        // next iteration works on the next
-                                        // column.
-                                        tileLsb >>= 1;
-                                        tileMsb >>= 1;
-
-                                        struct color *color = PpuGetColorFromPaletteRam(ppu, palette, pixel);
-
-                                        // Because we are reading the LSb first,
-                                        // we are effectively reading right to
-                                        // left; so when we draw, we need to
-                                        // make sure we are drawing in the right
-                                        // order. Note that our index starts at
-                                        // the left but our pixel is on the
-                                        // right.
-                                        int x = tileX * 8 + (7 - col);
-                                        int y = tileY * 8 + row;
-
-                                        SpriteSetPixel(ppu->patternTableSprites[i], x, y, color->rgba);
-                                }
+        for (uint16_t tile = 0; tile < 256; tile++) {
+                if (!isRedrawn && !ppu->isPatternTileDirty[i][tile]) {
+                        continue;
+                }
+                ppu->isPatternTileDirty[i][tile] = false;
+
+                uint16_t tileX = tile & 0x0F;
+                uint16_t tileY = tile >> 4;
+
+                // Loop through 8 rows of 8 pixels per tile.
+                for (uint16_t row = 0; row < 8; row++) {
+                        // Each row comes already decoded from the two bit
+                        // planes, left to right.
+                        uint8_t scratch[8];
+                        const uint8_t *pixels = PatternRow(ppu, i * CHR_ROM + tile * 16 + row, false, scratch);
+
+                        uint32_t *out = &view->pixels[(tileY * 8 + row) * view->width + tileX * 8];
+                        for (uint16_t col = 0; col < 8; col++) {
+                                out[col] = colors[((palette << 2) + pixels[col]) & 0x1F];
                         }
                 }
         }
 
-        return ppu->patternTableSprites[i];
+        return view;
 }
 
 void PpuReset(struct ppu *ppu) {
@@ -1255,6 +1923,7 @@ void PpuReset(struct ppu *ppu) {
 	ppu->bgShifterAttribHi = 0x0000;
 	ppu->status.reg = 0x00;
 	ppu->mask.reg = 0x00;
+	ppu->isPaletteDirty = true;
 	ppu->control.reg = 0x00;
 	ppu->vramAddr.reg = 0x0000;
 	ppu->tramAddr.reg = 0x0000;
@@ -1269,6 +1938,9 @@ void PpuResetFrameCompletion(struct ppu *ppu) {
 }
 
 struct sprite *PpuScreen(struct ppu *ppu) {
+        if (ppu->isIndexedOutputEnabled) {
+                ColorConvertIndexed(ppu->screen->pixels, COLOR_FORMAT_RGBA8888, ppu->indexedScreen, 256 * 240, ppu->palette);
+        }
         return ppu->screen;
 }
 
@@ -1280,10 +1952,300 @@ void PpuSetNmi(struct ppu *ppu, uint8_t trueOrFalse) {
         ppu->nmi = trueOrFalse;
 }
 
-struct sprite *PpuGetNameTable(struct ppu *ppu, uint8_t i) {
-        return ppu->nameTableSprites[i];
+struct sprite *PpuGetNameTables(struct ppu *ppu) {
+        const uint32_t *colors = PaletteColors(ppu);
+        struct sprite *view = ppu->nameTableView;
+        uint16_t patterns = ppu->control.patternBackground * CHR_ROM;
+
+        // Every cell changes with the colors, or with which background
+        // patterns are mapped.
+        bool isRedrawn = ppu->isNameTableViewStale ||
+                ppu->nameTableViewGeneration != ppu->paletteGeneration ||
+                ppu->nameTableViewPattern != ppu->control.patternBackground;
+        for (int bank = 0; bank < 4; bank++) {
+                const uint8_t *rows = CartPpuTileRow(ppu->cart, patterns + bank * 0x0400, false);
+                if (rows != ppu->nameTableViewBanks[bank]) {
+                        ppu->nameTableViewBanks[bank] = rows;
+                        isRedrawn = true;
+                }
+        }
+        ppu->isNameTableViewStale = false;
+        ppu->nameTableViewGeneration = ppu->paletteGeneration;
+        ppu->nameTableViewPattern = ppu->control.patternBackground;
+
+        // So do the cells of a nametable mirrored elsewhere.
+        for (int i = 0; i < 4; i++) {
+                if (ppu->nameTableViewMap[i] != ppu->nameTableMap[i]) {
+                        ppu->nameTableViewMap[i] = ppu->nameTableMap[i];
+                        memset(ppu->isNameTableCellDirty[i], true, sizeof(ppu->isNameTableCellDirty[i]));
+                }
+        }
+
+        // Uncover the cells under the last outline if it moves.
+        if (ppu->viewRectScroll.reg != ppu->viewScroll.reg || ppu->viewRectFineX != ppu->viewFineX) {
+                OutlineScroll(ppu, ppu->viewRectScroll, ppu->viewRectFineX, false);
+                ppu->viewRectScroll = ppu->viewScroll;
+                ppu->viewRectFineX = ppu->viewFineX;
+        }
+
+        for (int i = 0; i < 4; i++) {
+                const uint8_t *nameTable = ppu->nameTableMap[i];
+                int left = (i & 0x01) * 256;
+                int top = (i >> 1) * 240;
+
+                for (int cell = 0; cell < 960; cell++) {
+                        bool isTileDirty = ppu->isAnyNameTableTileDirty && ppu->isNameTableTileDirty[nameTable[cell]];
+                        if (!isRedrawn && !ppu->isNameTableCellDirty[i][cell] && !isTileDirty) {
+                                continue;
+                        }
+                        ppu->isNameTableCellDirty[i][cell] = false;
+
+                        int cellX = cell % 32;
+                        int cellY = cell / 32;
+
+                        // Each attribute byte covers 4x4 cells, 2 bits per 2x2.
+                        uint8_t attribute = nameTable[0x03C0 + (cellY / 4) * 8 + cellX / 4];
+                        uint8_t palette = (attribute >> (((cellY & 0x02) << 1) | (cellX & 0x02))) & 0x03;
+
+                        for (int row = 0; row < 8; row++) {
+                                uint8_t scratch[8];
+                                const uint8_t *pixels = PatternRow(ppu, patterns + nameTable[cell] * 16 + row, false, scratch);
+
+                                uint32_t *out = &view->pixels[(top + cellY * 8 + row) * view->width + left + cellX * 8];
+                                for (int col = 0; col < 8; col++) {
+                                        // Transparent pixels show the backdrop.
+                                        out[col] = colors[pixels[col] ? (palette << 2) + pixels[col] : 0];
+                                }
+                        }
+                }
+        }
+
+        if (ppu->isAnyNameTableTileDirty) {
+                memset(ppu->isNameTableTileDirty, false, sizeof(ppu->isNameTableTileDirty));
+                ppu->isAnyNameTableTileDirty = false;
+        }
+
+        OutlineScroll(ppu, ppu->viewRectScroll, ppu->viewRectFineX, true);
+
+        return view;
 }
 
-uint8_t *PpuGetOam(struct ppu *ppu) {
+void PpuWriteOam(struct ppu *ppu, uint8_t addr, uint8_t data) {
+        ((uint8_t *)ppu->oam)[addr] = data;
+
+        uint8_t sprite = addr >> 2;
+        switch (addr & 0x03) {
+                case 0: ppu->oamY[sprite] = data; break;
+                case 1: ppu->oamId[sprite] = data; break;
+                case 2: ppu->oamAttribute[sprite] = data; break;
+                case 3: ppu->oamX[sprite] = data; break;
+        }
+}
+
+const uint8_t *PpuGetOam(struct ppu *ppu) {
         return (uint8_t *)ppu->oam;
 }
+
+//! \brief Write bytes of state to a file, or read them back
+static bool StateBytes(FILE *file, bool isLoading, uint8_t *bytes, size_t count) {
+        if (isLoading) {
+                return count == fread(bytes, 1, count, file);
+        }
+        return count == fwrite(bytes, 1, count, file);
+}
+
+//! \brief StateBytes for a 16 bit value, little endian
+static bool StateWord(FILE *file, bool isLoading, uint16_t *value) {
+        uint8_t bytes[2] = { *value & 0xFF, *value >> 8 };
+        if (!StateBytes(file, isLoading, bytes, 2)) {
+                return false;
+        }
+        *value = bytes[0] | (bytes[1] << 8);
+        return true;
+}
+
+//! \brief StateBytes for a bool, as one byte
+static bool StateBool(FILE *file, bool isLoading, bool *value) {
+        uint8_t byte = *value;
+        if (!StateBytes(file, isLoading, &byte, 1)) {
+                return false;
+        }
+        *value = 0 != byte;
+        return true;
+}
+
+//! \brief Save or load everything PpuSaveState covers, in the same order
+static bool State(struct ppu *ppu, FILE *file, bool isLoading) {
+        uint16_t frameLo = ppu->frameCount & 0xFFFF;
+        uint16_t frameHi = ppu->frameCount >> 16;
+        bool isOk = StateWord(file, isLoading, &frameLo) && StateWord(file, isLoading, &frameHi);
+        ppu->frameCount = frameLo | ((uint32_t)frameHi << 16);
+
+        isOk = isOk && StateWord(file, isLoading, (uint16_t *)&ppu->scanline);
+        isOk = isOk && StateWord(file, isLoading, (uint16_t *)&ppu->cycle);
+        isOk = isOk && StateBool(file, isLoading, &ppu->isFrameComplete);
+
+        // Pattern memory may be the cart's rom or ram, so go through PpuRead
+        // and PpuWrite.
+        uint8_t patterns[0x2000];
+        if (!isLoading) {
+                for (int addr = 0; addr < 0x2000; addr++) {
+                        patterns[addr] = PpuRead(ppu, addr);
+                }
+        }
+        isOk = isOk && StateBytes(file, isLoading, patterns, sizeof(patterns));
+        if (isOk && isLoading) {
+                for (int addr = 0; addr < 0x2000; addr++) {
+                        PpuWrite(ppu, addr, patterns[addr]);
+                }
+        }
+
+        // Each of the four, whichever memory they're mirrored to.
+        for (int i = 0; i < 4; i++) {
+                isOk = isOk && StateBytes(file, isLoading, ppu->nameTableMap[i], NAME_TABLE_SIZE);
+        }
+        isOk = isOk && StateBytes(file, isLoading, ppu->paletteTables, 32);
+
+        isOk = isOk && StateBytes(file, isLoading, &ppu->mask.reg, 1);
+        isOk = isOk && StateBytes(file, isLoading, &ppu->status.reg, 1);
+        isOk = isOk && StateBytes(file, isLoading, &ppu->control.reg, 1);
+
+        isOk = isOk && StateBytes(file, isLoading, (uint8_t *)ppu->oam, sizeof(ppu->oam));
+        if (isOk && isLoading) {
+                for (int addr = 0; addr < 256; addr++) {
+                        PpuWriteOam(ppu, addr, ((uint8_t *)ppu->oam)[addr]);
+                }
+        }
+        isOk = isOk && StateBytes(file, isLoading, &ppu->oamAddr, 1);
+
+        isOk = isOk && StateBytes(file, isLoading, &ppu->spriteCount, 1);
+        isOk = isOk && StateBytes(file, isLoading, (uint8_t *)ppu->scanlineSprites, sizeof(ppu->scanlineSprites));
+        isOk = isOk && StateBytes(file, isLoading, ppu->spriteShifterPatternLo, 8);
+        isOk = isOk && StateBytes(file, isLoading, ppu->spriteShifterPatternHi, 8);
+        isOk = isOk && StateBytes(file, isLoading, ppu->spriteLine, 256);
+        isOk = isOk && StateBytes(file, isLoading, &ppu->extraSpriteCount, 1);
+        isOk = isOk && StateBytes(file, isLoading, (uint8_t *)ppu->extraSprites, sizeof(ppu->extraSprites));
+
+        isOk = isOk && StateWord(file, isLoading, &ppu->vramAddr.reg);
+        isOk = isOk && StateWord(file, isLoading, &ppu->tramAddr.reg);
+        isOk = isOk && StateBytes(file, isLoading, &ppu->fineX, 1);
+        isOk = isOk && StateBytes(file, isLoading, &ppu->addressLatch, 1);
+        isOk = isOk && StateBytes(file, isLoading, &ppu->dataBuffer, 1);
+        isOk = isOk && StateWord(file, isLoading, &ppu->address);
+
+        isOk = isOk && StateBytes(file, isLoading, &ppu->bgNextTileId, 1);
+        isOk = isOk && StateBytes(file, isLoading, &ppu->bgNextTileAttrib, 1);
+        isOk = isOk && StateBytes(file, isLoading, &ppu->bgNextTileLsb, 1);
+        isOk = isOk && StateBytes(file, isLoading, &ppu->bgNextTileMsb, 1);
+        isOk = isOk && StateWord(file, isLoading, &ppu->bgShifterPatternLo);
+        isOk = isOk && StateWord(file, isLoading, &ppu->bgShifterPatternHi);
+        isOk = isOk && StateWord(file, isLoading, &ppu->bgShifterAttribLo);
+        isOk = isOk && StateWord(file, isLoading, &ppu->bgShifterAttribHi);
+
+        isOk = isOk && StateBool(file, isLoading, &ppu->nmi);
+        isOk = isOk && StateBool(file, isLoading, &ppu->isSpriteZeroHitPossible);
+        isOk = isOk && StateBool(file, isLoading, &ppu->isSpriteZeroBeingRendered);
+
+        return isOk;
+}
+
+bool PpuSaveState(struct ppu *ppu, FILE *file) {
+        return State(ppu, file, false);
+}
+
+bool PpuLoadState(struct ppu *ppu, FILE *file) {
+        if (!State(ppu, file, true)) {
+                return false;
+        }
+
+        ppu->isPaletteDirty = true;
+        ppu->isNameTableViewStale = true;
+        return true;
+}
+
+//! \brief Position of the dot rendered at scanline, cycle within a frame
+static int32_t DotIndex(int scanline, int cycle) {
+        int32_t index = (scanline + 1) * 342 + cycle;
+        if (scanline > 0 || (scanline == 0 && cycle > 0)) {
+                index--;
+        }
+        return index;
+}
+
+//! \brief Count the ticks up to and including the one which renders the given dot
+static uint32_t TicksUntilDot(struct ppu *ppu, int scanline, int cycle) {
+        int32_t delta = DotIndex(scanline, cycle) - DotIndex(ppu->scanline, ppu->cycle);
+        if (delta < 0) {
+                delta += DOTS_PER_FRAME;
+        }
+        return delta + 1;
+}
+
+uint32_t PpuTicksUntilNmi(struct ppu *ppu) {
+        if (!ppu->control.enableNmi) {
+                return 0;
+        }
+        return PpuTicksUntilVblank(ppu);
+}
+
+uint32_t PpuTicksUntilVblank(struct ppu *ppu) {
+        return TicksUntilDot(ppu, 241, 1);
+}
+
+uint32_t PpuTicksUntilFrameComplete(struct ppu *ppu) {
+        return TicksUntilDot(ppu, 261, 341);
+}
+
+uint32_t PpuTicksUntilSpriteEvaluation(struct ppu *ppu) {
+        int scanline = 0;
+        if (ppu->scanline >= 0 && ppu->scanline < 240) {
+                scanline = (ppu->cycle <= 257) ? ppu->scanline : ppu->scanline + 1;
+        }
+        if (scanline >= 240) {
+                scanline = 0;
+        }
+        return TicksUntilDot(ppu, scanline, 257);
+}
+
+//! \brief Whether a scanline still to be evaluated this frame has more than 8
+//! sprites
+static bool IsSpriteOverflowAhead(struct ppu *ppu) {
+        int scanline = 0;
+        if (ppu->scanline >= 0) {
+                scanline = (ppu->cycle <= 257) ? ppu->scanline : ppu->scanline + 1;
+        }
+
+        uint8_t height = ppu->control.spriteSize ? 16 : 8;
+        for (; scanline < 240; scanline++) {
+                if (__builtin_popcountll(OamHits(ppu, (uint8_t)scanline, height)) > 8) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+uint32_t PpuTicksUntilStatusChange(struct ppu *ppu, uint8_t *data) {
+        *data = (ppu->status.reg & 0xE0) | (ppu->dataBuffer & 0x1F);
+
+        // A read would clear the vertical blank flag or the address latch.
+        if (ppu->status.verticalBlank || ppu->addressLatch) {
+                return 0;
+        }
+
+        // Until vertical blank starts, only a sprite zero hit or a scanline
+        // with too many sprites can set a flag.
+        if (ppu->scanline < 240 && !(-1 == ppu->scanline && 0 == ppu->cycle)) {
+                if (ppu->mask.renderBackground && ppu->mask.renderSprites && !ppu->status.spriteZeroHit) {
+                        return 0;
+                }
+                if (!ppu->status.spriteOverflow && IsSpriteOverflowAhead(ppu)) {
+                        return 0;
+                }
+                return TicksUntilDot(ppu, 241, 1);
+        }
+
+        if (240 == ppu->scanline || (241 == ppu->scanline && ppu->cycle <= 1)) {
+                return TicksUntilDot(ppu, 241, 1);
+        }
+        return TicksUntilDot(ppu, -1, 1);
+}
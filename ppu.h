@@ -4,7 +4,7 @@
 
   File: ppu.h
   Created: 2019-11-03
-  Updated: 2019-12-06
+  Updated: 2019-12-17
   Author: Aaron Oman
   Notice: GNU AGPLv3 License
 
@@ -19,9 +19,11 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h> // FILE
 
 struct ppu;
 struct cart;
+struct timeline;
 struct sprite;
 struct color;
 
@@ -34,9 +36,69 @@ PpuDeinit(struct ppu *ppu);
 void
 PpuAttachCart(struct ppu *ppu, struct cart *cart);
 
+//! \brief Map the four nametables onto memory as the cart's mirroring says
+//!
+//! Called when the cart is attached; call again whenever the mapper may have
+//! changed the mirroring.
+//!
+//! \param[in,out] ppu
+void
+PpuUpdateMirroring(struct ppu *ppu);
+
 void
 PpuTick(struct ppu *ppu);
 
+//! \brief Render the visible part of a scanline in one go
+//!
+//! Equivalent to calling PpuTick until cycle 257 of the current scanline, for
+//! use when nothing will access the ppu in the meantime.  Only renders from
+//! the start of a visible scanline; sprite evaluation and the fetches for the
+//! next scanline are left to PpuTick.
+//!
+//! \param[in,out] ppu
+//! \return the number of ticks run, or 0 if the ppu isn't at the start of a
+//! visible scanline or the scanline renderer is disabled
+uint32_t
+PpuTickScanline(struct ppu *ppu);
+
+//! \brief Enable or disable PpuTickScanline, which is enabled by default
+//!
+//! With the scanline renderer disabled every dot is rendered by PpuTick.
+void
+PpuSetScanlineRenderer(struct ppu *ppu, bool isEnabled);
+
+//! \brief Enable or disable the limit of 8 sprites per scanline
+//!
+//! With the limit disabled, sprites past the eighth on a scanline are drawn
+//! behind the first eight, removing the flicker games use to show more.
+//! Sprite overflow and sprite zero hits are unaffected.  Enabled by default.
+void
+PpuSetSpriteLimit(struct ppu *ppu, bool isEnabled);
+
+//! \brief Enable or disable writing pixels to the screen
+//!
+//! With output disabled the ppu keeps all of its timing, including sprite
+//! zero hits, but skips compositing and writing pixels; the screen keeps the
+//! last frame output.  Runners skipping frames disable it for the frames they
+//! won't show.  Enabled by default.
+void
+PpuSetOutput(struct ppu *ppu, bool isEnabled);
+
+//! \brief Enable or disable writing NES color indices rather than colors
+//!
+//! With indexed output the ppu writes each pixel to PpuIndexedScreen, and
+//! PpuScreen converts the whole frame to colors when it's asked for, so
+//! frames that are never shown are never converted.  Disabled by default.
+void
+PpuSetIndexedOutput(struct ppu *ppu, bool isEnabled);
+
+//! \brief The screen as NES color indices, when indexed output is enabled
+//!
+//! 256x240 indices, each the NES color in the low 6 bits and the emphasis
+//! bits above them; see ColorConvertIndexed.
+const uint16_t *
+PpuIndexedScreen(struct ppu *ppu);
+
 void
 PpuReset(struct ppu *ppu);
 
@@ -46,11 +108,18 @@ PpuIsFrameComplete(struct ppu *ppu);
 void
 PpuResetFrameCompletion(struct ppu *ppu);
 
+//! \brief The screen as colors
+//!
+//! With indexed output enabled, converts PpuIndexedScreen on every call.
 struct sprite *
 PpuScreen(struct ppu *ppu);
 
 //! \brief Draws CHR ROM for a given pattern table into a sprite
 //!
+//! Only tiles that changed since the last call are drawn again: tiles written
+//! through the ppu or switched in by the mapper, or every tile when the
+//! palette or its colors change.
+//!
 //! \param[in,out] ppu
 //! \param[in] i which pattern table to draw
 //! \param[in] palette which palette to use
@@ -63,15 +132,79 @@ PpuGetPatternTable(struct ppu *ppu, uint8_t i, uint8_t palette);
 //! \param[in,out] ppu
 //! \param[in] palette which palette to use for color
 //! \param[in] pixel 0, 1, 2 or 3
-struct color *
+struct color
 PpuGetColorFromPaletteRam(struct ppu *ppu, uint8_t palette, uint8_t pixel);
 
+//! \brief Replace the colors the ppu produces with those of a .pal file
+//!
+//! See ColorLoadPalette.
+//!
+//! \param[in,out] ppu
+//! \param[in] filename
+//! \return false if the file couldn't be loaded; the colors are unchanged
+bool
+PpuLoadPalette(struct ppu *ppu, const char *filename);
+
+//! \brief Get all of palette memory as colors
+//!
+//! The colors are cached, and only resolved again after palette memory or
+//! the grayscale or emphasis bits change.
+//!
+//! \param[in,out] ppu
+//! \return 32 rgba colors, indexed by (palette << 2) + pixel
+const uint32_t *
+PpuGetPaletteColors(struct ppu *ppu);
+
 uint8_t
 PpuReadViaCpu(struct ppu *ppu, uint16_t addr, bool readOnly);
 
 void
 PpuWriteViaCpu(struct ppu *ppu, uint16_t addr, uint8_t data);
 
+//! \brief Record every cpu access to the ppu in a timeline
+//!
+//! Writes through PpuWriteViaCpu, reads through PpuReadViaCpu that change the
+//! ppu, and OAM DMA through PpuRecordOamDma and PpuWriteOamViaDma, are
+//! recorded with the frame, scanline and cycle the ppu is on.  That's enough
+//! to replay what the ppu did from a state saved by PpuSaveState.  With no
+//! timeline, recording costs a single branch per access.
+//!
+//! \param[in,out] ppu
+//! \param[in] timeline the timeline to record to, or NULL to stop recording;
+//! the caller keeps ownership
+void
+PpuSetTimeline(struct ppu *ppu, struct timeline *timeline);
+
+struct timeline *
+PpuGetTimeline(struct ppu *ppu);
+
+//! \brief Record a write to $4014 in the timeline, if recording
+//!
+//! \param[in,out] ppu
+//! \param[in] page the page DMA copies from
+void
+PpuRecordOamDma(struct ppu *ppu, uint8_t page);
+
+//! \brief PpuWriteOam for OAM DMA, recording the byte in the timeline
+//!
+//! \param[in,out] ppu
+//! \param[in] addr
+//! \param[in] data
+void
+PpuWriteOamViaDma(struct ppu *ppu, uint8_t addr, uint8_t data);
+
+//! \return the number of frames the ppu has completed
+uint32_t
+PpuFrameCount(struct ppu *ppu);
+
+//! \return the scanline the ppu will render next, from -1 to 260
+int16_t
+PpuScanline(struct ppu *ppu);
+
+//! \return the cycle of the scanline the ppu will render next
+int16_t
+PpuCycle(struct ppu *ppu);
+
 uint8_t
 PpuRead(struct ppu *ppu, uint16_t addr);
 
@@ -84,10 +217,102 @@ PpuGetNmi(struct ppu *ppu);
 void
 PpuSetNmi(struct ppu *ppu, uint8_t trueOrFalse);
 
+//! \brief Draws all four nametables into a sprite, outlining the screen
+//!
+//! The nametables are laid out two by two, 512x480, as the ppu scrolls
+//! through them.  The outline is the screen at the scroll the last frame
+//! started from.  Only cells whose tile or attribute was written since the
+//! last call are drawn again, or every cell when the colors, background
+//! patterns or mirroring change.
+//!
+//! \param[in,out] ppu
+//! \return a sprite of the nametables
 struct sprite *
-PpuGetNameTable(struct ppu *ppu, uint8_t i);
+PpuGetNameTables(struct ppu *ppu);
 
-uint8_t *
+//! \brief OAM as the cpu sees it, 4 bytes per sprite: y, id, attribute, x
+//!
+//! Read only; write OAM through PpuWriteOam.
+const uint8_t *
 PpuGetOam(struct ppu *ppu);
 
+//! \brief Write a byte of OAM, as $2004 and OAM DMA do
+//!
+//! \param[in,out] ppu
+//! \param[in] addr offset into OAM; see PpuGetOam
+//! \param[in] data
+void
+PpuWriteOam(struct ppu *ppu, uint8_t addr, uint8_t data);
+
+//! \brief Save everything that decides what the ppu draws from here on
+//!
+//! That's the ppu's registers, position in the frame and memory, including
+//! pattern memory and nametables on the cart.  Not the mapper's state, so a
+//! state only loads back into a ppu attached to a cart in the same state.
+//!
+//! \param[in] ppu
+//! \param[in,out] file
+//! \return false if the file couldn't be written
+bool
+PpuSaveState(struct ppu *ppu, FILE *file);
+
+//! \brief Restore a state saved by PpuSaveState
+//!
+//! \param[in,out] ppu attached to the cart the state was saved with
+//! \param[in,out] file
+//! \return false if the file couldn't be read, leaving the ppu partly loaded
+bool
+PpuLoadState(struct ppu *ppu, FILE *file);
+
+//! \brief Number of ticks until the ppu raises its next nmi
+//!
+//! Only valid until the control register is next written.
+//!
+//! \param[in] ppu
+//! \return ticks up to and including the one raising the nmi, or 0 if nmi is
+//! disabled
+uint32_t
+PpuTicksUntilNmi(struct ppu *ppu);
+
+//! \brief Number of ticks until the ppu next enters vblank
+//!
+//! Unlike PpuTicksUntilNmi, valid until the ppu is next ticked, since every
+//! frame is the same length.
+//!
+//! \param[in] ppu
+//! \return ticks up to and including the one setting the vblank flag
+uint32_t
+PpuTicksUntilVblank(struct ppu *ppu);
+
+//! \brief Number of ticks until the ppu finishes the current frame
+//!
+//! \param[in] ppu
+//! \return ticks up to and including the one completing the frame
+uint32_t
+PpuTicksUntilFrameComplete(struct ppu *ppu);
+
+//! \brief Number of ticks until the ppu next reads OAM
+//!
+//! Sprites for the next scanline are evaluated from OAM at cycle 257 of each
+//! visible scanline; OAM isn't read anywhere else while rendering.
+//!
+//! \param[in] ppu
+//! \return ticks up to and including the one evaluating sprites
+uint32_t
+PpuTicksUntilSpriteEvaluation(struct ppu *ppu);
+
+//! \brief Number of ticks the status register is sure to keep reading the same
+//!
+//! The status only changes when vertical blank starts and ends, unless sprite
+//! zero may be hit or a scanline still to come has more than 8 sprites.  Only
+//! valid until the ppu is next written.
+//!
+//! \param[in] ppu
+//! \param[out] data what a cpu read of the status register would return now
+//! \return ticks up to and including the first one which may change the
+//! status, or 0 if a read now would have side effects or the status may change
+//! on any tick
+uint32_t
+PpuTicksUntilStatusChange(struct ppu *ppu, uint8_t *data);
+
 #endif // PPU_VERSION
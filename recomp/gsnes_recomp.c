@@ -0,0 +1,584 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: gsnes_recomp.c
+  Created: 2019-12-15
+  Updated: 2019-12-15
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file gsnes_recomp.c
+//! Ahead of time translation of mapper 000 prg rom to C.
+//!
+//! Usage: gsnes-recomp <rom.nes> <out.c>
+//!
+//! Mapper 000 carts have at most 32KB of prg rom, always mapped in the same
+//! place, so all of their code can be found and translated up front.  Code is
+//! found by walking every path reachable from the nmi, reset and irq vectors.
+//! Each basic block becomes one C function, and the blocks are gathered into a
+//! table indexed by pc for CpuSetTranslation.  Indirect jumps and returns are
+//! resolved at run time through the same table, and any pc which wasn't found
+//! here is left to the interpreter.
+//!
+//! Blocks only contain instructions which access internal RAM and prg rom, the
+//! same restriction as the block core.  Everything else ends the block and is
+//! run by the interpreter.
+#include <stdbool.h>
+#include <stdio.h> // fprintf, fopen
+#include <stdlib.h> // calloc, free
+#include <string.h> // strcmp
+
+#include "cart.h"
+#include "cpu.h"
+#include "recomp.h"
+
+//! Longest block, so that blocks still fit in the cycle budgets of CpuRun.
+static const int MAX_BLOCK_INSTRUCTIONS = 64;
+
+struct program {
+        uint8_t prg[0x8000]; //!< Everything the cpu reads from $8000
+        bool isCode[0x8000]; //!< An instruction starts here
+        bool isLeader[0x8000]; //!< A basic block starts here
+
+        uint16_t *pending; //!< Addresses still to be walked
+        int pendingCount;
+};
+
+//-- Decoding ------------------------------------------------------------------
+
+static uint8_t PrgRead(struct program *program, uint16_t addr) {
+        return program->prg[addr & 0x7FFF];
+}
+
+static uint16_t Operand(struct program *program, uint16_t addr, struct cpu_opcode_info *info) {
+        uint16_t operand = 0x0000;
+        if (info->length > 1)
+                operand = PrgRead(program, addr + 1);
+        if (info->length > 2)
+                operand |= PrgRead(program, addr + 2) << 8;
+        return operand;
+}
+
+static bool IsNamed(struct cpu_opcode_info *info, const char *name) {
+        return 0 == strcmp(info->name, name);
+}
+
+static bool IsControlFlow(uint8_t opcode, struct cpu_opcode_info *info) {
+        return CPU_MODE_REL == info->mode || 0x4C == opcode || 0x6C == opcode || 0x20 == opcode ||
+                0x60 == opcode || 0x40 == opcode || 0x00 == opcode;
+}
+
+static bool IsWrite(struct cpu_opcode_info *info) {
+        return IsNamed(info, "STA") || IsNamed(info, "STX") || IsNamed(info, "STY") ||
+                IsNamed(info, "INC") || IsNamed(info, "DEC") || IsNamed(info, "ASL") ||
+                IsNamed(info, "LSR") || IsNamed(info, "ROL") || IsNamed(info, "ROR");
+}
+
+//! \brief Whether crossing a page costs this instruction another cycle
+static bool HasPageCrossCycle(struct cpu_opcode_info *info) {
+        if (CPU_MODE_ABX != info->mode && CPU_MODE_ABY != info->mode)
+                return false;
+
+        return IsNamed(info, "ADC") || IsNamed(info, "SBC") || IsNamed(info, "AND") ||
+                IsNamed(info, "ORA") || IsNamed(info, "EOR") || IsNamed(info, "CMP") ||
+                IsNamed(info, "LDA") || IsNamed(info, "LDX") || IsNamed(info, "LDY");
+}
+
+//! \brief Whether an instruction can only access internal RAM or prg rom
+//!
+//! Mirrors IsBlockSafe in the cpu.  Mapper000 doesn't intercept $4020-$7FFF,
+//! but only $8000 and up is treated as prg rom, as in the cpu.
+static bool IsTranslatable(uint16_t addr, uint8_t opcode, struct cpu_opcode_info *info, uint16_t operand) {
+        if ((uint32_t)addr + info->length > 0x10000)
+                return false;
+
+        switch (info->mode) {
+                case CPU_MODE_IMP:
+                case CPU_MODE_IMM:
+                case CPU_MODE_REL:
+                case CPU_MODE_ZP0:
+                case CPU_MODE_ZPX:
+                case CPU_MODE_ZPY:
+                        return true;
+                case CPU_MODE_IND:
+                case CPU_MODE_IZX:
+                case CPU_MODE_IZY:
+                        return false;
+                default:
+                        break;
+        }
+
+        if (0x4C == opcode || 0x20 == opcode)
+                return true;
+
+        uint32_t lo = operand;
+        uint32_t hi = operand + ((CPU_MODE_ABS == info->mode) ? 0 : 0xFF);
+
+        return hi < 0x2000 || (!IsWrite(info) && lo >= 0x8000 && hi <= 0xFFFF);
+}
+
+//! \brief Worst case number of cycles for an instruction
+static uint8_t MaxCycles(struct cpu_opcode_info *info) {
+        if (CPU_MODE_REL == info->mode)
+                return info->cycles + 2; // Taken, to another page
+        if (HasPageCrossCycle(info))
+                return info->cycles + 1;
+        return info->cycles;
+}
+
+//-- Discovery -----------------------------------------------------------------
+
+//! \brief Mark addr as the start of a block and queue it to be walked
+static void AddEntry(struct program *program, uint16_t addr) {
+        if (addr < 0x8000)
+                return;
+
+        program->isLeader[addr & 0x7FFF] = true;
+        if (!program->isCode[addr & 0x7FFF])
+                program->pending[program->pendingCount++] = addr;
+}
+
+//! \brief Walk straight-line code from addr, queueing every other path found
+static void Walk(struct program *program, uint16_t addr) {
+        while (addr >= 0x8000 && !program->isCode[addr & 0x7FFF]) {
+                uint8_t opcode = PrgRead(program, addr);
+                struct cpu_opcode_info info;
+                CpuGetOpcodeInfo(opcode, &info);
+                uint16_t operand = Operand(program, addr, &info);
+
+                if ((uint32_t)addr + info.length > 0x10000)
+                        return;
+                program->isCode[addr & 0x7FFF] = true;
+
+                uint16_t next = addr + info.length;
+
+                if (CPU_MODE_REL == info.mode) {
+                        AddEntry(program, next + (int8_t)operand);
+                        program->isLeader[next & 0x7FFF] = true;
+                } else if (0x4C == opcode) {
+                        AddEntry(program, operand);
+                        return;
+                } else if (0x20 == opcode) {
+                        AddEntry(program, operand);
+                        program->isLeader[next & 0x7FFF] = true;
+                } else if (0x00 == opcode) {
+                        // BRK returns past its padding byte.
+                        AddEntry(program, PrgRead(program, 0xFFFE) | (PrgRead(program, 0xFFFF) << 8));
+                        next = addr + 3;
+                        AddEntry(program, next);
+                        return;
+                } else if (0x6C == opcode || 0x60 == opcode || 0x40 == opcode) {
+                        return;
+                } else if (!IsTranslatable(addr, opcode, &info, operand)) {
+                        program->isLeader[next & 0x7FFF] = true;
+                }
+
+                addr = next;
+        }
+}
+
+static int Discover(struct program *program) {
+        // Each instruction is walked once, queueing at most two more paths.
+        program->pending = (uint16_t *)calloc(0x10000 + 3, sizeof(uint16_t));
+        if (NULL == program->pending)
+                return 1;
+
+        AddEntry(program, PrgRead(program, 0xFFFA) | (PrgRead(program, 0xFFFB) << 8));
+        AddEntry(program, PrgRead(program, 0xFFFC) | (PrgRead(program, 0xFFFD) << 8));
+        AddEntry(program, PrgRead(program, 0xFFFE) | (PrgRead(program, 0xFFFF) << 8));
+
+        while (program->pendingCount > 0) {
+                Walk(program, program->pending[--program->pendingCount]);
+        }
+
+        free(program->pending);
+        program->pending = NULL;
+        return 0;
+}
+
+//-- Code Generation -----------------------------------------------------------
+
+//! \brief C expressions for an instruction's operand
+//!
+//! \param[out] value expression for the operand; an lvalue unless it's in rom
+//! \param[out] crossed expression for whether indexing crossed a page
+//! \return true if the operand reads prg rom at run time
+static bool OperandExpression(struct program *program, struct cpu_opcode_info *info, uint16_t operand, char *value, char *crossed) {
+        sprintf(crossed, "0");
+
+        switch (info->mode) {
+                case CPU_MODE_IMP:
+                        sprintf(value, "s->a");
+                        return false;
+                case CPU_MODE_IMM:
+                        sprintf(value, "0x%02X", operand);
+                        return false;
+                case CPU_MODE_ZP0:
+                        sprintf(value, "ram[0x%02X]", operand);
+                        return false;
+                case CPU_MODE_ZPX:
+                        sprintf(value, "ram[(uint8_t)(0x%02X + s->x)]", operand);
+                        return false;
+                case CPU_MODE_ZPY:
+                        sprintf(value, "ram[(uint8_t)(0x%02X + s->y)]", operand);
+                        return false;
+                case CPU_MODE_ABS:
+                        if (operand >= 0x8000) {
+                                sprintf(value, "0x%02X", PrgRead(program, operand));
+                        } else {
+                                sprintf(value, "ram[0x%03X]", operand & 0x07FF);
+                        }
+                        return false;
+                case CPU_MODE_ABX:
+                case CPU_MODE_ABY: {
+                        const char *reg = (CPU_MODE_ABX == info->mode) ? "s->x" : "s->y";
+                        sprintf(crossed, "(0x%02X + %s > 0xFF)", operand & 0x00FF, reg);
+                        if (operand >= 0x8000) {
+                                sprintf(value, "prg[0x%04X + %s]", operand & 0x7FFF, reg);
+                                return true;
+                        }
+                        sprintf(value, "ram[(0x%04X + %s) & 0x07FF]", operand, reg);
+                        return false;
+                }
+                default:
+                        sprintf(value, "0");
+                        return false;
+        }
+}
+
+//! \brief Condition under which a branch is taken
+static const char *BranchCondition(struct cpu_opcode_info *info) {
+        if (IsNamed(info, "BPL")) return "!(s->status & RECOMP_N)";
+        if (IsNamed(info, "BMI")) return "(s->status & RECOMP_N)";
+        if (IsNamed(info, "BVC")) return "!(s->status & RECOMP_V)";
+        if (IsNamed(info, "BVS")) return "(s->status & RECOMP_V)";
+        if (IsNamed(info, "BCC")) return "!(s->status & RECOMP_C)";
+        if (IsNamed(info, "BCS")) return "(s->status & RECOMP_C)";
+        if (IsNamed(info, "BNE")) return "!(s->status & RECOMP_Z)";
+        return "(s->status & RECOMP_Z)"; // BEQ
+}
+
+//! \brief Write the C for one instruction
+//!
+//! Control flow writes its own return; other instructions leave the block
+//! open.
+//!
+//! \return true if the operand read prg rom at run time
+static bool EmitInstruction(FILE *out, struct program *program, uint16_t addr) {
+        uint8_t opcode = PrgRead(program, addr);
+        struct cpu_opcode_info info;
+        CpuGetOpcodeInfo(opcode, &info);
+        uint16_t operand = Operand(program, addr, &info);
+        uint16_t next = addr + info.length;
+
+        char v[64];
+        char crossed[64];
+        bool usesPrg = OperandExpression(program, &info, operand, v, crossed);
+
+        fprintf(out, "\n        // $%04X: %s\n", addr, info.name);
+        fprintf(out, "        cycles += %d;\n", info.cycles);
+        if (HasPageCrossCycle(&info))
+                fprintf(out, "        cycles += %s;\n", crossed);
+
+        const char *n = info.name;
+
+        if (0 == strcmp(n, "ADC")) {
+                fprintf(out, "        RecompAdc(s, %s);\n", v);
+        } else if (0 == strcmp(n, "SBC") || 0xEB == opcode) {
+                fprintf(out, "        RecompSbc(s, %s);\n", v);
+        } else if (0 == strcmp(n, "AND")) {
+                fprintf(out, "        s->a &= %s;\n        RecompSetZN(s, s->a);\n", v);
+        } else if (0 == strcmp(n, "ORA")) {
+                fprintf(out, "        s->a |= %s;\n        RecompSetZN(s, s->a);\n", v);
+        } else if (0 == strcmp(n, "EOR")) {
+                fprintf(out, "        s->a ^= %s;\n        RecompSetZN(s, s->a);\n", v);
+        } else if (0 == strcmp(n, "CMP")) {
+                fprintf(out, "        RecompCompare(s, s->a, %s);\n", v);
+        } else if (0 == strcmp(n, "CPX")) {
+                fprintf(out, "        RecompCompare(s, s->x, %s);\n", v);
+        } else if (0 == strcmp(n, "CPY")) {
+                fprintf(out, "        RecompCompare(s, s->y, %s);\n", v);
+        } else if (0 == strcmp(n, "BIT")) {
+                fprintf(out, "        RecompBit(s, %s);\n", v);
+        } else if (0 == strcmp(n, "LDA")) {
+                fprintf(out, "        s->a = %s;\n        RecompSetZN(s, s->a);\n", v);
+        } else if (0 == strcmp(n, "LDX")) {
+                fprintf(out, "        s->x = %s;\n        RecompSetZN(s, s->x);\n", v);
+        } else if (0 == strcmp(n, "LDY")) {
+                fprintf(out, "        s->y = %s;\n        RecompSetZN(s, s->y);\n", v);
+        } else if (0 == strcmp(n, "STA")) {
+                fprintf(out, "        %s = s->a;\n", v);
+        } else if (0 == strcmp(n, "STX")) {
+                fprintf(out, "        %s = s->x;\n", v);
+        } else if (0 == strcmp(n, "STY")) {
+                fprintf(out, "        %s = s->y;\n", v);
+        } else if (0 == strcmp(n, "ASL")) {
+                fprintf(out, "        %s = RecompAsl(s, %s);\n", v, v);
+        } else if (0 == strcmp(n, "LSR")) {
+                fprintf(out, "        %s = RecompLsr(s, %s);\n", v, v);
+        } else if (0 == strcmp(n, "ROL")) {
+                fprintf(out, "        %s = RecompRol(s, %s);\n", v, v);
+        } else if (0 == strcmp(n, "ROR")) {
+                fprintf(out, "        %s = RecompRor(s, %s);\n", v, v);
+        } else if (0 == strcmp(n, "INC")) {
+                fprintf(out, "        %s = RecompIncDec(s, %s, 1);\n", v, v);
+        } else if (0 == strcmp(n, "DEC")) {
+                fprintf(out, "        %s = RecompIncDec(s, %s, -1);\n", v, v);
+        } else if (CPU_MODE_REL == info.mode) {
+                uint16_t target = next + (int8_t)operand;
+                int penalty = ((target & 0xFF00) != (next & 0xFF00)) ? 2 : 1;
+                fprintf(out, "        if (%s) {\n", BranchCondition(&info));
+                fprintf(out, "                s->pc = 0x%04X;\n", target);
+                fprintf(out, "                return cycles + %d;\n", penalty);
+                fprintf(out, "        }\n");
+                fprintf(out, "        s->pc = 0x%04X;\n        return cycles;\n", next);
+        } else if (0x4C == opcode) {
+                fprintf(out, "        s->pc = 0x%04X;\n        return cycles;\n", operand);
+        } else if (0x20 == opcode) {
+                uint16_t ret = next - 1;
+                fprintf(out, "        RecompPush(s, ram, 0x%02X);\n", ret >> 8);
+                fprintf(out, "        RecompPush(s, ram, 0x%02X);\n", ret & 0x00FF);
+                fprintf(out, "        s->pc = 0x%04X;\n        return cycles;\n", operand);
+        } else if (0x60 == opcode) {
+                fprintf(out, "        s->pc = RecompPull(s, ram);\n");
+                fprintf(out, "        s->pc |= RecompPull(s, ram) << 8;\n");
+                fprintf(out, "        s->pc++;\n        return cycles;\n");
+        } else if (0x40 == opcode) {
+                fprintf(out, "        s->status = (RecompPull(s, ram) & ~RECOMP_B) | RECOMP_U;\n");
+                fprintf(out, "        s->pc = RecompPull(s, ram);\n");
+                fprintf(out, "        s->pc |= RecompPull(s, ram) << 8;\n");
+                fprintf(out, "        return cycles;\n");
+        } else if (0x00 == opcode) {
+                uint16_t ret = addr + 3;
+                uint16_t vector = PrgRead(program, 0xFFFE) | (PrgRead(program, 0xFFFF) << 8);
+                fprintf(out, "        s->status |= RECOMP_I;\n");
+                fprintf(out, "        RecompPush(s, ram, 0x%02X);\n", ret >> 8);
+                fprintf(out, "        RecompPush(s, ram, 0x%02X);\n", ret & 0x00FF);
+                fprintf(out, "        RecompPush(s, ram, s->status | RECOMP_B);\n");
+                fprintf(out, "        s->status &= ~RECOMP_B;\n");
+                fprintf(out, "        s->pc = 0x%04X;\n        return cycles;\n", vector);
+        } else if (0 == strcmp(n, "PHA")) {
+                fprintf(out, "        RecompPush(s, ram, s->a);\n");
+        } else if (0 == strcmp(n, "PHP")) {
+                fprintf(out, "        RecompPush(s, ram, s->status | RECOMP_B | RECOMP_U);\n");
+                fprintf(out, "        s->status &= ~RECOMP_B;\n");
+        } else if (0 == strcmp(n, "PLA")) {
+                fprintf(out, "        s->a = RecompPull(s, ram);\n        RecompSetZN(s, s->a);\n");
+        } else if (0 == strcmp(n, "PLP")) {
+                fprintf(out, "        s->status = RecompPull(s, ram) | RECOMP_U;\n");
+        } else if (0 == strcmp(n, "TAX")) {
+                fprintf(out, "        s->x = s->a;\n        RecompSetZN(s, s->x);\n");
+        } else if (0 == strcmp(n, "TAY")) {
+                fprintf(out, "        s->y = s->a;\n        RecompSetZN(s, s->y);\n");
+        } else if (0 == strcmp(n, "TSX")) {
+                fprintf(out, "        s->x = s->sp;\n        RecompSetZN(s, s->x);\n");
+        } else if (0 == strcmp(n, "TXA")) {
+                fprintf(out, "        s->a = s->x;\n        RecompSetZN(s, s->a);\n");
+        } else if (0 == strcmp(n, "TXS")) {
+                fprintf(out, "        s->sp = s->x;\n");
+        } else if (0 == strcmp(n, "TYA")) {
+                fprintf(out, "        s->a = s->y;\n        RecompSetZN(s, s->a);\n");
+        } else if (0 == strcmp(n, "INX")) {
+                fprintf(out, "        s->x++;\n        RecompSetZN(s, s->x);\n");
+        } else if (0 == strcmp(n, "INY")) {
+                fprintf(out, "        s->y++;\n        RecompSetZN(s, s->y);\n");
+        } else if (0 == strcmp(n, "DEX")) {
+                fprintf(out, "        s->x--;\n        RecompSetZN(s, s->x);\n");
+        } else if (0 == strcmp(n, "DEY")) {
+                fprintf(out, "        s->y--;\n        RecompSetZN(s, s->y);\n");
+        } else if (0 == strcmp(n, "CLC")) {
+                fprintf(out, "        s->status &= ~RECOMP_C;\n");
+        } else if (0 == strcmp(n, "CLD")) {
+                fprintf(out, "        s->status &= ~RECOMP_D;\n");
+        } else if (0 == strcmp(n, "CLI")) {
+                fprintf(out, "        s->status &= ~RECOMP_I;\n");
+        } else if (0 == strcmp(n, "CLV")) {
+                fprintf(out, "        s->status &= ~RECOMP_V;\n");
+        } else if (0 == strcmp(n, "SEC")) {
+                fprintf(out, "        s->status |= RECOMP_C;\n");
+        } else if (0 == strcmp(n, "SED")) {
+                fprintf(out, "        s->status |= RECOMP_D;\n");
+        } else if (0 == strcmp(n, "SEI")) {
+                fprintf(out, "        s->status |= RECOMP_I;\n");
+        }
+        // Anything else is an illegal opcode or NOP, which only takes cycles.
+
+        return usesPrg;
+}
+
+//! \brief Write the function for the block starting at addr
+//!
+//! \param[out] count instructions in the block, or 0 if there's no block
+//! \param[out] maxCycles
+//! \param[in,out] usesPrg set if any instruction read prg rom at run time
+static void EmitBlock(FILE *out, struct program *program, uint16_t start, int *count, int *maxCycles, bool *usesPrg) {
+        *count = 0;
+        *maxCycles = 0;
+
+        uint16_t addr = start;
+        bool isOpen = true;
+        while (isOpen) {
+                uint8_t opcode = PrgRead(program, addr);
+                struct cpu_opcode_info info;
+                CpuGetOpcodeInfo(opcode, &info);
+                uint16_t operand = Operand(program, addr, &info);
+
+                if (!IsTranslatable(addr, opcode, &info, operand))
+                        break;
+
+                if (0 == *count) {
+                        fprintf(out, "\nstatic uint32_t Block_%04X(struct cpu_state *s, uint8_t *ram) {\n", start);
+                        fprintf(out, "        uint32_t cycles = 0;\n");
+                }
+
+                *usesPrg |= EmitInstruction(out, program, addr);
+                *maxCycles += MaxCycles(&info);
+                (*count)++;
+
+                if (IsControlFlow(opcode, &info)) {
+                        fprintf(out, "}\n");
+                        return;
+                }
+
+                addr += info.length;
+
+                // The next block will pick up from here.
+                if (addr < 0x8000 || program->isLeader[addr & 0x7FFF])
+                        isOpen = false;
+                if (*count == MAX_BLOCK_INSTRUCTIONS && addr >= 0x8000) {
+                        program->isLeader[addr & 0x7FFF] = true;
+                        isOpen = false;
+                }
+        }
+
+        if (0 != *count) {
+                fprintf(out, "\n        s->pc = 0x%04X;\n        return cycles;\n}\n", addr);
+        }
+}
+
+//! \brief Write the translation unit for the whole program
+static int Emit(FILE *out, struct program *program, char *romFile, uint32_t prgHash) {
+        struct block {
+                int count;
+                int maxCycles;
+        };
+
+        struct block *blocks = (struct block *)calloc(0x8000, sizeof(struct block));
+        FILE *body = tmpfile();
+        if (NULL == blocks || NULL == body) {
+                free(blocks);
+                if (NULL != body)
+                        fclose(body);
+                return 1;
+        }
+
+        // Blocks are written in address order, since a block cut short adds
+        // a leader further on.
+        bool usesPrg = false;
+        int numBlocks = 0;
+        int numInstructions = 0;
+        for (int i = 0; i < 0x8000; i++) {
+                if (!program->isLeader[i] || !program->isCode[i])
+                        continue;
+
+                EmitBlock(body, program, 0x8000 + i, &blocks[i].count, &blocks[i].maxCycles, &usesPrg);
+                if (0 != blocks[i].count) {
+                        numBlocks++;
+                        numInstructions += blocks[i].count;
+                }
+        }
+
+        fprintf(out, "// Generated by gsnes-recomp from %s; do not edit.\n", romFile);
+        fprintf(out, "// %d blocks, %d instructions.\n", numBlocks, numInstructions);
+        fprintf(out, "#include <stdint.h>\n\n#include \"cpu.h\"\n#include \"recomp.h\"\n");
+
+        if (usesPrg) {
+                fprintf(out, "\nstatic const uint8_t prg[0x8000] = {");
+                for (int i = 0; i < 0x8000; i++) {
+                        fprintf(out, "%s0x%02X,", (0 == i % 16) ? "\n        " : " ", program->prg[i]);
+                }
+                fprintf(out, "\n};\n");
+        }
+
+        rewind(body);
+        char buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), body)) > 0) {
+                fwrite(buffer, 1, n, out);
+        }
+        fclose(body);
+
+        fprintf(out, "\nconst struct cpu_translated_block RecompBlocks[0x8000] = {\n");
+        for (int i = 0; i < 0x8000; i++) {
+                if (0 != blocks[i].count) {
+                        fprintf(out, "        [0x%04X] = { Block_%04X, %d, %d },\n", i, 0x8000 + i, blocks[i].count, blocks[i].maxCycles);
+                }
+        }
+        fprintf(out, "};\n\nconst uint32_t RecompPrgHash = 0x%08Xu;\n", prgHash);
+
+        printf("%d blocks, %d instructions translated\n", numBlocks, numInstructions);
+
+        free(blocks);
+        return 0;
+}
+
+int main(int argc, char **argv) {
+        if (argc < 3) {
+                fprintf(stderr, "Usage: %s <rom.nes> <out.c>\n", argv[0]);
+                return 1;
+        }
+
+        struct cart *cart = CartInit(argv[1]);
+        if (NULL == cart || !CartIsImageValid(cart)) {
+                fprintf(stderr, "Couldn't load cart\n");
+                CartDeinit(cart);
+                return 1;
+        }
+
+        if (0 != CartMapper(cart)) {
+                fprintf(stderr, "Only mapper 000 carts can be translated, not mapper %03d\n", CartMapper(cart));
+                CartDeinit(cart);
+                return 1;
+        }
+
+        struct program *program = (struct program *)calloc(1, sizeof(struct program));
+        if (NULL == program) {
+                fprintf(stderr, "Couldn't allocate program\n");
+                CartDeinit(cart);
+                return 1;
+        }
+
+        for (uint32_t addr = 0x8000; addr <= 0xFFFF; addr++) {
+                CartCpuRead(cart, addr, &program->prg[addr & 0x7FFF]);
+        }
+        uint32_t prgHash = RecompHashPrg(cart);
+        CartDeinit(cart);
+
+        int result = Discover(program);
+        if (0 != result) {
+                fprintf(stderr, "Couldn't allocate work list\n");
+                free(program);
+                return result;
+        }
+
+        FILE *out = fopen(argv[2], "w");
+        if (NULL == out) {
+                perror("fopen() failed");
+                free(program);
+                return 1;
+        }
+
+        result = Emit(out, program, argv[1], prgHash);
+        if (0 != result)
+                fprintf(stderr, "Couldn't allocate blocks\n");
+
+        fclose(out);
+        free(program);
+        return result;
+}
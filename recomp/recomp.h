@@ -0,0 +1,164 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: recomp.h
+  Created: 2019-12-15
+  Updated: 2019-12-15
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file recomp.h
+//! Support for prg code translated to C by gsnes-recomp.
+//!
+//! Every translation unit written by gsnes-recomp includes this header.  The
+//! helpers mirror the fused cpu core exactly, operating on a struct cpu_state
+//! and internal RAM rather than the cpu and bus.
+#ifndef RECOMP_VERSION
+#define RECOMP_VERSION "0.1.0"
+
+#include <stdint.h>
+
+#include "cart.h"
+#include "cpu.h"
+
+enum recomp_flags {
+        RECOMP_C = (1 << 0), //!< Carry Bit
+        RECOMP_Z = (1 << 1), //!< Zero Bit
+        RECOMP_I = (1 << 2), //!< Disable Interrupts
+        RECOMP_D = (1 << 3), //!< Decimal Mode
+        RECOMP_B = (1 << 4), //!< Break
+        RECOMP_U = (1 << 5), //!< Unused
+        RECOMP_V = (1 << 6), //!< Overflow
+        RECOMP_N = (1 << 7), //!< Negative
+};
+
+//! Translated blocks, one entry per address from $8000; see CpuSetTranslation
+extern const struct cpu_translated_block RecompBlocks[0x8000];
+
+//! RecompHashPrg of the cart the blocks were translated from
+extern const uint32_t RecompPrgHash;
+
+//! \brief FNV-1a hash of the prg memory the cpu sees at $8000-$FFFF
+static inline uint32_t RecompHashPrg(struct cart *cart) {
+        uint32_t hash = 2166136261u;
+        for (uint32_t addr = 0x8000; addr <= 0xFFFF; addr++) {
+                uint8_t data = 0x00;
+                CartCpuRead(cart, addr, &data);
+                hash ^= data;
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+static inline void RecompSetFlag(struct cpu_state *s, enum recomp_flags f, int v) {
+        if (v)
+                s->status |= f;
+        else
+                s->status &= ~f;
+}
+
+static inline void RecompSetZN(struct cpu_state *s, uint8_t value) {
+        RecompSetFlag(s, RECOMP_Z, value == 0x00);
+        RecompSetFlag(s, RECOMP_N, value & 0x80);
+}
+
+static inline void RecompPush(struct cpu_state *s, uint8_t *ram, uint8_t value) {
+        ram[0x0100 + s->sp] = value;
+        s->sp--;
+}
+
+static inline uint8_t RecompPull(struct cpu_state *s, uint8_t *ram) {
+        s->sp++;
+        return ram[0x0100 + s->sp];
+}
+
+//! \brief Add with Carry; see FusedAdc
+static inline void RecompAdc(struct cpu_state *s, uint8_t fetched) {
+        uint16_t tmp = (uint16_t)s->a + (uint16_t)fetched + (uint16_t)(s->status & RECOMP_C);
+
+        RecompSetFlag(s, RECOMP_C, tmp > 255);
+        RecompSetFlag(s, RECOMP_Z, (tmp & 0x00FF) == 0);
+        RecompSetFlag(s, RECOMP_V, (~((uint16_t)s->a ^ (uint16_t)fetched) & ((uint16_t)s->a ^ (uint16_t)tmp)) & 0x0080);
+        RecompSetFlag(s, RECOMP_N, tmp & 0x80);
+
+        s->a = tmp & 0x00FF;
+}
+
+//! \brief Subtraction with Borrow; see FusedSbc
+static inline void RecompSbc(struct cpu_state *s, uint8_t fetched) {
+        uint16_t value = ((uint16_t)fetched) ^ 0x00FF;
+        uint16_t tmp = (uint16_t)s->a + value + (uint16_t)(s->status & RECOMP_C);
+
+        RecompSetFlag(s, RECOMP_C, tmp & 0xFF00);
+        RecompSetFlag(s, RECOMP_Z, 0 == (tmp & 0x00FF));
+        RecompSetFlag(s, RECOMP_V, (tmp ^ (uint16_t)s->a) & (tmp ^ value) & 0x0080);
+        RecompSetFlag(s, RECOMP_N, tmp & 0x0080);
+
+        s->a = tmp & 0x00FF;
+}
+
+//! \brief Shared body of CMP, CPX and CPY; see FusedCompare
+static inline void RecompCompare(struct cpu_state *s, uint8_t reg, uint8_t fetched) {
+        uint16_t tmp = (uint16_t)reg - (uint16_t)fetched;
+        RecompSetFlag(s, RECOMP_C, reg >= fetched);
+        RecompSetFlag(s, RECOMP_Z, (tmp & 0x00FF) == 0x0000);
+        RecompSetFlag(s, RECOMP_N, tmp & 0x0080);
+}
+
+//! \brief Bit test operation; see FusedBit
+static inline void RecompBit(struct cpu_state *s, uint8_t fetched) {
+        RecompSetFlag(s, RECOMP_Z, (s->a & fetched) == 0x00);
+        RecompSetFlag(s, RECOMP_N, fetched & (1 << 7));
+        RecompSetFlag(s, RECOMP_V, fetched & (1 << 6));
+}
+
+//! \brief Arithmetic Shift Left; see FusedAsl
+static inline uint8_t RecompAsl(struct cpu_state *s, uint8_t fetched) {
+        uint16_t tmp = (uint16_t)fetched << 1;
+        RecompSetFlag(s, RECOMP_C, (tmp & 0xFF00) > 0);
+        RecompSetFlag(s, RECOMP_Z, (tmp & 0x00FF) == 0x00);
+        RecompSetFlag(s, RECOMP_N, tmp & 0x80);
+        return tmp & 0x00FF;
+}
+
+//! \brief Logical Shift Right; see FusedLsr
+static inline uint8_t RecompLsr(struct cpu_state *s, uint8_t fetched) {
+        RecompSetFlag(s, RECOMP_C, fetched & 0x0001);
+        uint16_t tmp = fetched >> 1;
+        RecompSetFlag(s, RECOMP_Z, (tmp & 0x00FF) == 0x0000);
+        RecompSetFlag(s, RECOMP_N, tmp & 0x0080);
+        return tmp & 0x00FF;
+}
+
+//! \brief Rotate Left; see FusedRol
+static inline uint8_t RecompRol(struct cpu_state *s, uint8_t fetched) {
+        uint16_t tmp = (uint16_t)(fetched << 1) | (s->status & RECOMP_C);
+        RecompSetFlag(s, RECOMP_C, tmp & 0xFF00);
+        RecompSetFlag(s, RECOMP_Z, (tmp & 0x00FF) == 0x0000);
+        RecompSetFlag(s, RECOMP_N, tmp & 0x0080);
+        return tmp & 0x00FF;
+}
+
+//! \brief Rotate Right; see FusedRor
+static inline uint8_t RecompRor(struct cpu_state *s, uint8_t fetched) {
+        uint16_t tmp = (uint16_t)((s->status & RECOMP_C) << 7) | (fetched >> 1);
+        RecompSetFlag(s, RECOMP_C, fetched & 0x01);
+        RecompSetFlag(s, RECOMP_Z, (tmp & 0x00FF) == 0x0000);
+        RecompSetFlag(s, RECOMP_N, tmp & 0x0080);
+        return tmp & 0x00FF;
+}
+
+//! \brief Increment or decrement, returning the result; see FusedIncDec
+static inline uint8_t RecompIncDec(struct cpu_state *s, uint8_t fetched, int8_t delta) {
+        uint8_t tmp = fetched + delta;
+        RecompSetZN(s, tmp);
+        return tmp;
+}
+
+#endif // RECOMP_VERSION
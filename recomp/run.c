@@ -0,0 +1,171 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: run.c
+  Created: 2019-12-15
+  Updated: 2019-12-15
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file run.c
+//! Headless runner for a rom translated by gsnes-recomp.
+//!
+//! Usage: <runner> <rom.nes> [frames] [--diff]
+//!
+//! Linked against the translation of a single rom, which must be the rom given.
+//! Runs the rom with BusRunFrame for the given number of frames, first with the
+//! fused interpreter alone and then with the translation, reporting MIPS and
+//! how many instructions were run from translated blocks.  Both are then run
+//! again with the cpu alone, as in cpu_bench.  With --diff, both are run side
+//! by side and the cpu state and frame are compared after every frame.
+#include <stdbool.h>
+#include <stdio.h> // printf, fprintf
+#include <stdlib.h> // strtoul
+#include <string.h> // strcmp
+
+#include "bus.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "bench.h"
+#include "recomp.h"
+
+struct system *RecompSystemInit(char *romFile, bool isTranslated) {
+        struct system *system = SystemInit(romFile, CPU_CORE_FUSED);
+        if (NULL == system) {
+                fprintf(stderr, "Couldn't load cart\n");
+                return NULL;
+        }
+
+        if (isTranslated) {
+                if (RecompHashPrg(system->cart) != RecompPrgHash) {
+                        fprintf(stderr, "%s isn't the rom this runner was translated from\n", romFile);
+                        SystemDeinit(system);
+                        return NULL;
+                }
+                CpuSetTranslation(system->cpu, RecompBlocks);
+        }
+
+        return system;
+}
+
+//! \brief Run the rom, with or without the translation
+//!
+//! \param[in] isCpuOnly run the cpu alone, without the rest of the system
+//! ticking, to isolate the cost of the cpu; see cpu_bench
+int Bench(char *romFile, bool isTranslated, bool isCpuOnly, int frames, double *mips) {
+        struct system *system = RecompSystemInit(romFile, isTranslated);
+        if (NULL == system)
+                return 1;
+
+        double start = Now();
+        for (int i = 0; i < frames; i++) {
+                if (isCpuOnly) {
+                        CpuRun(system->cpu, 29781);
+                } else {
+                        BusRunFrame(system->bus);
+                        PpuResetFrameCompletion(system->ppu);
+                }
+        }
+        double elapsed = Now() - start;
+
+        uint64_t instructions = CpuInstructionCount(system->cpu);
+        *mips = (double)instructions / elapsed / 1000000.0;
+
+        struct cpu_decode_stats stats;
+        CpuGetDecodeStats(system->cpu, &stats);
+
+        printf("%-6s %8d frames %12llu instructions %8.3fs %8.3f MIPS %8.1f fps %6.2f%% translated%s\n",
+               isTranslated ? "recomp" : "fused", frames, (unsigned long long)instructions, elapsed, *mips,
+               (double)frames / elapsed, (0 == instructions) ? 0.0 : 100.0 * stats.translated / instructions,
+               isCpuOnly ? " (cpu only)" : "");
+
+        SystemDeinit(system);
+        return 0;
+}
+
+int Diff(char *romFile, int frames) {
+        struct system *fused = RecompSystemInit(romFile, false);
+        struct system *recomp = RecompSystemInit(romFile, true);
+        if (NULL == fused || NULL == recomp) {
+                SystemDeinit(fused);
+                SystemDeinit(recomp);
+                return 1;
+        }
+
+        int result = 0;
+        for (int frame = 0; frame < frames; frame++) {
+                BusRunFrame(fused->bus);
+                PpuResetFrameCompletion(fused->ppu);
+                BusRunFrame(recomp->bus);
+                PpuResetFrameCompletion(recomp->ppu);
+
+                struct cpu_state a;
+                struct cpu_state b;
+                CpuGetState(fused->cpu, &a);
+                CpuGetState(recomp->cpu, &b);
+
+                bool sameCpu = a.a == b.a && a.x == b.x && a.y == b.y && a.sp == b.sp &&
+                        a.pc == b.pc && a.status == b.status && a.cycles == b.cycles &&
+                        CpuInstructionCount(fused->cpu) == CpuInstructionCount(recomp->cpu);
+
+                if (!sameCpu || ScreenHash(fused->ppu) != ScreenHash(recomp->ppu)) {
+                        printf("Frame %d differs: frame hash %08X vs %08X, pc $%04X vs $%04X, instructions %llu vs %llu\n",
+                               frame, ScreenHash(fused->ppu), ScreenHash(recomp->ppu), a.pc, b.pc,
+                               (unsigned long long)CpuInstructionCount(fused->cpu),
+                               (unsigned long long)CpuInstructionCount(recomp->cpu));
+                        result = 1;
+                        break;
+                }
+        }
+
+        if (0 == result)
+                printf("No divergence over %d frames\n", frames);
+
+        SystemDeinit(fused);
+        SystemDeinit(recomp);
+        return result;
+}
+
+int main(int argc, char **argv) {
+        if (argc < 2) {
+                fprintf(stderr, "Usage: %s <rom.nes> [frames] [--diff]\n", argv[0]);
+                return 1;
+        }
+
+        char *romFile = argv[1];
+        int frames = 600;
+        bool diff = false;
+        for (int i = 2; i < argc; i++) {
+                if (0 == strcmp(argv[i], "--diff"))
+                        diff = true;
+                else
+                        frames = (int)strtoul(argv[i], NULL, 10);
+        }
+
+        if (diff)
+                return Diff(romFile, frames);
+
+        double fusedMips = 0.0;
+        double recompMips = 0.0;
+        if (Bench(romFile, false, false, frames, &fusedMips))
+                return 1;
+        if (Bench(romFile, true, false, frames, &recompMips))
+                return 1;
+
+        printf("recomp/fused: %.2fx\n", recompMips / fusedMips);
+
+        if (Bench(romFile, false, true, frames, &fusedMips))
+                return 1;
+        if (Bench(romFile, true, true, frames, &recompMips))
+                return 1;
+
+        printf("recomp/fused: %.2fx (cpu only)\n", recompMips / fusedMips);
+
+        return 0;
+}
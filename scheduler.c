@@ -0,0 +1,88 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: scheduler.c
+  Created: 2019-12-11
+  Updated: 2019-12-11
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file scheduler.c
+#include <stdlib.h> // calloc, free
+
+#include "scheduler.h"
+
+struct scheduler {
+        uint64_t when[SCHED_EVENT_COUNT];
+        enum sched_event next; //!< Earliest pending event
+};
+
+//! \brief Recompute the earliest pending event
+//!
+//! There are only a handful of events, so a linear scan beats keeping a heap.
+static void FindNext(struct scheduler *scheduler) {
+        enum sched_event next = 0;
+        for (int i = 1; i < SCHED_EVENT_COUNT; i++) {
+                if (scheduler->when[i] < scheduler->when[next]) {
+                        next = i;
+                }
+        }
+        scheduler->next = next;
+}
+
+struct scheduler *SchedulerInit() {
+        struct scheduler *scheduler = (struct scheduler *)calloc(1, sizeof(struct scheduler));
+        if (NULL == scheduler) {
+                return NULL;
+        }
+
+        SchedulerReset(scheduler);
+
+        return scheduler;
+}
+
+void SchedulerDeinit(struct scheduler *scheduler) {
+        if (NULL != scheduler) {
+                free(scheduler);
+        }
+}
+
+void SchedulerReset(struct scheduler *scheduler) {
+        for (int i = 0; i < SCHED_EVENT_COUNT; i++) {
+                scheduler->when[i] = SCHEDULER_NEVER;
+        }
+        scheduler->next = 0;
+}
+
+void SchedulerSet(struct scheduler *scheduler, enum sched_event event, uint64_t when) {
+        scheduler->when[event] = when;
+
+        if (when < scheduler->when[scheduler->next]) {
+                scheduler->next = event;
+        } else if (event == scheduler->next) {
+                FindNext(scheduler);
+        }
+}
+
+void SchedulerCancel(struct scheduler *scheduler, enum sched_event event) {
+        scheduler->when[event] = SCHEDULER_NEVER;
+
+        if (event == scheduler->next) {
+                FindNext(scheduler);
+        }
+}
+
+uint64_t SchedulerWhen(struct scheduler *scheduler, enum sched_event event) {
+        return scheduler->when[event];
+}
+
+uint64_t SchedulerNext(struct scheduler *scheduler, enum sched_event *event) {
+        *event = scheduler->next;
+        return scheduler->when[scheduler->next];
+}
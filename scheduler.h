@@ -0,0 +1,81 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: scheduler.h
+  Created: 2019-12-11
+  Updated: 2019-12-11
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file scheduler.h
+//! Timestamped system events keyed on the 64-bit master clock.
+//!
+//! Each kind of event is pending at most once, so the queue is just one
+//! timestamp per event with the earliest one cached.
+#ifndef SCHEDULER_VERSION
+#define SCHEDULER_VERSION "0.1.0"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SCHEDULER_NEVER UINT64_MAX //!< Timestamp of an event that isn't pending
+
+enum sched_event {
+        SCHED_EVENT_NMI, //!< The ppu raises an nmi
+        SCHED_EVENT_FRAME, //!< The ppu completes a frame
+        SCHED_EVENT_DMA, //!< OAM DMA finishes and the cpu resumes
+        // Mapper and APU IRQs go here once they exist.
+        SCHED_EVENT_COUNT,
+};
+
+struct scheduler;
+
+struct scheduler *
+SchedulerInit();
+
+void
+SchedulerDeinit(struct scheduler *scheduler);
+
+//! \brief Cancel every pending event
+//!
+//! \param[in,out] scheduler
+void
+SchedulerReset(struct scheduler *scheduler);
+
+//! \brief Schedule an event, replacing any pending event of the same kind
+//!
+//! \param[in,out] scheduler
+//! \param[in] event
+//! \param[in] when master clock tick the event occurs on
+void
+SchedulerSet(struct scheduler *scheduler, enum sched_event event, uint64_t when);
+
+//! \brief Cancel a pending event, if any
+//!
+//! \param[in,out] scheduler
+//! \param[in] event
+void
+SchedulerCancel(struct scheduler *scheduler, enum sched_event event);
+
+//! \param[in] scheduler
+//! \param[in] event
+//! \return the tick event occurs on, or SCHEDULER_NEVER if it isn't pending
+uint64_t
+SchedulerWhen(struct scheduler *scheduler, enum sched_event event);
+
+//! \brief Find the earliest pending event
+//!
+//! \param[in] scheduler
+//! \param[out] event earliest event, only valid if one is pending
+//! \return the tick that event occurs on, or SCHEDULER_NEVER if none are
+//! pending
+uint64_t
+SchedulerNext(struct scheduler *scheduler, enum sched_event *event);
+
+#endif // SCHEDULER_VERSION
@@ -0,0 +1,210 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: timeline.c
+  Created: 2019-12-17
+  Updated: 2019-12-17
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file timeline.c
+#include <stdlib.h> // calloc, free
+#include <stdio.h> // fopen, fwrite, fread, fclose
+#include <string.h> // memcmp
+
+#include "timeline.h"
+
+struct timeline {
+        struct timeline_entry *entries;
+        uint32_t capacity;
+        uint32_t head; //!< Where the next write goes
+        uint32_t count;
+};
+
+static const char magic[4] = { 'G', 'S', 'T', 'L' };
+
+static void Put(uint8_t **out, uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+                *(*out)++ = (value >> (i * 8)) & 0xFF;
+        }
+}
+
+static uint32_t Get(const uint8_t **in, int bytes) {
+        uint32_t value = 0;
+        for (int i = 0; i < bytes; i++) {
+                value |= (uint32_t)*(*in)++ << (i * 8);
+        }
+        return value;
+}
+
+struct timeline *TimelineInit(uint32_t capacity) {
+        if (0 == capacity) {
+                return NULL;
+        }
+
+        struct timeline *timeline = (struct timeline *)calloc(1, sizeof(struct timeline));
+        if (NULL == timeline) {
+                return NULL;
+        }
+
+        timeline->entries = (struct timeline_entry *)calloc(capacity, sizeof(struct timeline_entry));
+        if (NULL == timeline->entries) {
+                free(timeline);
+                return NULL;
+        }
+        timeline->capacity = capacity;
+
+        return timeline;
+}
+
+void TimelineDeinit(struct timeline *timeline) {
+        if (NULL == timeline) {
+                return;
+        }
+
+        if (NULL != timeline->entries) {
+                free(timeline->entries);
+        }
+
+        free(timeline);
+}
+
+void TimelineClear(struct timeline *timeline) {
+        timeline->head = 0;
+        timeline->count = 0;
+}
+
+void TimelineRecord(struct timeline *timeline, struct timeline_entry entry) {
+        timeline->entries[timeline->head] = entry;
+
+        timeline->head++;
+        if (timeline->head == timeline->capacity) {
+                timeline->head = 0;
+        }
+
+        if (timeline->count < timeline->capacity) {
+                timeline->count++;
+        }
+}
+
+uint32_t TimelineCount(struct timeline *timeline) {
+        return timeline->count;
+}
+
+struct timeline_entry TimelineGet(struct timeline *timeline, uint32_t i) {
+        uint32_t oldest = (timeline->head + timeline->capacity - timeline->count) % timeline->capacity;
+        return timeline->entries[(oldest + i) % timeline->capacity];
+}
+
+bool TimelineIsMidScanlineWrite(struct timeline_entry entry) {
+        return TIMELINE_WRITE == entry.kind && entry.scanline >= 0 && entry.scanline < 240 &&
+                entry.cycle >= 1 && entry.cycle <= 256;
+}
+
+uint32_t TimelineFindMidScanlineWrites(struct timeline *timeline, uint32_t frame, bool *lines) {
+        memset(lines, 0, 240 * sizeof(bool));
+
+        // Writes are in order, so walk back from the newest to the frame.
+        uint32_t found = 0;
+        for (uint32_t i = timeline->count; i > 0; i--) {
+                struct timeline_entry entry = TimelineGet(timeline, i - 1);
+                if (entry.frame < frame) {
+                        break;
+                }
+
+                if (entry.frame == frame && TimelineIsMidScanlineWrite(entry)) {
+                        lines[entry.scanline] = true;
+                        found++;
+                }
+        }
+
+        return found;
+}
+
+bool TimelineSave(struct timeline *timeline, const char *filename) {
+        FILE *f = fopen(filename, "wb");
+        if (NULL == f) {
+                return false;
+        }
+
+        bool isWritten = TimelineWrite(timeline, f);
+        return (0 == fclose(f)) && isWritten;
+}
+
+struct timeline *TimelineLoad(const char *filename) {
+        FILE *f = fopen(filename, "rb");
+        if (NULL == f) {
+                return NULL;
+        }
+
+        struct timeline *timeline = TimelineRead(f);
+        fclose(f);
+        return timeline;
+}
+
+bool TimelineWrite(struct timeline *timeline, FILE *f) {
+        uint8_t header[8];
+        uint8_t *out = header;
+        memcpy(out, magic, sizeof(magic));
+        out += sizeof(magic);
+        Put(&out, timeline->count, 4);
+        bool isWritten = 1 == fwrite(header, sizeof(header), 1, f);
+
+        for (uint32_t i = 0; i < timeline->count && isWritten; i++) {
+                struct timeline_entry entry = TimelineGet(timeline, i);
+
+                uint8_t bytes[TIMELINE_ENTRY_SIZE];
+                out = bytes;
+                Put(&out, entry.frame, 4);
+                Put(&out, (uint16_t)entry.scanline, 2);
+                Put(&out, entry.cycle, 2);
+                Put(&out, entry.addr, 2);
+                Put(&out, entry.data, 1);
+                Put(&out, entry.kind, 1);
+                isWritten = 1 == fwrite(bytes, sizeof(bytes), 1, f);
+        }
+
+        return isWritten;
+}
+
+struct timeline *TimelineRead(FILE *f) {
+        uint8_t header[8];
+        if (1 != fread(header, sizeof(header), 1, f) || 0 != memcmp(header, magic, sizeof(magic))) {
+                return NULL;
+        }
+
+        const uint8_t *in = &header[sizeof(magic)];
+        uint32_t count = Get(&in, 4);
+
+        // An empty timeline still needs room for a write.
+        struct timeline *timeline = TimelineInit((0 == count) ? 1 : count);
+        if (NULL == timeline) {
+                return NULL;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+                uint8_t bytes[TIMELINE_ENTRY_SIZE];
+                if (1 != fread(bytes, sizeof(bytes), 1, f)) {
+                        TimelineDeinit(timeline);
+                        return NULL;
+                }
+
+                in = bytes;
+                struct timeline_entry entry;
+                entry.frame = Get(&in, 4);
+                entry.scanline = (int16_t)Get(&in, 2);
+                entry.cycle = Get(&in, 2);
+                entry.addr = Get(&in, 2);
+                entry.data = Get(&in, 1);
+                entry.kind = Get(&in, 1);
+                TimelineRecord(timeline, entry);
+        }
+
+        return timeline;
+}
@@ -0,0 +1,132 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: timeline.h
+  Created: 2019-12-17
+  Updated: 2019-12-17
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file timeline.h
+//! A record of the cpu's accesses to the ppu, each tagged with where the ppu was
+//! in its frame.
+//!
+//! Accesses are kept in a ring buffer of fixed capacity, so once it's full the
+//! oldest are dropped.  See PpuSetTimeline.
+//!
+//! The file TimelineSave writes is little endian: the magic "GSTL", then the
+//! number of accesses as 32 bits, then each access as TIMELINE_ENTRY_SIZE
+//! bytes: frame (32 bits), scanline (signed 16), cycle (16), address (16),
+//! data (8) and kind (8).
+#ifndef TIMELINE_VERSION
+#define TIMELINE_VERSION "0.1.0"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h> // FILE
+
+#define TIMELINE_ENTRY_SIZE 12 //!< Bytes per access in a saved timeline
+
+enum timeline_kind {
+        TIMELINE_WRITE, //!< A write to $2000-$2007 or $4014
+        TIMELINE_READ, //!< A read of $2002 or $2007, which change the ppu
+        TIMELINE_OAM_DMA, //!< A byte OAM DMA wrote; addr is the OAM address
+};
+
+//! A cpu access to the ppu
+struct timeline_entry {
+        uint32_t frame; //!< Frames the ppu had completed
+        int16_t scanline;
+        uint16_t cycle;
+        uint16_t addr;
+        uint8_t data; //!< Written, or read
+        uint8_t kind; //!< enum timeline_kind
+};
+
+struct timeline;
+
+//! \param[in] capacity accesses kept before the oldest are dropped
+struct timeline *
+TimelineInit(uint32_t capacity);
+
+void
+TimelineDeinit(struct timeline *timeline);
+
+//! \brief Drop every access
+void
+TimelineClear(struct timeline *timeline);
+
+//! \brief Record an access, dropping the oldest if full
+//!
+//! \param[in,out] timeline
+//! \param[in] entry
+void
+TimelineRecord(struct timeline *timeline, struct timeline_entry entry);
+
+//! \return how many accesses are kept
+uint32_t
+TimelineCount(struct timeline *timeline);
+
+//! \param[in] timeline
+//! \param[in] i 0 for the oldest access kept, up to TimelineCount - 1
+//! \return the access
+struct timeline_entry
+TimelineGet(struct timeline *timeline, uint32_t i);
+
+//! \brief Whether an access is a write made while its scanline was being drawn
+//!
+//! Those are the writes, not reads or OAM DMA, on cycles 1 to 256 of scanlines 0 to 239; the ones that
+//! make raster effects.
+bool
+TimelineIsMidScanlineWrite(struct timeline_entry entry);
+
+//! \brief Find which lines of a frame had writes while they were being drawn
+//!
+//! Walks back from the newest access, so it's meant for recent frames; see
+//! TimelineIsMidScanlineWrite.
+//!
+//! \param[in] timeline
+//! \param[in] frame
+//! \param[out] lines 240 flags, one per visible scanline
+//! \return the number of such writes
+uint32_t
+TimelineFindMidScanlineWrites(struct timeline *timeline, uint32_t frame, bool *lines);
+
+//! \brief Save every access kept to a file
+//!
+//! \param[in] timeline
+//! \param[in] filename
+//! \return false if the file couldn't be written
+bool
+TimelineSave(struct timeline *timeline, const char *filename);
+
+//! \brief Read a file TimelineSave wrote
+//!
+//! \param[in] filename
+//! \return a timeline holding exactly the accesses in the file, or NULL if it
+//! couldn't be read
+struct timeline *
+TimelineLoad(const char *filename);
+
+//! \brief TimelineSave, to an open file
+//!
+//! \param[in] timeline
+//! \param[in,out] file left just past the timeline
+//! \return false if the file couldn't be written
+bool
+TimelineWrite(struct timeline *timeline, FILE *file);
+
+//! \brief TimelineLoad, from an open file
+//!
+//! \param[in,out] file left just past the timeline
+//! \return the timeline, or NULL if it couldn't be read
+struct timeline *
+TimelineRead(FILE *file);
+
+#endif // TIMELINE_VERSION
@@ -0,0 +1,120 @@
+/******************************************************************************
+  GrooveStomp's NES Emulator
+  Copyright (c) 2019 Aaron Oman (GrooveStomp)
+
+  File: timeline_dump.c
+  Created: 2019-12-17
+  Updated: 2019-12-17
+  Author: Aaron Oman
+  Notice: GNU AGPLv3 License
+
+  Based off of: One Lone Coder NES Emulator Copyright (C) 2019 Javidx9
+  This program comes with ABSOLUTELY NO WARRANTY.
+  This is free software, and you are welcome to redistribute it under certain
+  conditions; See LICENSE for details.
+ ******************************************************************************/
+//! \file timeline_dump.c
+//! Prints a timeline of ppu accesses saved by TimelineSave.
+//!
+//! Usage: timeline_dump <timeline> [--mid|--dma]
+//!
+//! Prints every write and read, one per line, with where the ppu was in its
+//! frame.  With --dma, also prints each byte OAM DMA copied.  With --mid,
+//! instead prints each frame's scanlines that had writes while they were being
+//! drawn.
+#include <stdbool.h>
+#include <stdio.h> // printf, fprintf
+#include <string.h> // memset, strcmp
+
+#include "timeline.h"
+
+static const char *registerNames[8] = {
+        "PPUCTRL", "PPUMASK", "PPUSTATUS", "OAMADDR",
+        "OAMDATA", "PPUSCROLL", "PPUADDR", "PPUDATA",
+};
+
+//! \brief Print the lines of a frame with writes made mid-scanline
+static void PrintMidScanlineWrites(uint32_t frame, const bool *lines) {
+        printf("frame %u:", frame);
+        for (int line = 0; line < 240; line++) {
+                if (lines[line]) {
+                        printf(" %d", line);
+                }
+        }
+        printf("\n");
+}
+
+//! \brief Print the writes of each frame made mid-scanline
+//!
+//! Accesses are in order, so this takes a single pass from the oldest,
+//! printing each frame once the next one starts.
+static void DumpMidScanlineWrites(struct timeline *timeline) {
+        bool lines[240] = {false};
+        bool isFound = false;
+        uint32_t frame = 0;
+
+        for (uint32_t i = 0; i < TimelineCount(timeline); i++) {
+                struct timeline_entry entry = TimelineGet(timeline, i);
+                if (isFound && entry.frame != frame) {
+                        PrintMidScanlineWrites(frame, lines);
+                        memset(lines, 0, sizeof(lines));
+                        isFound = false;
+                }
+                frame = entry.frame;
+
+                if (TimelineIsMidScanlineWrite(entry)) {
+                        lines[entry.scanline] = true;
+                        isFound = true;
+                }
+        }
+
+        if (isFound) {
+                PrintMidScanlineWrites(frame, lines);
+        }
+}
+
+int main(int argc, char **argv) {
+        if (argc < 2) {
+                fprintf(stderr, "Usage: %s <timeline> [--mid|--dma]\n", argv[0]);
+                return 1;
+        }
+
+        struct timeline *timeline = TimelineLoad(argv[1]);
+        if (NULL == timeline) {
+                fprintf(stderr, "Couldn't load timeline: %s\n", argv[1]);
+                return 1;
+        }
+
+        if (argc > 2 && 0 == strcmp(argv[2], "--mid")) {
+                DumpMidScanlineWrites(timeline);
+                TimelineDeinit(timeline);
+                return 0;
+        }
+
+        bool isDmaShown = argc > 2 && 0 == strcmp(argv[2], "--dma");
+
+        printf("%8s %8s %5s  %-5s %-5s %-9s %s\n", "frame", "scanline", "cycle", "", "addr", "register", "data");
+        for (uint32_t i = 0; i < TimelineCount(timeline); i++) {
+                struct timeline_entry entry = TimelineGet(timeline, i);
+
+                const char *access = "write";
+                const char *name = registerNames[entry.addr & 0x0007];
+                if (TIMELINE_READ == entry.kind) {
+                        access = "read";
+                } else if (TIMELINE_OAM_DMA == entry.kind) {
+                        if (!isDmaShown) {
+                                continue;
+                        }
+                        access = "dma";
+                        name = "OAM";
+                } else if (0x4014 == entry.addr) {
+                        name = "OAMDMA";
+                }
+
+                printf("%8u %8d %5u  %-5s $%04X %-9s $%02X\n",
+                       entry.frame, entry.scanline, entry.cycle, access, entry.addr, name, entry.data);
+        }
+
+        TimelineDeinit(timeline);
+        return 0;
+}